@@ -3,26 +3,50 @@
 #include "fx.h"
 #include "../globals.h"
 #include "../mathlib.h"
+#include "../util/pixel_ops.h"
 
 #define FADE_DURATION 1.0f
 
-int get_fade_bias(float start_time, float end_time)
+FxOptions g_fx_options = {
+	.xor_dda = 0,
+	.sdf_mode = kSdfAnalytic,
+	.march_warm_start = 1,
+	.cone_prepass = 0,
+	.raymarch_fixed = RAYMARCH_FIXED_POINT,
+	.raymarch_compare = 0,
+	.plasma_spans = 1,
+	.kefren_bar_count = 120,
+};
+
+#define FLASH_BIAS 50
+
+// 1 is all white, 0 no fade
+static float get_fade_amount(float start_time, float end_time)
 {
-	int bias = 0;
+	float fade = 0.0f;
 	float t = G.time;
 	if (G.ending)
 	{
 		if (t < FADE_DURATION)
-			bias = (int)lerp(-250.0f, 0.0f, t);
+			fade = 1.0f - t / FADE_DURATION;
 	}
 	else
 	{
 		if (t < start_time + FADE_DURATION)
-			bias = (int)lerp(-250.0f, 0.0f, t - start_time);
+			fade = 1.0f - (t - start_time) / FADE_DURATION;
 		if (t > end_time - FADE_DURATION)
-			bias = (int)lerp(0.0f, -250.0f, t - (end_time - FADE_DURATION));
+			fade = (t - (end_time - FADE_DURATION)) / FADE_DURATION;
 	}
+	return saturate(fade);
+}
 
-	bias = MIN(0, bias);
-	return bias;
+void get_fade_tone(uint8_t tone_lut[256], float start_time, float end_time, bool flash)
+{
+	ToneParams params = {
+		.bias = flash ? FLASH_BIAS : 0,
+		.contrast = 1.0f,
+		.gamma = 1.0f,
+		.fade = get_fade_amount(start_time, end_time),
+	};
+	build_tone_lut(tone_lut, &params);
 }
\ No newline at end of file
@@ -2,10 +2,14 @@
 
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
 void fx_plasma_init();
 void fx_raytrace_init();
 void fx_starfield_init();
 void fx_prettyhip_init();
+void fx_mesh_init();
 
 typedef void (*fx_update_function)(float start_time, float end_time, float alpha);
 
@@ -14,5 +18,35 @@ void fx_prettyhip_update(float start_time, float end_time, float alpha);
 void fx_plasma_update(float start_time, float end_time, float alpha);
 void fx_raymarch_update(float start_time, float end_time, float alpha);
 void fx_raytrace_update(float start_time, float end_time, float alpha);
+void fx_mesh_update(float start_time, float end_time, float alpha);
+void fx_mesh_wireframe_update(float start_time, float end_time, float alpha);
+void fx_mesh_gouraud_update(float start_time, float end_time, float alpha);
+void fx_mesh_stack_update(float start_time, float end_time, float alpha);
+
+// Tone curve for draw_dithered_screen_tone: fades in from white at the start of a part and out
+// to white at its end, darkened a bit on the beat when flash is set.
+void get_fade_tone(uint8_t tone_lut[256], float start_time, float end_time, bool flash);
+
+// Compile in fixed point (Q16.16) versions of the raymarcher kernels, e.g. for CPUs without
+// a fast FPU; g_fx_options.raymarch_fixed then picks which ones are used.
+#define RAYMARCH_FIXED_POINT 0
+
+typedef enum {
+	kSdfAnalytic, // evaluate the distance functions
+	kSdfGridNearest, // look up from baked 3D grids, nearest sample
+	kSdfGridTrilinear, // look up from baked 3D grids, trilinear filtered
+} SdfMode;
+
+// Quality/performance switches of the effects; benchmark mode flips these to compare variants.
+typedef struct FxOptions {
+	int xor_dda; // XOR Towers: exact voxel traversal instead of growing step marching (slower on PC)
+	int sdf_mode; // SdfMode of the raymarched scenes
+	int march_warm_start; // Puls: start marching from the previous hit distance of the pixel
+	int cone_prepass; // Raymarcher: start pixel rays from a coarse per-tile cone march (approximate)
+	int raymarch_fixed; // Raymarcher: use fixed point kernels (needs RAYMARCH_FIXED_POINT)
+	int raymarch_compare; // Raymarcher: also run the float kernels, and count the differences
+	int plasma_spans; // Plasma: evaluate the cube/ring only within their projected spans of each row
+	int kefren_bar_count; // Prettyhip: number of Kefren bars over the screen height
+} FxOptions;
 
-int get_fade_bias(float start_time, float end_time);
+extern FxOptions g_fx_options;
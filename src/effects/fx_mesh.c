@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: Unlicense
+
+#include "fx.h"
+#include "../globals.h"
+
+#include "../platform.h"
+#include "../mathlib.h"
+#include "../mini3d/mesh.h"
+#include "../util/pixel_ops.h"
+
+#include <string.h>
+
+// Polygonal scenes: a ring of tori that the camera flies through (so that the near plane
+// clipping gets exercised), flat shaded or wireframe into the framebuffer, or gouraud shaded and
+// dithered.
+// Not on the demo timeline yet; benchmark mode runs them.
+
+#define TORUS_RING_SEGS (32)
+#define TORUS_TUBE_SEGS (12)
+#define TORUS_VERTS (TORUS_RING_SEGS * TORUS_TUBE_SEGS)
+#define TORUS_TRIS (TORUS_VERTS * 2)
+#define TORUS_COUNT (6)
+
+static float3 s_torus_verts[TORUS_VERTS];
+static float3 s_torus_normals[TORUS_VERTS];
+static uint16_t s_torus_indices[TORUS_TRIS * 3];
+static Mesh s_torus = { s_torus_verts, TORUS_VERTS, s_torus_indices, TORUS_TRIS, NULL };
+static Mesh s_torus_smooth = { s_torus_verts, TORUS_VERTS, s_torus_indices, TORUS_TRIS, s_torus_normals };
+
+static void build_torus(float ring_radius, float tube_radius)
+{
+	for (int i = 0; i < TORUS_RING_SEGS; ++i)
+	{
+		float a = i * (2.0f * M_PIf / TORUS_RING_SEGS);
+		for (int j = 0; j < TORUS_TUBE_SEGS; ++j)
+		{
+			float b = j * (2.0f * M_PIf / TORUS_TUBE_SEGS);
+			float r = ring_radius + tube_radius * cosf(b);
+			s_torus_verts[i * TORUS_TUBE_SEGS + j] = (float3){ r * cosf(a), tube_radius * sinf(b), r * sinf(a) };
+			s_torus_normals[i * TORUS_TUBE_SEGS + j] = (float3){ cosf(b) * cosf(a), sinf(b), cosf(b) * sinf(a) };
+		}
+	}
+	uint16_t* idx = s_torus_indices;
+	for (int i = 0; i < TORUS_RING_SEGS; ++i)
+	{
+		int i1 = (i + 1) % TORUS_RING_SEGS;
+		for (int j = 0; j < TORUS_TUBE_SEGS; ++j)
+		{
+			int j1 = (j + 1) % TORUS_TUBE_SEGS;
+			uint16_t v00 = (uint16_t)(i * TORUS_TUBE_SEGS + j), v01 = (uint16_t)(i * TORUS_TUBE_SEGS + j1);
+			uint16_t v10 = (uint16_t)(i1 * TORUS_TUBE_SEGS + j), v11 = (uint16_t)(i1 * TORUS_TUBE_SEGS + j1);
+			*idx++ = v00; *idx++ = v11; *idx++ = v01;
+			*idx++ = v00; *idx++ = v10; *idx++ = v11;
+		}
+	}
+}
+
+void fx_mesh_init()
+{
+	mesh_init();
+	build_torus(1.0f, 0.35f);
+}
+
+static void submit_tori(const Mesh* torus)
+{
+	float t = G.time * 0.25f;
+	mesh_begin_frame((float3){ -0.4f, 0.7f, -0.6f }, 0.1f);
+	for (int i = 0; i < TORUS_COUNT; ++i)
+	{
+		// tori along a circle around the camera path; the camera moves along z through them
+		float a = i * (2.0f * M_PIf / TORUS_COUNT) + t * 0.3f;
+		float z = fmodf(i * 3.0f - t * 3.0f, TORUS_COUNT * 3.0f);
+		if (z < 0.0f)
+			z += TORUS_COUNT * 3.0f;
+		float3 pos = { cosf(a) * 2.0f, sinf(a) * 1.2f, z };
+		MeshPose pose;
+		mesh_pose_from_angles(&pose, t + i, t * 0.7f + i * 0.5f, t * 0.3f, pos);
+		mesh_submit(torus, &pose);
+	}
+}
+
+void fx_mesh_update(float start_time, float end_time, float alpha)
+{
+	plat_gfx_clear(kSolidColorBlack);
+	submit_tori(&s_torus);
+	mesh_end_frame(G.framebuffer, G.framebuffer_stride, false, NULL); // little overlap
+}
+
+void fx_mesh_wireframe_update(float start_time, float end_time, float alpha)
+{
+	static const uint8_t kWhite[8] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+	plat_gfx_clear(kSolidColorBlack);
+	submit_tori(&s_torus);
+	mesh_end_frame_wireframe(G.framebuffer, G.framebuffer_stride, 1, kWhite, NULL);
+}
+
+void fx_mesh_gouraud_update(float start_time, float end_time, float alpha)
+{
+	memset(g_screen_buffer, 0, SCREEN_X * SCREEN_Y);
+	submit_tori(&s_torus_smooth);
+	mesh_end_frame_gouraud(g_screen_buffer, SCREEN_X, NULL);
+	draw_dithered_screen(G.framebuffer, 0);
+}
+
+// Depth complexity test: a stack of tumbling tori along the view axis, each covering a good
+// part of the screen, so most pixels are within several of them.
+#define STACK_TORUS_COUNT (16)
+
+void fx_mesh_stack_update(float start_time, float end_time, float alpha)
+{
+	plat_gfx_clear(kSolidColorBlack);
+
+	float t = G.time * 0.25f;
+	mesh_begin_frame((float3){ -0.4f, 0.7f, -0.6f }, 0.1f);
+	for (int i = 0; i < STACK_TORUS_COUNT; ++i)
+	{
+		float3 pos = { sinf(t + i * 0.7f) * 0.4f, cosf(t * 1.3f + i) * 0.3f, 3.0f + i * 0.6f };
+		MeshPose pose;
+		mesh_pose_from_angles(&pose, t * 0.5f + i, 1.2f + sinf(t + i) * 0.4f, t * 0.2f, pos);
+		mesh_submit(&s_torus, &pose);
+	}
+	mesh_end_frame(G.framebuffer, G.framebuffer_stride, true, NULL);
+}
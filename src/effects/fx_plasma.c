@@ -6,6 +6,8 @@
 #include "fx.h"
 #include "../mathlib.h"
 #include "../util/pixel_ops.h"
+#include "../util/perf_stats.h"
+#include <string.h>
 
 #define TRIG_TABLE_SIZE 512
 #define TRIG_TABLE_MASK (TRIG_TABLE_SIZE-1)
@@ -42,6 +44,48 @@ static uint16_t s_plasma_pos2;
 static uint16_t s_plasma_pos3;
 static uint16_t s_plasma_pos4;
 
+// Plasma is a sum of two sines along x and two along y. The x terms of the pixels evaluated this
+// frame go into a table, the y terms are one value per row; both biased to be non-negative, so
+// that the sum of two fits into 14 bits.
+#define PLASMA_TERM_BIAS (2 * TRIG_TABLE_SCALE)
+static uint16_t s_plasma_cols[SCREEN_X / 2];
+
+static void plasma_init_columns(int col_offset)
+{
+	for (int i = 0; i < SCREEN_X / 2; ++i)
+	{
+		int px = col_offset + i * 2;
+		int tpos1 = (s_plasma_pos1 + 5 + px * 5) & TRIG_TABLE_MASK;
+		int tpos2 = (s_plasma_pos2 + 3 + px * 3) & TRIG_TABLE_MASK;
+		s_plasma_cols[i] = (uint16_t)(s_sin_table[tpos1] + s_sin_table[tpos2] + PLASMA_TERM_BIAS);
+	}
+}
+
+static inline int plasma_value(int col, int row_term)
+{
+	// the bias of the sum is a multiple of 128<<4, so it does not change the result
+	return 128 + (((s_plasma_cols[col] + row_term) >> 4) & 127);
+}
+
+// Plasma values for columns [col_start, col_end) of a row, written to every other byte of dst
+// (which is the pixel of col_start). Two pixels at once in 16 bit lanes of a 32 bit word (sums
+// never carry across lanes); col_start has to be even.
+static void plasma_row_kernel(uint8_t* dst, int col_start, int col_end, int row_term)
+{
+	const uint32_t row2 = (uint32_t)row_term * 0x00010001u;
+	int col = col_start;
+	for (; col + 2 <= col_end; col += 2, dst += 4)
+	{
+		uint32_t cols2;
+		memcpy(&cols2, &s_plasma_cols[col], sizeof(cols2));
+		uint32_t v = (((cols2 + row2) >> 4) & 0x007F007Fu) | 0x00800080u;
+		dst[0] = (uint8_t)v;
+		dst[2] = (uint8_t)(v >> 16);
+	}
+	if (col < col_end)
+		dst[0] = (uint8_t)plasma_value(col, row_term);
+}
+
 
 // raymarching a very simplified version of "twisty cuby" by DJDoomz
 // https://www.shadertoy.com/view/MtdyWj
@@ -120,6 +164,103 @@ static int eval_ring_twister(const EvalState* st, float x, float y)
 }
 
 
+// Ring is where abs((x*x+y*y)*2.4-1.3) <= 1: an annulus, so a row crosses it in one or two x ranges.
+static int ring_row_spans(float y, float spans[2][2])
+{
+	float outer2 = (2.3f / 2.4f) - y * y;
+	if (outer2 < 0.0f)
+		return 0;
+	float outer = sqrtf(outer2);
+	float inner2 = (0.3f / 2.4f) - y * y;
+	if (inner2 <= 0.0f)
+	{
+		spans[0][0] = -outer; spans[0][1] = outer;
+		return 1;
+	}
+	float inner = sqrtf(inner2);
+	spans[0][0] = -outer; spans[0][1] = -inner;
+	spans[1][0] = inner; spans[1][1] = outer;
+	return 2;
+}
+
+// The cube is hit only where the position after the first march step is within 1.0 of it, i.e.
+// inside the cube grown to half size 3.7. That step starts at 4 units along the ray and does not
+// go backwards unless the start already is inside the cube, so only the part of the grown cube
+// beyond that start plane matters. The row is covered by the screen projection of that part,
+// rotated by the twist of the row: slice it at y. Returns number of spans (0 or 1); the effect
+// only draws the cube within abs(x) < 1 anyway.
+#define CUBE_HIT_HALF_SIZE (2.7f + 1.0f)
+#define CUBE_START_Z (4.0f * 0.8f)
+static int cube_row_span(const EvalState* st, float y, float span[2])
+{
+	// grown cube corners relative to the ray origin; rays are pos + s * {x, y, 0.8}
+	float3 corners[8];
+	for (int i = 0; i < 8; ++i)
+	{
+		float3 c = {
+			(i & 1) ? CUBE_HIT_HALF_SIZE : -CUBE_HIT_HALF_SIZE,
+			(i & 2) ? CUBE_HIT_HALF_SIZE : -CUBE_HIT_HALF_SIZE,
+			(i & 4) ? CUBE_HIT_HALF_SIZE : -CUBE_HIT_HALF_SIZE };
+		// the rotations in sdf_twisty_cuby are their own inverses; undo them in reverse order
+		float n1 = st->rotm_ty6 * c.y + st->rotm_tx6 * c.x;
+		float n2 = st->rotm_tx6 * c.y - st->rotm_ty6 * c.x;
+		c.y = n1; c.x = n2;
+		n1 = st->rotm_ty * c.x + st->rotm_tx * c.z;
+		n2 = st->rotm_tx * c.x - st->rotm_ty * c.z;
+		c.x = n1; c.z = n2;
+		corners[i] = (float3){ c.x - st->pos.x, c.y - st->pos.y, c.z + 6.0f - st->pos.z };
+	}
+
+	// screen positions of the corners beyond the start plane, and of the edges crossing it
+	float sx[8 + 12], sy[8 + 12];
+	int count = 0;
+	for (int i = 0; i < 8; ++i)
+	{
+		const float3* a = &corners[i];
+		if (a->z >= CUBE_START_Z)
+		{
+			sx[count] = a->x * 0.8f / a->z;
+			sy[count] = a->y * 0.8f / a->z;
+			++count;
+		}
+		for (int bit = 1; bit < 8; bit <<= 1)
+		{
+			if (i & bit)
+				continue;
+			const float3* b = &corners[i | bit];
+			if ((a->z < CUBE_START_Z) == (b->z < CUBE_START_Z))
+				continue;
+			float f = (CUBE_START_Z - a->z) / (b->z - a->z);
+			sx[count] = (a->x + (b->x - a->x) * f) * (0.8f / CUBE_START_Z);
+			sy[count] = (a->y + (b->y - a->y) * f) * (0.8f / CUBE_START_Z);
+			++count;
+		}
+	}
+
+	// the convex hull edges are among the point pair segments, so slicing all of them gives the hull slice
+	float xmin = 1.0f, xmax = -1.0f;
+	for (int i = 0; i < count; ++i)
+	{
+		if (sy[i] == y)
+		{
+			xmin = MIN(xmin, sx[i]);
+			xmax = MAX(xmax, sx[i]);
+		}
+		for (int j = i + 1; j < count; ++j)
+		{
+			float di = sy[i] - y, dj = sy[j] - y;
+			if ((di < 0.0f) == (dj < 0.0f) || di == dj)
+				continue;
+			float x = sx[i] + (sx[j] - sx[i]) * (di / (di - dj));
+			xmin = MIN(xmin, x);
+			xmax = MAX(xmax, x);
+		}
+	}
+	span[0] = MAX(xmin, -1.0f);
+	span[1] = MIN(xmax, 1.0f);
+	return span[0] <= span[1] ? 1 : 0;
+}
+
 void fx_plasma_update(float start_time, float end_time, float alpha)
 {
 	int tpos4 = s_plasma_pos4;
@@ -142,6 +283,10 @@ void fx_plasma_update(float start_time, float end_time, float alpha)
 
 	int t_frame_index = G.frame_count & 3;
 
+	// all the rows evaluated in a frame use the same column offset
+	int frame_col_offset = MAX(g_order_pattern_2x2[t_frame_index][0], g_order_pattern_2x2[t_frame_index][1]) - 1;
+	plasma_init_columns(frame_col_offset);
+
 	float y = ysize / 2 - dy;
 	for (int py = 0; py < SCREEN_Y; ++py, tpos4 += 3, tpos3 += 1, y -= dy)
 	{
@@ -153,46 +298,59 @@ void fx_plasma_update(float start_time, float end_time, float alpha)
 		if (col_offset < 0)
 			continue; // this row does not evaluate any pixels
 
-		float x = -xsize / 2 + dx * 0.5f;
-		int pix_idx = py * SCREEN_X;
-		x += dx * col_offset;
-		pix_idx += col_offset;
+		float x0 = -xsize / 2 + dx * 0.5f + dx * col_offset;
+		uint8_t* row_pix = g_screen_buffer + py * SCREEN_X + col_offset;
+		int row_term = s_sin_table[tpos3] + s_sin_table[tpos4] + PLASMA_TERM_BIAS;
 
+		// x ranges where the cube/ring can be; everything else is plasma only
+		float spans_x[2][2];
+		int span_count;
 		if (twisty_cube)
 		{
 			float tt = t + 0.2f * sinf(y * 1.5f + t);
 			st.rotm_tx = cosf(tt); st.rotm_ty = sinf(tt);
 			st.rotm_tx6 = cosf(tt * 0.6f); st.rotm_ty6 = sinf(tt * 0.6f);
 		}
-
-		for (int px = col_offset; px < SCREEN_X; px += 2, x += dx * 2, pix_idx += 2)
+		if (!g_fx_options.plasma_spans)
 		{
-			int tpos1 = s_plasma_pos1 + 5 + px * 5;
-			int tpos2 = s_plasma_pos2 + 3 + px * 3;
-			tpos1 &= TRIG_TABLE_MASK;
-			tpos2 &= TRIG_TABLE_MASK;
-
-			int plasma = s_sin_table[tpos1] + s_sin_table[tpos2] + s_sin_table[tpos3] + s_sin_table[tpos4];
-
-			int val = 128 + ((plasma >> 4) & 127);
+			// whole row through the object evaluation, as before the spans
+			spans_x[0][0] = -xsize;
+			spans_x[0][1] = xsize;
+			span_count = 1;
+		}
+		else if (twisty_cube)
+			span_count = cube_row_span(&st, y, spans_x[0]);
+		else
+			span_count = ring_row_spans(y, spans_x);
 
-			if (twisty_cube)
-			{
-				if (fabsf(x) < 1.0f)
-				{
-					int cube_val = trace_twisty_cuby(&st, x, y);
-					if (cube_val >= 0)
-						val = cube_val;
-				}
-			}
-			else
+		int col = 0;
+		for (int i = 0; i < span_count; ++i)
+		{
+			// to columns, with a bit of margin, even aligned for the plasma kernel
+			int span_start = (int)floorf((spans_x[i][0] - x0) / (dx * 2)) - 1;
+			int span_end = (int)ceilf((spans_x[i][1] - x0) / (dx * 2)) + 2;
+			span_start = MAX(col, span_start) & ~1;
+			span_end = MIN(SCREEN_X / 2, (span_end + 1) & ~1);
+			if (span_end <= span_start)
+				continue;
+			PERF_COUNT(kPerfPlasmaObjPixels, span_end - span_start);
+
+			plasma_row_kernel(row_pix + col * 2, col, span_start, row_term);
+			for (col = span_start; col < span_end; ++col)
 			{
-				int ring_val = eval_ring_twister(&st, x, y);
-				if (ring_val >= 0)
-					val = ring_val;
+				// not accumulated, so that the result does not depend on where the span starts
+				float x = x0 + dx * 2 * col;
+				int val = -1;
+				if (!twisty_cube)
+					val = eval_ring_twister(&st, x, y);
+				else if (fabsf(x) < 1.0f)
+					val = trace_twisty_cuby(&st, x, y);
+				if (val < 0)
+					val = plasma_value(col, row_term);
+				row_pix[col * 2] = val;
 			}
-			g_screen_buffer[pix_idx] = val;
 		}
+		plasma_row_kernel(row_pix + col * 2, col, SCREEN_X / 2, row_term);
 	}
 
 	s_plasma_pos1 += 7;
@@ -204,8 +362,9 @@ void fx_plasma_update(float start_time, float end_time, float alpha)
 		s_plasma_pos4 = (int)(sinf(G.crank_angle_rad) * 431);
 	}
 
-	int bias = (G.beat ? 50 : 0) + get_fade_bias(start_time, end_time);
-	draw_dithered_screen(G.framebuffer, bias);
+	uint8_t tone_lut[256];
+	get_fade_tone(tone_lut, start_time, end_time, G.beat);
+	draw_dithered_screen_tone(G.framebuffer, tone_lut);
 }
 
 void fx_plasma_init()
@@ -36,40 +36,120 @@ typedef struct EvalState
 	float rotmx, rotmy;
 } EvalState;
 
-static int eval_color(EvalState* st, float x, float y)
+// x dependent parts of the rotated coordinates, for the columns evaluated this frame
+static float s_col_ux[SCREEN_X / 2];
+static float s_col_uy[SCREEN_X / 2];
+
+static void prettyhip_init_columns(const EvalState* st, int col_offset, float xsize, float dx)
+{
+	// same x accumulation as a per pixel loop would do
+	float x = -xsize / 2 + dx * 0.5f + dx * col_offset;
+	for (int i = 0; i < SCREEN_X / 2; ++i, x += dx * 2)
+	{
+		s_col_ux[i] = st->rotmy * x;
+		s_col_uy[i] = st->rotmx * x;
+	}
+}
+
+// Index just past the run of [start, count) that stays in the same cell as u[start] (ceilf
+// does not change), given approximate per column step du. u is monotonic along a row.
+static int cell_run_end(const float* u, int start, int count, float du)
 {
-	float ux = st->rotmy * x + st->rotmx * y;
-	float uy = st->rotmx * x - st->rotmy * y;
-	ux = ux * 10.0f + 5.0f;
-	uy = uy * 10.0f + 5.0f;
-	float fx = fract(ux);
-	float fy = fract(uy);
-	fx = MIN(fx, 1.0f - fx);
-	fy = MIN(fy, 1.0f - fy);
-
-	// the calculation below is a small table, so lookup:
-	//float cx = ceilf(ux) - 5.5f;
-	//float cy = ceilf(uy) - 5.5f;
-	//float s = sqrtf(cx * cx + cy * cy);
-	int lcx = (int)ceilf(ux);
-	int lcy = (int)ceilf(uy);
-	float s = s_uxuy_lookup[lcy][lcx];
-
-	float e = 2.0f * fract((st->t - s * 0.5f) * 0.25f) - 1.0f;
-	float v = fract(4.0f * MIN(fx, fy));
-	float b = 0.95f * (e < 0.0f ? v : 1.0f - v) - e * e;
-	//float a = smoothstep(-0.05f, 0.0f, b) + s * 0.1f;
-	float a = invlerp(-0.05f, 0.0f, b) + s * 0.1f;
-
-	float res = st->alpha < 0.5f ? e : a;
-	return MIN(255, (int)(res * 250.0f));
+	float cell = ceilf(u[start]);
+	// a value is in the cell when cell-1 < v <= cell
+	int end = count;
+	if (du > 0.0f)
+		end = start + 1 + (int)((cell - u[start]) / du);
+	else if (du < 0.0f)
+		end = start + 1 + (int)((u[start] - (cell - 1.0f)) / -du);
+	end = MIN(MAX(end, start + 1), count);
+	while (end < count && u[end] <= cell && u[end] > cell - 1.0f)
+		++end;
+	while (end > start + 1 && !(u[end - 1] <= cell && u[end - 1] > cell - 1.0f))
+		--end;
+	return end;
+}
+
+// Evaluates the columns of one row into every other byte of dst. The rotated coordinates are
+// affine along the row; the cell dependent part (distance lookup, wave phase e) is evaluated once
+// per run of pixels within the same cell.
+static void prettyhip_row_kernel(const EvalState* st, uint8_t* dst, float y)
+{
+	float ux[SCREEN_X / 2], uy[SCREEN_X / 2];
+	const float row_ux = st->rotmx * y;
+	const float row_uy = st->rotmy * y;
+	for (int i = 0; i < SCREEN_X / 2; ++i)
+	{
+		ux[i] = (s_col_ux[i] + row_ux) * 10.0f + 5.0f;
+		uy[i] = (s_col_uy[i] - row_uy) * 10.0f + 5.0f;
+	}
+	const float dux = (ux[SCREEN_X / 2 - 1] - ux[0]) / (SCREEN_X / 2 - 1);
+	const float duy = (uy[SCREEN_X / 2 - 1] - uy[0]) / (SCREEN_X / 2 - 1);
+
+	int col = 0;
+	while (col < SCREEN_X / 2)
+	{
+		int end = MIN(cell_run_end(ux, col, SCREEN_X / 2, dux), cell_run_end(uy, col, SCREEN_X / 2, duy));
+
+		// cell center distance is a small table, so lookup:
+		//float cx = ceilf(ux) - 5.5f;
+		//float cy = ceilf(uy) - 5.5f;
+		//float s = sqrtf(cx * cx + cy * cy);
+		int lcx = (int)ceilf(ux[col]);
+		int lcy = (int)ceilf(uy[col]);
+		float s = s_uxuy_lookup[lcy][lcx];
+		float e = 2.0f * fract((st->t - s * 0.5f) * 0.25f) - 1.0f;
+
+		if (st->alpha < 0.5f)
+		{
+			uint8_t val = (uint8_t)MIN(255, (int)(e * 250.0f));
+			for (; col < end; ++col)
+				dst[col * 2] = val;
+			continue;
+		}
+
+		// floor of everything in the cell; for u exactly on the upper edge fract would be 0
+		// instead of 1, both fold to the same distance to the edge
+		const float floor_x = (float)(lcx - 1);
+		const float floor_y = (float)(lcy - 1);
+		const float e2 = e * e;
+		const float v_sign = e < 0.0f ? 1.0f : -1.0f;
+		const float v_base = e < 0.0f ? 0.0f : 1.0f;
+		const float s_term = s * 0.1f;
+		for (; col < end; ++col)
+		{
+			float fx = ux[col] - floor_x;
+			float fy = uy[col] - floor_y;
+			fx = MIN(fx, 1.0f - fx);
+			fy = MIN(fy, 1.0f - fy);
+			float m = 4.0f * MIN(fx, fy); // within [0, 2]
+			float v = m - (m >= 2.0f ? 2.0f : m >= 1.0f ? 1.0f : 0.0f);
+			float b = 0.95f * (v_base + v_sign * v) - e2;
+			//float a = smoothstep(-0.05f, 0.0f, b) + s * 0.1f;
+			float a = invlerp(-0.05f, 0.0f, b) + s_term;
+			dst[col * 2] = (uint8_t)MIN(255, (int)(a * 250.0f));
+		}
+	}
 }
 
-#define MAX_BARS (240)
-static int s_bar_count = 120;
+#define MAX_BARS (1024)
 #define BAR_WIDTH (17)
 static uint8_t kBarColors[BAR_WIDTH] = { 5, 50, 96, 134, 165, 189, 206, 216, 220, 216, 206, 189, 165, 134, 96, 50, 5 };
 
+// left edge of each bar this frame
+static int16_t s_bar_x[MAX_BARS];
+
+static void kefren_place_bars(int bar_count, float time)
+{
+	const float kSinStep1 = 0.093f;
+	const float kSinStep2 = -0.063f;
+	for (int idx = 0; idx < bar_count; ++idx)
+	{
+		float bar_x = (sinf(time * 1.1f + kSinStep1 * idx) + sinf(time * 2.3f + kSinStep2 * idx)) * SCREEN_X * 0.1f + SCREEN_X / 2;
+		s_bar_x[idx] = (int16_t)(((int)bar_x) - BAR_WIDTH / 2);
+	}
+}
+
 
 void fx_prettyhip_update(float start_time, float end_time, float alpha)
 {
@@ -86,8 +166,13 @@ void fx_prettyhip_update(float start_time, float end_time, float alpha)
 	float dx = xsize / SCREEN_X;
 	float dy = ysize / SCREEN_Y;
 
-	float y = ysize / 2 - dy * 0.5f;
 	int t_frame_index = G.frame_count & 3;
+
+	// all the rows evaluated in a frame use the same column offset
+	int frame_col_offset = MAX(g_order_pattern_2x2[t_frame_index][0], g_order_pattern_2x2[t_frame_index][1]) - 1;
+	prettyhip_init_columns(&st, frame_col_offset, xsize, dx);
+
+	float y = ysize / 2 - dy * 0.5f;
 	for (int py = 0; py < SCREEN_Y; ++py, y -= dy)
 	{
 		int t_row_index = py & 1;
@@ -95,53 +180,55 @@ void fx_prettyhip_update(float start_time, float end_time, float alpha)
 		if (col_offset < 0)
 			continue; // this row does not evaluate any pixels
 
-		float x = -xsize / 2 + dx * 0.5f;
-		int pix_idx = py * SCREEN_X;
-
-		x += dx * col_offset;
-		pix_idx += col_offset;
-		for (int px = col_offset; px < SCREEN_X; px += 2, x += dx * 2, pix_idx += 2)
-		{
-			int val = eval_color(&st, x, y);
-			g_screen_buffer[pix_idx] = val;
-		}
+		prettyhip_row_kernel(&st, g_screen_buffer + py * SCREEN_X + col_offset, y);
 	}
 
 	// foreground: kefren bars
 	uint8_t bar_line[SCREEN_X];
 	memset(bar_line, 0xFF, sizeof(bar_line));
 
-	const float kSinStep1 = 0.093f;
-	const float kSinStep2 = -0.063f;
+	int bar_count = MIN(g_fx_options.kefren_bar_count, MAX_BARS);
+	kefren_place_bars(bar_count, G.time * 0.3f);
+
+	// bars only ever get added to the line, so track the covered span; next to each other the bars
+	// overlap (sum of the sines moves by at most ~6 pixels per bar), so it normally has no holes
+	int cover_start = SCREEN_X, cover_end = 0;
+	bool cover_holes = false;
 
-	float time = G.time * 0.3f;
-	float bar_step = (float)s_bar_count / (float)SCREEN_Y;
-	int prev_bar_idx = -1;
+	float bar_step = (float)bar_count / (float)SCREEN_Y;
+	int next_bar_idx = 0;
 	float bar_idx = 0.0f;
 	for (int py = 0; py < SCREEN_Y; ++py, bar_idx += bar_step) {
-		int idx = (int)bar_idx;
-		if (idx != prev_bar_idx) {
-			prev_bar_idx = idx;
-
-			// Draw a new bar into our scanline
-			float bar_x = (sinf(time * 1.1f + kSinStep1 * idx) + sinf(time * 2.3f + kSinStep2 * idx)) * SCREEN_X * 0.1f + SCREEN_X / 2;
-			int bar_ix = ((int)bar_x) - BAR_WIDTH / 2;
-			for (int x = 0; x < BAR_WIDTH; ++x) {
-				bar_line[bar_ix + x] = kBarColors[x];
-			}
+		// Draw the new bars into our scanline
+		int idx = MIN((int)bar_idx, bar_count - 1);
+		for (; next_bar_idx <= idx; ++next_bar_idx) {
+			int bar_ix = s_bar_x[next_bar_idx];
+			memcpy(bar_line + bar_ix, kBarColors, BAR_WIDTH);
+			if (bar_ix > cover_end || bar_ix + BAR_WIDTH < cover_start)
+				cover_holes |= cover_start < cover_end;
+			cover_start = MIN(cover_start, bar_ix);
+			cover_end = MAX(cover_end, bar_ix + BAR_WIDTH);
 		}
+		if (cover_start >= cover_end)
+			continue;
 
 		uint8_t* dst = g_screen_buffer + py * SCREEN_X;
 		//int row_bias = 50 - (SCREEN_Y - py) / 2; // fade to white near top, more black at bottom
-		for (int px = 0; px < SCREEN_X; ++px, ++dst)
+		if (!cover_holes)
+		{
+			memcpy(dst + cover_start, bar_line + cover_start, cover_end - cover_start);
+			continue;
+		}
+		for (int px = cover_start; px < cover_end; ++px)
 		{
 			uint8_t v = bar_line[px];
 			if (v == 0xFF)
 				continue;
-			*dst = v;
+			dst[px] = v;
 		}
 	}
 
-	int bias = (G.beat ? 50 : 0) + get_fade_bias(start_time, end_time);
-	draw_dithered_screen(G.framebuffer, bias);
+	uint8_t tone_lut[256];
+	get_fade_tone(tone_lut, start_time, end_time, G.beat);
+	draw_dithered_screen_tone(G.framebuffer, tone_lut);
 }
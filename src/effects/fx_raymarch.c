@@ -3,41 +3,140 @@
 #include "../globals.h"
 
 #include "../platform.h"
+#include "fx.h"
 #include "../mathlib.h"
+#include "../util/perf_stats.h"
 #include "../util/pixel_ops.h"
+#include "../util/sdf_grid.h"
+#include "../util/fixed_point.h"
+#include "../util/fast_math.h"
 #include "../external/aheasing/easing.h"
-#include "../mini3d/render.h"
+#include "../mini3d/lines.h"
 #include <string.h>
 
+// Per-frame ray setup: the (unnormalized) ray direction for screen position x,y is
+// cx*x + cy*y + c0 + cq*(x*x+y*y), i.e. a 3x3 camera matrix plus a quadratic term that
+// only Puls uses (its "fisheye" lens).
+typedef struct RayBasis
+{
+	float3 cx, cy, c0;
+	float3 cq;
+} RayBasis;
+
+// Ray directions along a row of pixels, stepped with forward differences. The quadratic
+// term has a constant second order difference, so all of that is just additions.
+typedef struct RayRow
+{
+	float3 dir;
+	float3 ddir;
+	float3 dddir;
+} RayRow;
+
+static inline float3 ray_dir(const RayBasis* basis, float x, float y)
+{
+	return v3_add(v3_add(v3_mulfl(basis->cx, x), v3_mulfl(basis->cy, y)), v3_add(basis->c0, v3_mulfl(basis->cq, x * x + y * y)));
+}
+
+static void ray_row_init(RayRow* row, const RayBasis* basis, float x, float y, float step)
+{
+	row->dir = ray_dir(basis, x, y);
+	row->ddir = v3_add(v3_mulfl(basis->cx, step), v3_mulfl(basis->cq, 2.0f * x * step + step * step));
+	row->dddir = v3_mulfl(basis->cq, 2.0f * step * step);
+}
+
+static inline void ray_row_step(RayRow* row)
+{
+	row->dir = v3_add(row->dir, row->ddir);
+}
+
+static inline void ray_row_step_quad(RayRow* row)
+{
+	row->dir = v3_add(row->dir, row->ddir);
+	row->ddir = v3_add(row->ddir, row->dddir);
+}
+
 typedef struct TraceState
 {
 	float t;
-	float rotmx, rotmy;
+	int sdf_mode; // SdfMode
 
-	float xor_rotmx, xor_rotmy;
-	float xor_scale;
+	RayBasis field_ray;
 	float xor_camx, xor_camy;
 	int xor_mask;
+	RayBasis xor_ray;
 
 	float sph_camx, sph_camy;
 	float sph_camdist;
 	float3 sponge_pos;
+	RayBasis sponge_ray;
 	float puls_t_param;
 	float puls_width_param;
-	float puls_cosa, puls_sina;
 	float3 puls_pos;
+	RayBasis puls_ray;
+
+#if RAYMARCH_FIXED_POINT
+	fx3 sph_cam_fx;
+	fx3 sponge_pos_fx;
+	fx3 puls_pos_fx;
+	fx32 puls_t_param_fx;
+	fx32 puls_width_param_fx;
+#endif
 } TraceState;
 
+#if RAYMARCH_FIXED_POINT
+static int raymarch_compare(int val_fixed, int val_float)
+{
+	int diff = fx_abs(val_fixed - val_float);
+	(void)diff; // only counted in benchmark mode
+	PERF_COUNT(kPerfFixedCompareRays, 1);
+	PERF_COUNT(kPerfFixedAbsDiff, diff);
+	PERF_COUNT(kPerfFixedDiffRays, diff != 0);
+	PERF_COUNT(kPerfFixedBigDiffRays, diff > 16);
+	return val_fixed;
+}
+
+// Pick the fixed point or the float version of a marching kernel; when comparing, run both
+// and count how much they differ. The fixed point kernels only evaluate the analytic distance
+// functions, so the grid sdf modes always use the float ones.
+#define RAYMARCH_KERNEL(name, st, ...) ( \
+	!g_fx_options.raymarch_fixed || (st)->sdf_mode != kSdfAnalytic ? name##_float(st, __VA_ARGS__) : \
+	g_fx_options.raymarch_compare ? raymarch_compare(name##_fx(st, __VA_ARGS__), name##_float(st, __VA_ARGS__)) : \
+	name##_fx(st, __VA_ARGS__))
+
+// Effect counters of the fixed point kernels; when comparing, only the float (reference) kernel
+// counts, so the numbers are not doubled.
+#define PERF_COUNT_FX(counter, n) do { if (!g_fx_options.raymarch_compare) PERF_COUNT(counter, n); } while (0)
+#else
+#define RAYMARCH_KERNEL(name, ...) name##_float(__VA_ARGS__)
+#endif
+
+// Where a sphere-traced ray starts: ray parameter, and how many steps that counts as
+// (some scenes shade by the step count).
+typedef struct MarchStart
+{
+	float t;
+	int steps;
+} MarchStart;
+
 
 // ------------------------------------------
 // "XOR Towers" by Greg Rostami https://www.shadertoy.com/view/7lsXR2 simplified - 10fps at 2x2t
 
-static int trace_xor_towers(TraceState* st, float x, float y)
+static int xor_height_to_color(float height)
+{
+	height = (height - 3) / 40.0f;
+	height *= height;
+	int res = (int)(height * 255.0f);
+	//res += G.beat ? 50 : 0;
+	res = MAX(0, res);
+	res = MIN(255, res);
+	return 255-res;
+}
+
+static int trace_xor_towers(const TraceState* st, float3 dir)
 {
-	x *= st->xor_scale;
-	y *= st->xor_scale;
-	float ux = st->xor_rotmy * x + st->xor_rotmx * y;
-	float uy = st->xor_rotmx * x - st->xor_rotmy * y;
+	float ux = dir.x;
+	float uy = dir.y;
 
 	float cx = st->xor_camx;
 	float cy = st->xor_camy;
@@ -63,65 +162,312 @@ static int trace_xor_towers(TraceState* st, float x, float y)
 		height += heightstep;
 		heightstep += 0.07f;
 	}
-	height = (height - 3) / 40.0f;
-	height *= height;
-	int res = (int)(height * 255.0f);
-	//res += G.beat ? 50 : 0;
-	res = MAX(0, res);
-	res = MIN(255, res);
-	return 255-res;
+	PERF_COUNT(kPerfXorRays, 1);
+	PERF_COUNT(kPerfXorSteps, it - MINSTEP);
+	return xor_height_to_color(height);
 #undef MAXSTEP
 }
 
+// Exact voxel traversal (Amanatides & Woo) of the same scene: the ray is at cx + ux * h, cy + uy * h
+// at height h, and we walk the (x, y, height) cells it passes through, in order. Finds thin
+// features that the marcher above steps over, and each step is just a couple compares and adds.
+//
+// A cell is solid when (bx ^ by ^ bz) & mask < bz - 8. Nothing is solid below height 9, so start
+// there. Above that, while the threshold is at most 2^k, all cells that have any of the bits >= k
+// set are empty; and those bits are the same over 2^k x 2^k x 2^k aligned blocks. So when the block
+// we are in has them set, jump right to where the ray exits it.
+#define XOR_DDA_START_HEIGHT 9
+#define XOR_DDA_MAX_HEIGHT 41.0f // about the same as where the marcher above gives up
+// DDA finds where the ray enters the solid cell, while the marcher reports a height that is on
+// average this much further (it stops somewhere inside the cell, and then adds one more step).
+#define XOR_DDA_HEIGHT_BIAS 3.5f
+
+// smallest k where (1 << k) >= threshold
+static const uint8_t kXorBlockLevel[64] = {
+	0, 0, 1, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4,
+	4, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+	5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+	6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+};
+
+#define XOR_DDA_MAX_STEPS 64
+// Smaller blocks are skipped more often, but cover fewer cells; 8x8 cells was the best tradeoff.
+#define XOR_DDA_MIN_BLOCK_LEVEL 3
+
+typedef struct XorDDA {
+	float ux, uy, cx, cy;
+	float hdeltax, hdeltay;
+	int stepx, stepy;
+	float h, hnextx, hnexty, hnextz;
+	int bx, by, bz;
+} XorDDA;
+
+static inline int xor_dda_floor(float v)
+{
+	int i = (int)v;
+	return i - (v < (float)i ? 1 : 0);
+}
+
+// height where the ray leaves the [lo, hi) interval along one axis
+static inline float xor_dda_exit(float c, float hdelta, int step, int lo, int hi)
+{
+	return ((step > 0 ? hi : lo) - c) * hdelta * step;
+}
+
+static void xor_dda_set_cell(XorDDA* dda, float h, int bx, int by, int bz)
+{
+	dda->h = h;
+	dda->bx = bx;
+	dda->by = by;
+	dda->bz = bz;
+	dda->hnextx = xor_dda_exit(dda->cx, dda->hdeltax, dda->stepx, bx, bx + 1);
+	dda->hnexty = xor_dda_exit(dda->cy, dda->hdeltay, dda->stepy, by, by + 1);
+	dda->hnextz = (float)(bz + 1);
+}
+
+// the block of 2^k cells around current cell is empty: continue from where the ray leaves it
+static void xor_dda_skip_block(XorDDA* dda, int k)
+{
+	int size = 1 << k;
+	int bx0 = dda->bx & ~(size - 1);
+	int by0 = dda->by & ~(size - 1);
+	// block ends at next 2^k boundary in height too, or where the threshold gets over 2^k
+	int bz1 = MIN((dda->bz | (size - 1)) + 1, size + 9);
+	float hx = xor_dda_exit(dda->cx, dda->hdeltax, dda->stepx, bx0, bx0 + size);
+	float hy = xor_dda_exit(dda->cy, dda->hdeltay, dda->stepy, by0, by0 + size);
+	float hz = (float)bz1;
+
+	int bx, by, bz;
+	float h;
+	if (hz <= hx && hz <= hy)
+	{
+		h = MAX(dda->h, hz);
+		bx = xor_dda_floor(dda->cx + dda->ux * h);
+		by = xor_dda_floor(dda->cy + dda->uy * h);
+		bz = bz1;
+	}
+	else if (hx <= hy)
+	{
+		h = MAX(dda->h, hx);
+		bx = dda->stepx > 0 ? bx0 + size : bx0 - 1;
+		by = xor_dda_floor(dda->cy + dda->uy * h);
+		bz = MAX(dda->bz, (int)h);
+	}
+	else
+	{
+		h = MAX(dda->h, hy);
+		bx = xor_dda_floor(dda->cx + dda->ux * h);
+		by = dda->stepy > 0 ? by0 + size : by0 - 1;
+		bz = MAX(dda->bz, (int)h);
+	}
+	xor_dda_set_cell(dda, h, bx, by, bz);
+}
+
+static int trace_xor_towers_dda(const TraceState* st, float3 dir)
+{
+	int mask = st->xor_mask;
+
+	XorDDA dda;
+	dda.ux = dir.x;
+	dda.uy = dir.y;
+	dda.cx = st->xor_camx;
+	dda.cy = st->xor_camy;
+	dda.stepx = dir.x >= 0.0f ? 1 : -1;
+	dda.stepy = dir.y >= 0.0f ? 1 : -1;
+	// height increments to cross one cell in x / y
+	dda.hdeltax = 1.0f / (fabsf(dir.x) + 1.0e-6f);
+	dda.hdeltay = 1.0f / (fabsf(dir.y) + 1.0e-6f);
+	float h = XOR_DDA_START_HEIGHT;
+	xor_dda_set_cell(&dda, h, xor_dda_floor(dda.cx + dda.ux * h), xor_dda_floor(dda.cy + dda.uy * h), XOR_DDA_START_HEIGHT);
+
+	int steps = 0;
+	for (; steps < XOR_DDA_MAX_STEPS && dda.h < XOR_DDA_MAX_HEIGHT; ++steps)
+	{
+		int threshold = dda.bz - 8;
+		int bits = (dda.bx ^ dda.by ^ dda.bz) & mask;
+		if (bits < threshold)
+			break;
+
+		int k = MAX(kXorBlockLevel[threshold & 63], XOR_DDA_MIN_BLOCK_LEVEL);
+		if ((bits >> k) != 0)
+		{
+			xor_dda_skip_block(&dda, k);
+			continue;
+		}
+
+		if (dda.hnextx < dda.hnexty && dda.hnextx < dda.hnextz)
+		{
+			dda.h = dda.hnextx;
+			dda.hnextx += dda.hdeltax;
+			dda.bx += dda.stepx;
+		}
+		else if (dda.hnexty < dda.hnextz)
+		{
+			dda.h = dda.hnexty;
+			dda.hnexty += dda.hdeltay;
+			dda.by += dda.stepy;
+		}
+		else
+		{
+			dda.h = dda.hnextz;
+			dda.hnextz += 1.0f;
+			dda.bz++;
+		}
+	}
+	PERF_COUNT(kPerfXorRays, 1);
+	PERF_COUNT(kPerfXorSteps, steps);
+	return xor_height_to_color(dda.h + XOR_DDA_HEIGHT_BIAS);
+}
+
+static int trace_xor(const TraceState* st, float3 dir)
+{
+	return g_fx_options.xor_dda ? trace_xor_towers_dda(st, dir) : trace_xor_towers(st, dir);
+}
+
+static void setup_xor_ray(RayBasis* ray, float rotmx, float rotmy, float scale)
+{
+	// ux = m.y * x + m.x * y, uy = m.x * x - m.y * y; on screen coordinates scaled by `scale`
+	ray->cx = (float3){ rotmy * scale, rotmx * scale, 0.0f };
+	ray->cy = (float3){ rotmx * scale, -rotmy * scale, 0.0f };
+	ray->c0 = ray->cq = (float3){ 0.0f, 0.0f, 0.0f };
+}
+
+
+// Periodic distance fields can be evaluated directly, or looked up from grids baked at first use
+static SdfGrid s_field_sphere_grid, s_field_octa_grid, s_sponge_grid, s_puls_grid_a, s_puls_grid_b;
+static bool s_sdf_grids_baked = false;
+
+#define SDF_EVAL(st, func, grid, p) ( \
+	(st)->sdf_mode == kSdfGridNearest ? sdf_grid_nearest(grid, p) : \
+	(st)->sdf_mode == kSdfGridTrilinear ? sdf_grid_trilinear(grid, p) : \
+	func(p))
+
 
 // ------------------------------------------
 // Somewhat based on "Raymarch 180 chars" by coyote https://www.shadertoy.com/view/llfSzH simplified - 12fps at 2x2t, 21fps at 4x2t
 
-static int trace_sphere_field(TraceState* st, float x, float y)
+#define FIELD_MAX_TRACE_STEPS 15
+#define FIELD_START_T 1.0f
+
+static float sphere_field_sdf(float3 pos)
+{
+	float3 rf = v3_subfl(v3_fract_fast(pos), 0.5f);
+	return v3_dot(rf, rf) - 0.1f;
+}
+
+static float octa_field_sdf(float3 pos)
+{
+	float3 rf = v3_subfl(v3_fract_fast(pos), 0.5f);
+	return fabsf(rf.x) + fabsf(rf.y) - 0.4f;
+}
+
+static float sphere_field_dist(const TraceState* st, float3 pos)
+{
+	return SDF_EVAL(st, sphere_field_sdf, &s_field_sphere_grid, pos);
+}
+
+static int trace_sphere_field_float(const TraceState* st, float3 dir, MarchStart start)
 {
-	float ux = st->rotmy * x + st->rotmx * y;
-	float uy = st->rotmx * x - st->rotmy * y;
 	float3 pos = { st->sph_camx, st->sph_camy, st->sph_camdist };
-	float3 dir = { ux * 1.666f * 0.6f, uy * 1.666f * 0.6f, 2.0f * 0.6f };
 
-	pos = v3_add(pos, dir);
+	pos = v3_add(pos, v3_mulfl(dir, start.t));
 
-#define MAXSTEP 15
-	int it = 0;
-	for (; it < MAXSTEP; ++it)
+	int it = start.steps;
+	for (; it < FIELD_MAX_TRACE_STEPS; ++it)
 	{
-		float3 rf = v3_subfl(v3_fract(pos), 0.5f);
-		float d = v3_dot(rf, rf) - 0.1f;
+		float d = sphere_field_dist(st, pos);
 		if (d < 0.01f)
 			break;
 		pos = v3_add(pos, v3_mulfl(dir, d * 1.5f));
 	}
-	return 255 - (int)(it * (255.0f / MAXSTEP));
+	PERF_COUNT(kPerfMarchRays, 1);
+	PERF_COUNT(kPerfMarchSteps, it - start.steps);
+	return 255 - (int)(it * (255.0f / FIELD_MAX_TRACE_STEPS));
+}
 
-#undef MAXSTEP
+#if RAYMARCH_FIXED_POINT
+static int trace_sphere_field_fx(const TraceState* st, float3 dirf, MarchStart start)
+{
+	fx3 dir = fx3_from_float3(dirf);
+	fx3 pos = fx3_add(st->sph_cam_fx, fx3_mul(dir, fx_from_float(start.t)));
+
+	int it = start.steps;
+	for (; it < FIELD_MAX_TRACE_STEPS; ++it)
+	{
+		fx3 rf = fx3_fract_centered(pos);
+		fx32 d = fx_mul_small(rf.x, rf.x) + fx_mul_small(rf.y, rf.y) + fx_mul_small(rf.z, rf.z) - FX_CONST(0.1f);
+		if (d < FX_CONST(0.01f))
+			break;
+		pos = fx3_add(pos, fx3_mul(dir, d + (d >> 1)));
+	}
+	PERF_COUNT_FX(kPerfMarchRays, 1);
+	PERF_COUNT_FX(kPerfMarchSteps, it - start.steps);
+	return 255 - (int)(it * (255.0f / FIELD_MAX_TRACE_STEPS));
+}
+#endif
+
+static int trace_sphere_field(const TraceState* st, float3 dir, MarchStart start)
+{
+	return RAYMARCH_KERNEL(trace_sphere_field, st, dir, start);
+}
+static float octa_field_dist(const TraceState* st, float3 pos)
+{
+	return SDF_EVAL(st, octa_field_sdf, &s_field_octa_grid, pos);
 }
-static int trace_octa_field(TraceState* st, float x, float y)
+
+static int trace_octa_field_float(const TraceState* st, float3 dir, MarchStart start)
 {
-	float ux = st->rotmy * x + st->rotmx * y;
-	float uy = st->rotmx * x - st->rotmy * y;
 	float3 pos = { st->sph_camx, st->sph_camy, st->sph_camdist };
-	float3 dir = { ux * 1.666f * 0.6f, uy * 1.666f * 0.6f, 2.0f * 0.6f };
 
-	pos = v3_add(pos, dir);
+	pos = v3_add(pos, v3_mulfl(dir, start.t));
 
-#define MAXSTEP 15
-	int it = 0;
-	for (; it < MAXSTEP; ++it)
+	int it = start.steps;
+	for (; it < FIELD_MAX_TRACE_STEPS; ++it)
 	{
-		float3 rf = v3_subfl(v3_fract(pos), 0.5f);
-		float d = fabsf(rf.x) + fabsf(rf.y) - 0.4f;
+		float d = octa_field_dist(st, pos);
 		if (d < 0.01f)
 			break;
 		pos = v3_add(pos, v3_mulfl(dir, d * 1.5f));
 	}
-	return 255 - (int)(it * (255.0f / MAXSTEP));
+	PERF_COUNT(kPerfMarchRays, 1);
+	PERF_COUNT(kPerfMarchSteps, it - start.steps);
+	return 255 - (int)(it * (255.0f / FIELD_MAX_TRACE_STEPS));
+}
 
-#undef MAXSTEP
+#if RAYMARCH_FIXED_POINT
+static int trace_octa_field_fx(const TraceState* st, float3 dirf, MarchStart start)
+{
+	fx3 dir = fx3_from_float3(dirf);
+	fx3 pos = fx3_add(st->sph_cam_fx, fx3_mul(dir, fx_from_float(start.t)));
+
+	int it = start.steps;
+	for (; it < FIELD_MAX_TRACE_STEPS; ++it)
+	{
+		fx3 rf = fx3_fract_centered(pos);
+		fx32 d = fx_abs(rf.x) + fx_abs(rf.y) - FX_CONST(0.4f);
+		if (d < FX_CONST(0.01f))
+			break;
+		pos = fx3_add(pos, fx3_mul(dir, d + (d >> 1)));
+	}
+	PERF_COUNT_FX(kPerfMarchRays, 1);
+	PERF_COUNT_FX(kPerfMarchSteps, it - start.steps);
+	return 255 - (int)(it * (255.0f / FIELD_MAX_TRACE_STEPS));
+}
+#endif
+
+static int trace_octa_field(const TraceState* st, float3 dir, MarchStart start)
+{
+	return RAYMARCH_KERNEL(trace_octa_field, st, dir, start);
+}
+
+static void setup_field_ray(RayBasis* ray, float rotmx, float rotmy)
+{
+	// dir = { ux * 1.666 * 0.6, uy * 1.666 * 0.6, 2 * 0.6 }, where ux,uy is x,y rotated
+	const float s = 1.666f * 0.6f;
+	ray->cx = (float3){ rotmy * s, rotmx * s, 0.0f };
+	ray->cy = (float3){ rotmx * s, -rotmy * s, 0.0f };
+	ray->c0 = (float3){ 0.0f, 0.0f, 2.0f * 0.6f };
+	ray->cq = (float3){ 0.0f, 0.0f, 0.0f };
 }
 
 
@@ -130,69 +476,183 @@ static int trace_octa_field(TraceState* st, float x, float y)
 
 #define SPONGE_MAX_TRACE_STEPS 8
 #define SPONGE_FAR_DIST 5.0f
+#define SPONGE_START_T 0.0f
+#define SPONGE_DIR_OFFSET 0.5f // rays start at pos + dir * 0.5, and t is counted from there
 
 static float sponge_sdf(float3 q)
 {
 	// Layer one. The ".05" on the end varies the hole size.
 	// p = abs(fract(q / 3) * 3 - 1.5)
-	float3 p = v3_fract(v3_mulfl(q, 0.333333f));
+	float3 p = v3_fract_fast(v3_mulfl(q, 0.333333f));
 	p = v3_abs(v3_subfl(v3_mulfl(p, 3.0f), 1.5f));
 	float d = MIN(MAX(p.x, p.y), MIN(MAX(p.y, p.z), MAX(p.x, p.z))) - 1.0f + 0.05f;
 
 	// Layer two
-	p = v3_abs(v3_subfl(v3_fract(q), 0.5f));
+	p = v3_abs(v3_subfl(v3_fract_fast(q), 0.5f));
 	d = MAX(d, MIN(MAX(p.x, p.y), MIN(MAX(p.y, p.z), MAX(p.x, p.z))) - (1.0f / 3.0f) + 0.05f);
 
 	return d;
 }
 
-static int trace_sponge(TraceState* st, float x, float y)
+static float sponge_dist(const TraceState* st, float3 pos)
 {
-	x *= 3.3333f;
-	y *= 3.3333f;
+	return SDF_EVAL(st, sponge_sdf, &s_sponge_grid, pos);
+}
 
+static int trace_sponge_float(const TraceState* st, float3 dir, MarchStart start)
+{
 	float3 pos = st->sponge_pos;
-	float3 dir = { x, y, 1.0f }; // do not normalize on purpose lol
-
-	// Rotate the ray
-	// dir.xy = mat2(m.y, -m.x, m)*dir.xy
-	float nx = st->rotmy * dir.x + st->rotmx * dir.y;
-	float ny = st->rotmx * dir.x - st->rotmy * dir.y;
-	dir.x = nx;
-	dir.y = ny;
-	// dir.xz = mat2(m.y, -m.x, m)*dir.xz
-	nx = st->rotmy * dir.x + st->rotmx * dir.z;
-	ny = st->rotmx * dir.x - st->rotmy * dir.z;
-	dir.x = nx;
-	dir.z = ny;
-
-	pos = v3_add(pos, v3_mulfl(dir, 0.5f));
+	pos = v3_add(pos, v3_mulfl(dir, SPONGE_DIR_OFFSET));
 
-	float t = 0.0f;
+	float t = start.t;
 	int i;
-	for (i = 0; i < SPONGE_MAX_TRACE_STEPS; ++i)
+	for (i = start.steps; i < SPONGE_MAX_TRACE_STEPS; ++i)
 	{
 		float3 q = v3_add(pos, v3_mulfl(dir, t));
-		float d = sponge_sdf(q);
+		float d = sponge_dist(st, q);
 		if (d < t * 0.05f || d > SPONGE_FAR_DIST)
 			break;
 		t += d;
 	}
+	PERF_COUNT(kPerfMarchRays, 1);
+	PERF_COUNT(kPerfMarchSteps, i - start.steps);
 	//return MIN((int)(t * 0.3f * 255.0f), 255);
 	return 255 - i * 31;
 }
 
+#if RAYMARCH_FIXED_POINT
+static inline fx32 sponge_cross_fx(fx3 p)
+{
+	return MIN(MAX(p.x, p.y), MIN(MAX(p.y, p.z), MAX(p.x, p.z)));
+}
+
+static fx32 sponge_sdf_fx(fx3 q)
+{
+	// Layer one: p = abs(fract(q / 3) * 3 - 1.5)
+	fx3 p = fx3_mul(q, FX_CONST(0.333333f));
+	p.x = fx_abs(fx_fract(p.x) * 3 - FX_CONST(1.5f));
+	p.y = fx_abs(fx_fract(p.y) * 3 - FX_CONST(1.5f));
+	p.z = fx_abs(fx_fract(p.z) * 3 - FX_CONST(1.5f));
+	fx32 d = sponge_cross_fx(p) - FX_ONE + FX_CONST(0.05f);
+
+	// Layer two
+	p = fx3_fract_centered(q);
+	p = (fx3){ fx_abs(p.x), fx_abs(p.y), fx_abs(p.z) };
+	d = MAX(d, sponge_cross_fx(p) - FX_CONST(1.0f / 3.0f) + FX_CONST(0.05f));
+	return d;
+}
+
+static int trace_sponge_fx(const TraceState* st, float3 dirf, MarchStart start)
+{
+	fx3 dir = fx3_from_float3(dirf);
+	fx3 pos = fx3_add(st->sponge_pos_fx, fx3_mul(dir, FX_CONST(SPONGE_DIR_OFFSET)));
+
+	fx32 t = fx_from_float(start.t);
+	int i;
+	for (i = start.steps; i < SPONGE_MAX_TRACE_STEPS; ++i)
+	{
+		fx3 q = fx3_add(pos, fx3_mul(dir, t));
+		fx32 d = sponge_sdf_fx(q);
+		if (d < fx_mul(t, FX_CONST(0.05f)) || d > FX_CONST(SPONGE_FAR_DIST))
+			break;
+		t += d;
+	}
+	PERF_COUNT_FX(kPerfMarchRays, 1);
+	PERF_COUNT_FX(kPerfMarchSteps, i - start.steps);
+	return 255 - i * 31;
+}
+#endif
+
+static int trace_sponge(const TraceState* st, float3 dir, MarchStart start)
+{
+	return RAYMARCH_KERNEL(trace_sponge, st, dir, start);
+}
+
+static float3 sponge_rotate(float3 dir, float rotmx, float rotmy)
+{
+	// dir.xy = mat2(m.y, -m.x, m)*dir.xy
+	float nx = rotmy * dir.x + rotmx * dir.y;
+	float ny = rotmx * dir.x - rotmy * dir.y;
+	dir.x = nx;
+	dir.y = ny;
+	// dir.xz = mat2(m.y, -m.x, m)*dir.xz
+	nx = rotmy * dir.x + rotmx * dir.z;
+	ny = rotmx * dir.x - rotmy * dir.z;
+	dir.x = nx;
+	dir.z = ny;
+	return dir;
+}
+
+static void setup_sponge_ray(RayBasis* ray, float rotmx, float rotmy)
+{
+	// dir = { x * 3.3333, y * 3.3333, 1 } (do not normalize on purpose lol), then rotated
+	ray->cx = sponge_rotate((float3) { 3.3333f, 0.0f, 0.0f }, rotmx, rotmy);
+	ray->cy = sponge_rotate((float3) { 0.0f, 3.3333f, 0.0f }, rotmx, rotmy);
+	ray->c0 = sponge_rotate((float3) { 0.0f, 0.0f, 1.0f }, rotmx, rotmy);
+	ray->cq = (float3){ 0.0f, 0.0f, 0.0f };
+}
+
 // ------------------------------------------
 // Puls by Rrrola "tribute", I guess?
 // somewhat based on https://wakaba.c3.cx/w/puls.html
 
 #define PULS_MAX_TRACE_STEPS 24
+#define PULS_START_T 0.4f
+
+// Temporal warm start: each pixel remembers the distance where its puls ray converged
+// (0 = nothing usable), and the next march of it starts well before the closest of that and
+// the neighbors. The march is not exact (over-relaxed steps), so where it starts does change
+// where it stops a bit; every 4th update of a pixel does a full march so that the error does
+// not accumulate over time.
+#define PULS_WARM_START_SCALE 0.6f
+#define PULS_WARM_START_REFRESH 4
+#define PULS_T_CACHE_SCALE 4096.0f
+#define PULS_T_CACHE_SIZE (SCREEN_X / 2 * SCREEN_Y / 2)
+static uint16_t s_puls_t_cache[PULS_T_CACHE_SIZE];
+
+static float puls_warm_start_t(int pix_idx)
+{
+	if (!g_fx_options.march_warm_start || g_fx_options.raymarch_compare || ((G.frame_count >> 2) + pix_idx) % PULS_WARM_START_REFRESH == 0)
+		return 0.0f;
+	int res = s_puls_t_cache[pix_idx];
+	if (res == 0)
+		return 0.0f;
+	const int offsets[4] = { -1, 1, -SCREEN_X / 2, SCREEN_X / 2 };
+	for (int i = 0; i < 4; ++i)
+	{
+		int idx = pix_idx + offsets[i];
+		if (idx >= 0 && idx < PULS_T_CACHE_SIZE && s_puls_t_cache[idx] != 0)
+			res = MIN(res, s_puls_t_cache[idx]);
+	}
+	return res * (PULS_WARM_START_SCALE / PULS_T_CACHE_SCALE);
+}
+
+// The SDF is MIN(a(pos) - 0.1445 + timeParam, b(pos) - widthParam), where a & b
+// do not depend on per-frame parameters (so they can be baked into grids).
+static float puls_term_a(float3 pos)
+{
+	float v2x = fabsf(fract_fast(pos.x) - 0.5f) / 2.0f;
+	float v2y = fabsf(fract_fast(pos.y) - 0.5f) / 2.0f;
+	float v2z = fabsf(fract_fast(pos.z) - 0.5f) / 2.0f;
+	return v2x + v2y + v2z;
+}
+
+static float puls_term_b(float3 pos)
+{
+	float v2x = 0.25f - fabsf(fract_fast(pos.x) - 0.5f) / 2.0f;
+	float v2y = 0.25f - fabsf(fract_fast(pos.y) - 0.5f) / 2.0f;
+	float v2z = 0.25f - fabsf(fract_fast(pos.z) - 0.5f) / 2.0f;
+	float dx = fabsf(v2z - v2x);
+	float dy = fabsf(v2x - v2y);
+	float dz = fabsf(v2y - v2z);
+	return dx + dy + dz;
+}
 
 static float puls_sdf(float timeParam, float widthParam, float3 pos)
 {
-	float v2x = fabsf(fract(pos.x) - 0.5f) / 2.0f;
-	float v2y = fabsf(fract(pos.y) - 0.5f) / 2.0f;
-	float v2z = fabsf(fract(pos.z) - 0.5f) / 2.0f;
+	float v2x = fabsf(fract_fast(pos.x) - 0.5f) / 2.0f;
+	float v2y = fabsf(fract_fast(pos.y) - 0.5f) / 2.0f;
+	float v2z = fabsf(fract_fast(pos.z) - 0.5f) / 2.0f;
 	float r = timeParam;
 
 	float d1 = v2x + v2y + v2z - 0.1445f + r;
@@ -208,24 +668,50 @@ static float puls_sdf(float timeParam, float widthParam, float3 pos)
 	return MIN(d1, d2);
 }
 
-static int trace_puls(TraceState* st, float x, float y)
+static float puls_dist(const TraceState* st, float3 pos)
+{
+	if (st->sdf_mode == kSdfAnalytic)
+		return puls_sdf(st->puls_t_param, st->puls_width_param, pos);
+	bool trilinear = st->sdf_mode == kSdfGridTrilinear;
+	float a = trilinear ? sdf_grid_trilinear(&s_puls_grid_a, pos) : sdf_grid_nearest(&s_puls_grid_a, pos);
+	float b = trilinear ? sdf_grid_trilinear(&s_puls_grid_b, pos) : sdf_grid_nearest(&s_puls_grid_b, pos);
+	return MIN(a - 0.1445f + st->puls_t_param, b - st->puls_width_param);
+}
+
+static int trace_puls_float(const TraceState* st, float3 dir, MarchStart start, int pix_idx)
 {
 	float3 pos = st->puls_pos;
-	float3 dir = { x, -y, 0.33594f - x * x - y * y };
-	dir = (float3){ dir.y, dir.z * st->puls_cosa - dir.x * st->puls_sina, dir.x * st->puls_cosa + dir.z * st->puls_sina };
-	dir = (float3){ dir.y, dir.z * st->puls_cosa - dir.x * st->puls_sina, dir.x * st->puls_cosa + dir.z * st->puls_sina };
-	dir = (float3){ dir.y, dir.z * st->puls_cosa - dir.x * st->puls_sina, dir.x * st->puls_cosa + dir.z * st->puls_sina };
 
-	float t = 0.4f;
+	float t = start.t;
+	float ts = puls_warm_start_t(pix_idx);
+	if (ts > t)
+	{
+		// if we're already at (or inside) a surface there, the hit moved closer
+		// and we have to do the march from the regular start
+		float d = puls_dist(st, v3_add(pos, v3_mulfl(dir, ts)));
+		PERF_COUNT(kPerfPulsSteps, 1);
+		if (d >= ts * 0.07f)
+		{
+			t = ts + d * 1.7f;
+			PERF_COUNT(kPerfPulsWarmStarts, 1);
+		}
+		else
+			PERF_COUNT(kPerfPulsWarmFallbacks, 1);
+	}
 	int i;
 	for (i = 0; i < PULS_MAX_TRACE_STEPS; ++i)
 	{
 		float3 q = v3_add(pos, v3_mulfl(dir, t));
-		float d = puls_sdf(st->puls_t_param, st->puls_width_param, q);
+		float d = puls_dist(st, q);
 		if (d < t * 0.07f)
 			break;
 		t += d * 1.7f;
 	}
+	PERF_COUNT(kPerfPulsRays, 1);
+	PERF_COUNT(kPerfPulsSteps, i);
+	PERF_COUNT(kPerfMarchRays, 1);
+	PERF_COUNT(kPerfMarchSteps, i);
+	s_puls_t_cache[pix_idx] = i < PULS_MAX_TRACE_STEPS ? (uint16_t)MIN(t * PULS_T_CACHE_SCALE, 65535.0f) : 0;
 
 	//return (int)(((float)j) / (float)MAXSTEP * 255.0f);
 	float v = 1.0f - (t - 0.5f) * 0.25f;
@@ -236,23 +722,230 @@ static int trace_puls(TraceState* st, float x, float y)
 	return res;
 }
 
+#if RAYMARCH_FIXED_POINT
+static fx32 puls_sdf_fx(const TraceState* st, fx3 pos)
+{
+	fx32 v2x = fx_abs(fx_fract(pos.x) - FX_HALF) >> 1;
+	fx32 v2y = fx_abs(fx_fract(pos.y) - FX_HALF) >> 1;
+	fx32 v2z = fx_abs(fx_fract(pos.z) - FX_HALF) >> 1;
+
+	fx32 d1 = v2x + v2y + v2z - FX_CONST(0.1445f) + st->puls_t_param_fx;
+
+	v2x = FX_CONST(0.25f) - v2x;
+	v2y = FX_CONST(0.25f) - v2y;
+	v2z = FX_CONST(0.25f) - v2z;
+	fx32 d2 = fx_abs(v2z - v2x) + fx_abs(v2x - v2y) + fx_abs(v2y - v2z) - st->puls_width_param_fx;
+
+	return MIN(d1, d2);
+}
+
+static int trace_puls_fx(const TraceState* st, float3 dirf, MarchStart start, int pix_idx)
+{
+	fx3 dir = fx3_from_float3(dirf);
+	fx3 pos = st->puls_pos_fx;
+
+	fx32 t = fx_from_float(start.t);
+	fx32 ts = fx_from_float(puls_warm_start_t(pix_idx));
+	if (ts > t)
+	{
+		fx32 d = puls_sdf_fx(st, fx3_add(pos, fx3_mul(dir, ts)));
+		PERF_COUNT_FX(kPerfPulsSteps, 1);
+		if (d >= fx_mul(ts, FX_CONST(0.07f)))
+		{
+			t = ts + fx_mul(d, FX_CONST(1.7f));
+			PERF_COUNT_FX(kPerfPulsWarmStarts, 1);
+		}
+		else
+			PERF_COUNT_FX(kPerfPulsWarmFallbacks, 1);
+	}
+	int i;
+	for (i = 0; i < PULS_MAX_TRACE_STEPS; ++i)
+	{
+		fx3 q = fx3_add(pos, fx3_mul(dir, t));
+		fx32 d = puls_sdf_fx(st, q);
+		if (d < fx_mul(t, FX_CONST(0.07f)))
+			break;
+		t += fx_mul(d, FX_CONST(1.7f));
+	}
+	PERF_COUNT_FX(kPerfPulsRays, 1);
+	PERF_COUNT_FX(kPerfPulsSteps, i);
+	PERF_COUNT_FX(kPerfMarchRays, 1);
+	PERF_COUNT_FX(kPerfMarchSteps, i);
+	// the cache is in 1/4096 units, i.e. 4 fractional bits less
+	s_puls_t_cache[pix_idx] = i < PULS_MAX_TRACE_STEPS ? (uint16_t)MIN(t >> 4, 65535) : 0;
+
+	fx32 v = FX_ONE - ((t - FX_HALF) >> 2);
+	v = fx_mul(v, v);
+	int res = (v * 255) >> FX_SHIFT;
+	res = MIN(255, res);
+	res = MAX(0, res);
+	return res;
+}
+#endif
+
+static int trace_puls(const TraceState* st, float3 dir, MarchStart start, int pix_idx)
+{
+	return RAYMARCH_KERNEL(trace_puls, st, dir, start, pix_idx);
+}
+
+static float3 puls_rotate(float3 dir, float cosa, float sina)
+{
+	return (float3){ dir.y, dir.z * cosa - dir.x * sina, dir.x * cosa + dir.z * sina };
+}
+
+static void setup_puls_ray(RayBasis* ray, float cosa, float sina)
+{
+	// dir = { x, -y, 0.33594 - x*x - y*y }, rotated three times
+	float3 ex = { 1.0f, 0.0f, 0.0f };
+	float3 ey = { 0.0f, -1.0f, 0.0f };
+	float3 ez = { 0.0f, 0.0f, 1.0f };
+	for (int i = 0; i < 3; ++i)
+	{
+		ex = puls_rotate(ex, cosa, sina);
+		ey = puls_rotate(ey, cosa, sina);
+		ez = puls_rotate(ez, cosa, sina);
+	}
+	ray->cx = ex;
+	ray->cy = ey;
+	ray->c0 = v3_mulfl(ez, 0.33594f);
+	ray->cq = v3_mulfl(ez, -1.0f);
+}
+
+
+// ------------------------------------------
 
 // ------------------------------------------
+// Coarse prepass: for each tile of 4x4 half-res pixels, march the ray through the tile center
+// with the scene's own stepping, for as long as the cone around it (that contains the rays of
+// all the pixels of the tile) is clear of surfaces. Pixel rays of the tile then start from there,
+// at the step count the center ray had.
+//
+// This is an approximation, not a conservative bound: the clearance test takes the distance at
+// face value, but the scene fields are not true distances (the sphere field is squared, octa and
+// puls are L1), and the prepass steps with the scene's relax factor. About 1.2% of the pixels of
+// those sections come out different from the full march, so it is off by default.
+//
+// Only half of the rows and columns are traced each frame (temporal 2x2), so one prepass ray
+// is shared by the 4 pixel rays of the tile that are traced this frame.
+
+#define CONE_TILE_SIZE 4
+#define CONE_TILES_X (SCREEN_X / 2 / CONE_TILE_SIZE)
+#define CONE_TILES_Y (SCREEN_Y / 2 / CONE_TILE_SIZE)
+
+static MarchStart s_cone_tiles[CONE_TILES_X * CONE_TILES_Y];
+
+typedef float (*ConeDistFunc)(const TraceState* st, float3 pos);
+
+// How a scene marches: pos = origin + dir * (t + dir_offset); stops when the distance is
+// below hit_abs + hit_rel * t (or above far_dist, if that is not zero); steps by distance * relax.
+typedef struct ConeScene
+{
+	ConeDistFunc dist;
+	float3 origin;
+	float dir_offset;
+	float start_t;
+	float hit_abs, hit_rel;
+	float far_dist;
+	float relax;
+	int max_steps;
+} ConeScene;
+
+static MarchStart cone_march(const TraceState* st, const ConeScene* scene, float3 dir, float cone_k)
+{
+	MarchStart res = { scene->start_t, 0 };
+	float t = scene->start_t;
+	for (int i = 0; i < scene->max_steps - 1; ++i)
+	{
+		float u = t + scene->dir_offset;
+		float d = scene->dist(st, v3_add(scene->origin, v3_mulfl(dir, u)));
+		// every pixel ray of the tile is within cone radius of this point; none of them
+		// may have reached their hit threshold yet
+		if (d < u * cone_k + scene->hit_abs + scene->hit_rel * t)
+			break;
+		res.t = t;
+		res.steps = i;
+		if (scene->far_dist > 0.0f && d > scene->far_dist)
+			break;
+		t += d * scene->relax;
+		PERF_COUNT(kPerfConeSteps, 1);
+	}
+	return res;
+}
+
+// x0,y0: position of the top left half-res pixel, dx,dy: pixel size
+static void cone_prepass(const TraceState* st, const ConeScene* scene, const RayBasis* basis, float x0, float y0, float dx, float dy)
+{
+	// the tile spans 3 pixels (plus one more in x when the temporal pattern shifts it)
+	const float hx = dx * (CONE_TILE_SIZE - 0.5f);
+	const float hy = dy * (CONE_TILE_SIZE - 1.0f);
+	MarchStart* tile = s_cone_tiles;
+	for (int ty = 0; ty < CONE_TILES_Y; ++ty)
+	{
+		float y = y0 - (ty * CONE_TILE_SIZE * 2) * dy - hy;
+		for (int tx = 0; tx < CONE_TILES_X; ++tx, ++tile)
+		{
+			float x = x0 + (tx * CONE_TILE_SIZE * 2) * dx + hx;
+			float3 dir = ray_dir(basis, x, y);
+			float k = 0.0f;
+			for (int c = 0; c < 4; ++c)
+			{
+				float3 corner = ray_dir(basis, x + ((c & 1) ? hx : -hx), y + ((c & 2) ? hy : -hy));
+				float3 offset = v3_sub(corner, dir);
+				k = MAX(k, v3_len(&offset));
+			}
+			*tile = cone_march(st, scene, dir, k);
+		}
+	}
+}
+
+static inline MarchStart cone_tile_start(int px, int py)
+{
+	return s_cone_tiles[(py / CONE_TILE_SIZE) * CONE_TILES_X + px / CONE_TILE_SIZE];
+}
+
+static void log_sdf_grid_error(const char* name, const SdfGrid* grid, sdf_grid_function func)
+{
+	float mean_n, max_n, mean_t, max_t;
+	sdf_grid_error(grid, func, false, &mean_n, &max_n);
+	sdf_grid_error(grid, func, true, &mean_t, &max_t);
+	plat_sys_log("sdf grid %s: nearest err mean %.4f max %.4f, trilinear err mean %.4f max %.4f", name, mean_n, max_n, mean_t, max_t);
+}
+
+static void bake_sdf_grids()
+{
+	sdf_grid_bake(&s_field_sphere_grid, 1.0f, sphere_field_sdf);
+	sdf_grid_bake(&s_field_octa_grid, 1.0f, octa_field_sdf);
+	sdf_grid_bake(&s_sponge_grid, 3.0f, sponge_sdf);
+	sdf_grid_bake(&s_puls_grid_a, 1.0f, puls_term_a);
+	sdf_grid_bake(&s_puls_grid_b, 1.0f, puls_term_b);
+	s_sdf_grids_baked = true;
+
+	log_sdf_grid_error("sphere field", &s_field_sphere_grid, sphere_field_sdf);
+	log_sdf_grid_error("octa field", &s_field_octa_grid, octa_field_sdf);
+	log_sdf_grid_error("sponge", &s_sponge_grid, sponge_sdf);
+	log_sdf_grid_error("puls a", &s_puls_grid_a, puls_term_a);
+	log_sdf_grid_error("puls b", &s_puls_grid_b, puls_term_b);
+}
 
 static float s_prev_divider_dx1, s_prev_divider_dy1, s_prev_divider_dx2, s_prev_divider_dy2;
+static int s_prev_frame = -1, s_prev_section = -1;
 
 void fx_raymarch_update(float start_time, float end_time, float alpha)
 {
 	TraceState st;
 	st.t = G.time;
+	st.sdf_mode = g_fx_options.sdf_mode;
+	if (st.sdf_mode != kSdfAnalytic && !s_sdf_grids_baked)
+		bake_sdf_grids();
 	float r_angle = 0.6f - 0.1f * st.t + G.crank_angle_rad;
-	st.rotmx = sinf(r_angle);
-	st.rotmy = cosf(r_angle);
+	float rotmx = sinf(r_angle);
+	float rotmy = cosf(r_angle);
+	setup_field_ray(&st.field_ray, rotmx, rotmy);
+	setup_sponge_ray(&st.sponge_ray, rotmx, rotmy);
 
 	float xor_r_angle = 0.6f - 0.03f * st.t + G.crank_angle_rad;
-	st.xor_rotmx = sinf(xor_r_angle);
-	st.xor_rotmy = cosf(xor_r_angle);
-	st.xor_scale = 1.666f + sinf(G.time * 0.05f) * 0.3f;
+	float xor_scale = 1.666f + sinf(G.time * 0.05f) * 0.3f;
+	setup_xor_ray(&st.xor_ray, sinf(xor_r_angle), cosf(xor_r_angle), xor_scale);
 	st.xor_camx = G.time * 0.4f;
 	st.xor_camy = G.time * 1.7f;
 	int bar_idx = (((int)G.time) / 4) & 3;
@@ -271,17 +964,30 @@ void fx_raymarch_update(float start_time, float end_time, float alpha)
 	st.puls_width_param = (0.08f - st.puls_t_param * 2.0f) * (G.beat ? 0.3f : 0.1f);
 
 	float puls_rot = pulst * 0.00564f + G.crank_angle_rad;
-	st.puls_sina = sinf(puls_rot);
-	st.puls_cosa = cosf(puls_rot);
+	setup_puls_ray(&st.puls_ray, cosf(puls_rot), sinf(puls_rot));
 	st.puls_pos.x = 0.5f + 0.0134f * pulst;
 	st.puls_pos.y = 1.1875f + 0.0134f * pulst;
 	st.puls_pos.z = 0.875f + 0.0134f * pulst;
 
+#if RAYMARCH_FIXED_POINT
+	st.sph_cam_fx = fx3_from_float3((float3){ st.sph_camx, st.sph_camy, st.sph_camdist });
+	st.sponge_pos_fx = fx3_from_float3(st.sponge_pos);
+	st.puls_pos_fx = fx3_from_float3(st.puls_pos);
+	st.puls_t_param_fx = fx_from_float(st.puls_t_param);
+	st.puls_width_param_fx = fx_from_float(st.puls_width_param);
+#endif
+
 	float section_flt = alpha * 9.0f;
 	int section_idx = (int)section_flt;
 	float section_alpha = section_flt - section_idx;
 	//section_idx = 4;
 
+	// cached march distances are only valid if we continue from the previous frame of the same section
+	if (G.frame_count != s_prev_frame + 1 || section_idx != s_prev_section)
+		memset(s_puls_t_cache, 0, sizeof(s_puls_t_cache));
+	s_prev_frame = G.frame_count;
+	s_prev_section = section_idx;
+
 	float transition_in = 1.0f;
 	if (section_alpha < 1.0f/8.0f)
 		transition_in = CubicEaseInOut(section_alpha * 8.0f);
@@ -300,6 +1006,23 @@ void fx_raymarch_update(float start_time, float end_time, float alpha)
 	float dx = xsize / SCREEN_X;
 	float dy = ysize / SCREEN_Y;
 
+	float3 field_origin = { st.sph_camx, st.sph_camy, st.sph_camdist };
+	const MarchStart field_start = { FIELD_START_T, 0 };
+	const MarchStart sponge_start = { SPONGE_START_T, 0 };
+	const MarchStart puls_start = { PULS_START_T, 0 };
+	const ConeScene cone_scenes[5] = {
+		{ octa_field_dist, field_origin, 0.0f, FIELD_START_T, 0.01f, 0.0f, 0.0f, 1.5f, FIELD_MAX_TRACE_STEPS },
+		{ sphere_field_dist, field_origin, 0.0f, FIELD_START_T, 0.01f, 0.0f, 0.0f, 1.5f, FIELD_MAX_TRACE_STEPS },
+		{ NULL },
+		{ sponge_dist, st.sponge_pos, SPONGE_DIR_OFFSET, SPONGE_START_T, 0.0f, 0.05f, SPONGE_FAR_DIST, 1.0f, SPONGE_MAX_TRACE_STEPS },
+		{ puls_dist, st.puls_pos, 0.0f, PULS_START_T, 0.0f, 0.07f, 0.0f, 1.7f, PULS_MAX_TRACE_STEPS },
+	};
+	const RayBasis* cone_bases[5] = { &st.field_ray, &st.field_ray, NULL, &st.sponge_ray, &st.puls_ray };
+	// sections that show one sphere traced scene get the coarse prepass
+	bool use_cone = g_fx_options.cone_prepass && section_idx < 5 && cone_scenes[section_idx].dist != NULL;
+	if (use_cone)
+		cone_prepass(&st, &cone_scenes[section_idx], cone_bases[section_idx], -xsize / 2 + dx, ysize / 2 - dy, dx, dy);
+
 	// temporal: one ray for each 2x2 block, and also update one pixel within each 2x2 macroblock (16x fewer rays): 28fps (35ms)
 	float y = ysize / 2 - dy;
 	for (int py = 0; py < SCREEN_Y / 2; ++py, y -= dy * 2)
@@ -317,84 +1040,107 @@ void fx_raymarch_update(float start_time, float end_time, float alpha)
 			pix_idx++;
 		}
 		
+		// Ray directions of all the scenes along this row; each scene only steps the ones it uses.
+		const float xstep = dx * 4;
+		RayRow field_row, xor_row, sponge_row, puls_row;
+		ray_row_init(&field_row, &st.field_ray, x, y, xstep);
+		ray_row_init(&xor_row, &st.xor_ray, x, y, xstep);
+		ray_row_init(&sponge_row, &st.sponge_ray, x, y, xstep);
+		ray_row_init(&puls_row, &st.puls_ray, x, y, xstep);
+
 		if (section_idx == 0) // octa field
 		{
-			for (int px = 0; px < SCREEN_X / 2; px += 2, x += dx * 4, pix_idx += 2)
+			for (int px = 0; px < SCREEN_X / 2; px += 2, pix_idx += 2, ray_row_step(&field_row))
 			{
-				int val = trace_octa_field(&st, x, y);
+				int val = trace_octa_field(&st, field_row.dir, use_cone ? cone_tile_start(px, py) : field_start);
 				g_screen_buffer_2x2sml[pix_idx] = val;
 			}
 		}
 		else if (section_idx == 1) // sphere field
 		{
-			for (int px = 0; px < SCREEN_X / 2; px += 2, x += dx * 4, pix_idx += 2)
+			for (int px = 0; px < SCREEN_X / 2; px += 2, pix_idx += 2, ray_row_step(&field_row))
 			{
-				int val = trace_sphere_field(&st, x, y);
+				int val = trace_sphere_field(&st, field_row.dir, use_cone ? cone_tile_start(px, py) : field_start);
 				g_screen_buffer_2x2sml[pix_idx] = val;
 			}
 		}
 		else if (section_idx == 2) // xor towers
 		{
-			for (int px = 0; px < SCREEN_X / 2; px += 2, x += dx * 4, pix_idx += 2)
+			for (int px = 0; px < SCREEN_X / 2; px += 2, pix_idx += 2, ray_row_step(&xor_row))
 			{
-				int val = trace_xor_towers(&st, x, y);
+				int val = trace_xor(&st, xor_row.dir);
 				g_screen_buffer_2x2sml[pix_idx] = val;
 			}
 		}
 		else if (section_idx == 3) // sponge
 		{
-			for (int px = 0; px < SCREEN_X / 2; px += 2, x += dx * 4, pix_idx += 2)
+			for (int px = 0; px < SCREEN_X / 2; px += 2, pix_idx += 2, ray_row_step(&sponge_row))
 			{
-				int val = trace_sponge(&st, x, y);
+				int val = trace_sponge(&st, sponge_row.dir, use_cone ? cone_tile_start(px, py) : sponge_start);
 				g_screen_buffer_2x2sml[pix_idx] = val;
 			}
 		}
 		else if (section_idx == 4) // puls
 		{
-			for (int px = 0; px < SCREEN_X / 2; px += 2, x += dx * 4, pix_idx += 2)
+			for (int px = 0; px < SCREEN_X / 2; px += 2, pix_idx += 2, ray_row_step_quad(&puls_row))
 			{
-				int val = trace_puls(&st, x, y);
+				int val = trace_puls(&st, puls_row.dir, use_cone ? cone_tile_start(px, py) : puls_start, pix_idx);
 				g_screen_buffer_2x2sml[pix_idx] = val;
 			}
 		}
 		else if (section_idx == 5) // top: sphere field, bottom: puls
 		{
-			for (int px = 0; px < SCREEN_X / 2; px += 2, x += dx * 4, pix_idx += 2)
+			if (py < transition_y)
 			{
-				int val;
-				if (py < transition_y)
-					val = trace_sphere_field(&st, x, y);
-				else
-					val = trace_puls(&st, x, y);
-				g_screen_buffer_2x2sml[pix_idx] = val;
+				for (int px = 0; px < SCREEN_X / 2; px += 2, pix_idx += 2, ray_row_step(&field_row))
+				{
+					int val = trace_sphere_field(&st, field_row.dir, field_start);
+					g_screen_buffer_2x2sml[pix_idx] = val;
+				}
+			}
+			else
+			{
+				for (int px = 0; px < SCREEN_X / 2; px += 2, pix_idx += 2, ray_row_step_quad(&puls_row))
+				{
+					int val = trace_puls(&st, puls_row.dir, puls_start, pix_idx);
+					g_screen_buffer_2x2sml[pix_idx] = val;
+				}
 			}
 		}
 		else if (section_idx == 6) // top: sponge, sphere field, bottom: xor, puls
 		{
-			for (int px = 0; px < SCREEN_X / 2; px += 2, x += dx * 4, pix_idx += 2)
+			if (py < SCREEN_Y / 4)
 			{
-				int val;
-				if (py < SCREEN_Y / 4)
+				for (int px = 0; px < SCREEN_X / 2; px += 2, pix_idx += 2, ray_row_step(&sponge_row), ray_row_step(&field_row))
 				{
+					int val;
 					if (px < transition_x)
-						val = trace_sponge(&st, x, y);
+						val = trace_sponge(&st, sponge_row.dir, sponge_start);
 					else
-						val = trace_sphere_field(&st, x, y);
+						val = trace_sphere_field(&st, field_row.dir, field_start);
+					g_screen_buffer_2x2sml[pix_idx] = val;
 				}
-				else
+			}
+			else
+			{
+				for (int px = 0; px < SCREEN_X / 2; px += 2, pix_idx += 2, ray_row_step(&xor_row), ray_row_step_quad(&puls_row))
 				{
+					int val;
 					if (px < transition_x)
-						val = trace_xor_towers(&st, x, y);
+					{
+						val = trace_xor(&st, xor_row.dir);
+						s_puls_t_cache[pix_idx] = 0;
+					}
 					else
-						val = trace_puls(&st, x, y);
+						val = trace_puls(&st, puls_row.dir, puls_start, pix_idx);
+					g_screen_buffer_2x2sml[pix_idx] = val;
 				}
-				g_screen_buffer_2x2sml[pix_idx] = val;
 			}
 		}
 		else if (section_idx >= 7) // same as above, divider lines rotating
 		{
 			float pdy = (float)(py - SCREEN_Y / 4);
-			for (int px = 0; px < SCREEN_X / 2; px += 2, x += dx * 4, pix_idx += 2)
+			for (int px = 0; px < SCREEN_X / 2; px += 2, pix_idx += 2)
 			{
 				float pdx = (float)(px - SCREEN_X / 4);
 				float det1 = divider_dx1 * pdy - divider_dy1 * pdx;
@@ -402,15 +1148,22 @@ void fx_raymarch_update(float start_time, float end_time, float alpha)
 				int quad_index = (det1 >= 0.0f ? 0 : 1) + (det2 >= 0.0f ? 2 : 0);
 
 				int val;
+				if (quad_index != 0)
+					s_puls_t_cache[pix_idx] = 0;
 				if (quad_index == 0)
-					val = trace_puls(&st, x, y);
+					val = trace_puls(&st, puls_row.dir, puls_start, pix_idx);
 				else if (quad_index == 1)
-					val = trace_sphere_field(&st, x, y);
+					val = trace_sphere_field(&st, field_row.dir, field_start);
 				else if (quad_index == 2)
-					val = trace_xor_towers(&st, x, y);
+					val = trace_xor(&st, xor_row.dir);
 				else
-					val = trace_sponge(&st, x, y);
+					val = trace_sponge(&st, sponge_row.dir, sponge_start);
 				g_screen_buffer_2x2sml[pix_idx] = val;
+
+				ray_row_step_quad(&puls_row);
+				ray_row_step(&field_row);
+				ray_row_step(&xor_row);
+				ray_row_step(&sponge_row);
 			}
 		}
 	}
@@ -418,41 +1171,34 @@ void fx_raymarch_update(float start_time, float end_time, float alpha)
 	draw_dithered_screen_2x2(G.framebuffer, 1);
 
 	// draw divider lines
-	float3 linea, lineb;
-	linea.z = lineb.z = 0;
-	uint8_t pattern[8] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	float3 lines[4];
+	int line_count = 0;
+	static const uint8_t pattern[8] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
 	if (section_idx == 5)
 	{
-		linea.x = 0; lineb.x = SCREEN_X - 1;
-		linea.y = lineb.y = (float)(transition_y * 2);
-		drawLine(G.framebuffer, G.framebuffer_stride, &linea, &lineb, 1, pattern);
+		lines[0] = (float3){ 0, (float)(transition_y * 2), 0 };
+		lines[1] = (float3){ SCREEN_X - 1, (float)(transition_y * 2), 0 };
+		line_count = 1;
 	}
 	if (section_idx == 6)
 	{
-		linea.x = 0; lineb.x = SCREEN_X - 1;
-		linea.y = lineb.y = SCREEN_Y/2;
-		drawLine(G.framebuffer, G.framebuffer_stride, &linea, &lineb, 1, pattern);
-
-		linea.x = lineb.x = 1 + (float)(transition_x * 2);
-		linea.y = 0; lineb.y = SCREEN_Y-1;
-		drawLine(G.framebuffer, G.framebuffer_stride, &linea, &lineb, 1, pattern);
+		lines[0] = (float3){ 0, SCREEN_Y / 2, 0 };
+		lines[1] = (float3){ SCREEN_X - 1, SCREEN_Y / 2, 0 };
+		lines[2] = (float3){ 1 + (float)(transition_x * 2), 0, 0 };
+		lines[3] = (float3){ 1 + (float)(transition_x * 2), SCREEN_Y - 1, 0 };
+		line_count = 2;
 	}
 	if (section_idx >= 7)
 	{
 		// draw rotating divider lines at previous frame angles, looks a tiny bit
 		// better due to temporal stuff
-		linea.x = 1 + SCREEN_X / 2 + s_prev_divider_dx1 * SCREEN_X;
-		linea.y = SCREEN_Y / 2 + s_prev_divider_dy1 * SCREEN_X;
-		lineb.x = 1 + SCREEN_X / 2 - s_prev_divider_dx1 * SCREEN_X;
-		lineb.y = SCREEN_Y / 2 - s_prev_divider_dy1 * SCREEN_X;
-		drawLine(G.framebuffer, G.framebuffer_stride, &linea, &lineb, 1, pattern);
-
-		linea.x = 1 + SCREEN_X / 2 + s_prev_divider_dx2 * SCREEN_X;
-		linea.y = SCREEN_Y / 2 + s_prev_divider_dy2 * SCREEN_X;
-		lineb.x = 1 + SCREEN_X / 2 - s_prev_divider_dx2 * SCREEN_X;
-		lineb.y = SCREEN_Y / 2 - s_prev_divider_dy2 * SCREEN_X;
-		drawLine(G.framebuffer, G.framebuffer_stride, &linea, &lineb, 1, pattern);
+		lines[0] = (float3){ 1 + SCREEN_X / 2 + s_prev_divider_dx1 * SCREEN_X, SCREEN_Y / 2 + s_prev_divider_dy1 * SCREEN_X, 0 };
+		lines[1] = (float3){ 1 + SCREEN_X / 2 - s_prev_divider_dx1 * SCREEN_X, SCREEN_Y / 2 - s_prev_divider_dy1 * SCREEN_X, 0 };
+		lines[2] = (float3){ 1 + SCREEN_X / 2 + s_prev_divider_dx2 * SCREEN_X, SCREEN_Y / 2 + s_prev_divider_dy2 * SCREEN_X, 0 };
+		lines[3] = (float3){ 1 + SCREEN_X / 2 - s_prev_divider_dx2 * SCREEN_X, SCREEN_Y / 2 - s_prev_divider_dy2 * SCREEN_X, 0 };
+		line_count = 2;
 	}
+	lines_draw_segments(G.framebuffer, G.framebuffer_stride, lines, line_count, 1, pattern);
 
 	s_prev_divider_dx1 = divider_dx1;
 	s_prev_divider_dy1 = divider_dy1;
@@ -342,7 +342,9 @@ static void do_render(float crank_angle, float time, float start_time, float end
 			g_screen_buffer[pix_idx] = val;
 		}
 	}
-	draw_dithered_screen(framebuffer, get_fade_bias(start_time, end_time));
+	uint8_t tone_lut[256];
+	get_fade_tone(tone_lut, start_time, end_time, false);
+	draw_dithered_screen_tone(framebuffer, tone_lut);
 }
 
 void fx_raytrace_update(float start_time, float end_time, float alpha)
@@ -34,6 +34,7 @@ void fx_starfield_update(float start_time, float end_time, float alpha)
 		alpha = 1.0f - (cosf(G.crank_angle_rad) * 0.5f + 0.5f);
 
 	float speed_a = CubicEaseIn(alpha) * 0.8f + 0.2f;
+	speed_a *= 1.0f + G.audio_bands[0] * 0.5f; // bass pushes the stars
 	dt *= speed_a;
 
 	int draw_count;
@@ -8,6 +8,7 @@
 
 #define TIME_UNIT_LENGTH_SECONDS (0.46875f)
 #define TIME_LEN_30FPSFRAME (1.0f/(TIME_UNIT_LENGTH_SECONDS*30.0f))
+#define AUDIO_BAND_COUNT (8)
 
 typedef struct Globals
 {
@@ -18,6 +19,11 @@ typedef struct Globals
 	bool beat; // is current frame on the "beat"
 	bool ending; // "ending" / interactive part after music
 
+	// music analysis (see util/audio_analysis.h); all zero when no music is playing
+	float audio_bands[AUDIO_BAND_COUNT]; // 0..1 band levels, band 0 is bass (below ~260Hz), then octaves up
+	float audio_level; // 0..1 level of the whole spectrum
+	bool onset; // an onset (drum hit, note start) was detected in the music since the previous frame
+
 	// screen
 	uint8_t* framebuffer;
 	int framebuffer_stride;
@@ -5,14 +5,25 @@
 #include "effects/fx.h"
 #include "globals.h"
 #include "mathlib.h"
+#include "mini3d/gouraud.h"
+#include "mini3d/lines.h"
+#include "mini3d/mesh.h"
+#include "util/audio_analysis.h"
+#include "util/audio_clock.h"
+#include "util/audio_mixer.h"
+#include "util/audio_telemetry.h"
+#include "util/cpu_dispatch.h"
+#include "util/fast_math.h"
+#include "util/perf_hud.h"
+#include "util/perf_stats.h"
 #include "util/pixel_ops.h"
 
-//#define SHOW_STATS 1
-
-#define PLAY_MUSIC 1
+#define PLAY_MUSIC (!BENCHMARK_MODE)
 #if PLAY_MUSIC
 static const char* kMusicPath = "music.pda";
+static const char* kStampPath = "stamp.pda";
 static PlatFileMusicPlayer* s_music;
+static PlatSample* s_stamp;
 #endif
 
 typedef struct DemoImage {
@@ -20,16 +31,17 @@ typedef struct DemoImage {
 	int x, y;
 	int tstart, tend;
 	bool ending;
+	bool stamp; // lands with the stamp sample on its start beat
 	PlatBitmap* bitmap;
 } DemoImage;
 
 static DemoImage s_images[] = {
-	{"text_everybody.pdi",	105,   8, 16, 29, false },
-	{"text_wantsto.pdi",	120,  56, 18, 30, false },
-	{"text_crank.pdi",		 89, 103, 20, 31, false },
-	{"text_theworld.pdi",	136, 163, 22, 32, false },
-	{"text_instr.pdi",		  5, 183,  0, 64000, true },
-	{"text_logo.pdi",		365, 210,  0, 64000, true },
+	{"text_everybody.pdi",	105,   8, 16, 29, false, true },
+	{"text_wantsto.pdi",	120,  56, 18, 30, false, true },
+	{"text_crank.pdi",		 89, 103, 20, 31, false, true },
+	{"text_theworld.pdi",	136, 163, 22, 32, false, true },
+	{"text_instr.pdi",		  5, 183,  0, 64000, true, false },
+	{"text_logo.pdi",		365, 210,  0, 64000, true, false },
 };
 #define DEMO_IMAGE_COUNT (sizeof(s_images)/sizeof(s_images[0]))
 
@@ -49,11 +61,30 @@ void app_initialize()
 			plat_sys_log_error("Could not load bitmap %s: %s", s_images[i].file, err);
 	}
 
+	kernels_init();
 	init_pixel_ops();
+	fast_math_init();
 	fx_plasma_init();
 	fx_raytrace_init();
 	fx_starfield_init();
 	fx_prettyhip_init();
+#if BENCHMARK_MODE
+	fx_mesh_init(); // not on the timeline yet
+#endif
+	audio_analysis_init();
+	mixer_init();
+	hud_init();
+#if BENCHMARK_MODE
+	fast_math_report();
+	audio_analysis_report();
+	audio_clock_report();
+	mixer_report();
+	gouraud_report();
+	lines_report();
+	hud_report();
+	perf_counters_reset();
+	audio_telemetry_reset();
+#endif
 
 #if PLAY_MUSIC
 	s_music = plat_audio_play_file(kMusicPath);
@@ -61,9 +92,13 @@ void app_initialize()
 		G.ending = false;
 	else
 		plat_sys_log_error("Could not load music file %s", kMusicPath);
+	s_stamp = plat_audio_load_sample(kStampPath);
+	if (s_stamp == NULL)
+		plat_sys_log_error("Could not load sample %s", kStampPath);
 #endif
 }
 
+#if !BENCHMARK_MODE
 static int s_beat_frame_done = -1;
 #define TIME_SCRUB_SECONDS (5.0f)
 
@@ -82,12 +117,14 @@ static int track_current_time()
 			{
 				offset -= TIME_SCRUB_SECONDS;
 				plat_audio_set_time(s_music, offset);
+				audio_analysis_reset();
 			}
 		}
 		if (G.buttons_pressed & kPlatButtonDown) {
 			float offset = plat_audio_get_time(s_music);
 			offset += 5.0f;
 			plat_audio_set_time(s_music, offset);
+			audio_analysis_reset();
 		}
 		G.time = plat_audio_get_time(s_music) / TIME_UNIT_LENGTH_SECONDS;
 
@@ -95,6 +132,7 @@ static int track_current_time()
 		if (!plat_audio_is_playing(s_music))
 		{
 			G.ending = true;
+			audio_analysis_reset();
 			plat_time_reset();
 			G.time = G.prev_time = 0.0f;
 		}
@@ -104,13 +142,29 @@ static int track_current_time()
 	if (G.prev_time > G.time)
 		G.prev_time = G.time;
 
+#if PLAY_MUSIC
+	// Without music nothing feeds the analysis (on Playdate its published values would stay
+	// frozen at the last ones), so the levels are zeroed here.
+	static uint32_t s_onset_count;
+	AudioAnalysis audio;
+	audio_analysis_read(&audio);
+	bool playing = s_music && !G.ending;
+	for (int i = 0; i < AUDIO_BAND_COUNT; ++i)
+		G.audio_bands[i] = playing ? audio.bands[i] : 0.0f;
+	G.audio_level = playing ? audio.level : 0.0f;
+	G.onset = playing && audio.onset_count != s_onset_count;
+	s_onset_count = audio.onset_count;
+#endif
+
 	// "beat" is if during this frame the tick would change (except when music is done, no beats then)
 	int beat_at_end_of_frame = (int)(G.time + TIME_LEN_30FPSFRAME);
 	G.beat = (G.ending || (s_beat_frame_done >= beat_at_end_of_frame)) ? false : true;
 	return beat_at_end_of_frame;
 }
+#endif // #if !BENCHMARK_MODE
 
 typedef struct DemoEffect {
+	const char* name;
 	float start_time;
 	float end_time;
 	fx_update_function update;
@@ -118,28 +172,29 @@ typedef struct DemoEffect {
 } DemoEffect;
 
 static DemoEffect s_effects[] = {
-	{0, 32, fx_starfield_update},
-	{32, 64, fx_prettyhip_update},
-	{64, 96, fx_plasma_update},
-	{96, 240, fx_raymarch_update},
-	{240, 304, fx_raytrace_update},
+	{"starfield", 0, 32, fx_starfield_update},
+	{"prettyhip", 32, 64, fx_prettyhip_update},
+	{"plasma", 64, 96, fx_plasma_update},
+	{"raymarch", 96, 240, fx_raymarch_update},
+	{"raytrace", 240, 304, fx_raytrace_update},
 };
 #define DEMO_EFFECT_COUNT (sizeof(s_effects)/sizeof(s_effects[0]))
 
 static DemoEffect s_ending_effects[] = {
-	{0, 32, fx_starfield_update, 0.5f},
-	{32, 64, fx_prettyhip_update, 0.5f},
-	{64, 80, fx_plasma_update, 0.4f}, // w/ twisty cube
-	{80, 96, fx_plasma_update, 0.6f}, // w/ twisted ring
-	{96, 240, fx_raymarch_update, 0.2f}, // xor towers
-	{96, 240, fx_raymarch_update, 0.3f}, // sponge
-	{96, 240, fx_raymarch_update, 0.4f}, // puls
-	{96, 240, fx_raymarch_update, 0.8f}, // 4x fx rotating
-	{240, 304, fx_raytrace_update, 0.5f},
+	{"starfield", 0, 32, fx_starfield_update, 0.5f},
+	{"prettyhip", 32, 64, fx_prettyhip_update, 0.5f},
+	{"plasma: twisty cube", 64, 80, fx_plasma_update, 0.4f},
+	{"plasma: ring twister", 80, 96, fx_plasma_update, 0.6f},
+	{"raymarch: xor towers", 96, 240, fx_raymarch_update, 0.2f},
+	{"raymarch: sponge", 96, 240, fx_raymarch_update, 0.3f},
+	{"raymarch: puls", 96, 240, fx_raymarch_update, 0.4f},
+	{"raymarch: 4 scenes rotating", 96, 240, fx_raymarch_update, 0.8f},
+	{"raytrace", 240, 304, fx_raytrace_update, 0.5f},
 };
 #define DEMO_ENDING_EFFECT_COUNT (sizeof(s_ending_effects)/sizeof(s_ending_effects[0]))
 
 static int s_cur_effect = DEMO_ENDING_EFFECT_COUNT - 1;
+static const char* s_section; // name of the effect or benchmark part, for the HUD
 
 
 static void update_effect()
@@ -155,6 +210,7 @@ static void update_effect()
 			{
 				float a = invlerp(fx->start_time, fx->end_time, t);
 				fx->update(fx->start_time, fx->end_time, a);
+				s_section = fx->name;
 				break;
 			}
 		}
@@ -177,8 +233,32 @@ static void update_effect()
 		}
 		const DemoEffect* fx = &s_ending_effects[s_cur_effect];
 		fx->update(fx->start_time, fx->end_time, fx->ending_alpha);
+		s_section = fx->name;
+	}
+}
+
+#if PLAY_MUSIC
+// Stamps are scheduled this far ahead (in beats), so that they start exactly on their beat.
+#define STAMP_LOOKAHEAD (0.25f)
+static float s_stamps_scheduled_until = -1.0f;
+
+static void schedule_stamps()
+{
+	if (s_stamp == NULL || G.ending)
+		return;
+	// seeked back: schedule the stamps from there again
+	if (s_stamps_scheduled_until > G.time + STAMP_LOOKAHEAD)
+		s_stamps_scheduled_until = G.time;
+	float until = G.time + STAMP_LOOKAHEAD;
+	for (int i = 0; i < DEMO_IMAGE_COUNT; ++i)
+	{
+		const DemoImage* img = &s_images[i];
+		if (img->stamp && img->tstart > s_stamps_scheduled_until && img->tstart <= until && img->tstart >= G.time)
+			plat_audio_play_sample(s_stamp, 0.6f, 0.0f, img->tstart * TIME_UNIT_LENGTH_SECONDS);
 	}
+	s_stamps_scheduled_until = until;
 }
+#endif
 
 static void update_images()
 {
@@ -192,6 +272,149 @@ static void update_images()
 	}
 }
 
+#if BENCHMARK_MODE
+
+typedef struct BenchSegment {
+	const char* name;
+	float start_time;
+	float end_time;
+	fx_update_function update; // effect that is not on the timeline, or NULL
+} BenchSegment;
+
+static const BenchSegment s_bench_segments[] = {
+	{"starfield", 0, 32},
+	{"prettyhip", 32, 64},
+	{"plasma: twisty cube", 64, 80},
+	{"plasma: ring twister", 80, 96},
+	{"raymarch: octa field", 96, 112},
+	{"raymarch: sphere field", 112, 128},
+	{"raymarch: xor towers", 128, 144},
+	{"raymarch: sponge", 144, 160},
+	{"raymarch: puls", 160, 176},
+	{"raymarch: sphere field + puls", 176, 192},
+	{"raymarch: 4 scenes", 192, 208},
+	{"raymarch: 4 scenes rotating", 208, 240},
+	{"raytrace", 240, 304},
+	{"mesh: tori", 240, 304, fx_mesh_update},
+	{"mesh: tori wireframe", 240, 304, fx_mesh_wireframe_update},
+	{"mesh: tori gouraud", 240, 304, fx_mesh_gouraud_update},
+	{"mesh: tori stack", 240, 304, fx_mesh_stack_update},
+};
+#define BENCH_SEGMENT_COUNT (sizeof(s_bench_segments)/sizeof(s_bench_segments[0]))
+
+// Each variant runs the segments overlapping its time range, with the option set to the given value.
+typedef struct BenchVariant {
+	const char* name;
+	int* option;
+	int value;
+	float start_time;
+	float end_time;
+} BenchVariant;
+
+static const BenchVariant s_bench_variants[] = {
+	{"default", NULL, false, 0, 304},
+	{"xor towers: voxel dda", &g_fx_options.xor_dda, 1, 128, 144},
+	{"puls: no warm start", &g_fx_options.march_warm_start, 0, 160, 240},
+	{"raymarch: cone prepass (approximate)", &g_fx_options.cone_prepass, 1, 96, 176},
+#if RAYMARCH_FIXED_POINT
+	{"raymarch: float kernels", &g_fx_options.raymarch_fixed, 0, 96, 240},
+	{"raymarch: fixed vs float accuracy", &g_fx_options.raymarch_compare, 1, 96, 240},
+#endif
+	{"raymarch: sdf grid nearest", &g_fx_options.sdf_mode, kSdfGridNearest, 96, 240},
+	{"raymarch: sdf grid trilinear", &g_fx_options.sdf_mode, kSdfGridTrilinear, 96, 240},
+	{"plasma: no object spans", &g_fx_options.plasma_spans, 0, 64, 96},
+	{"prettyhip: 240 bars", &g_fx_options.kefren_bar_count, 240, 32, 64},
+	{"prettyhip: 960 bars", &g_fx_options.kefren_bar_count, 960, 32, 64},
+	{"dither: no run cache", &g_dither_runs, 0, 0, 304},
+	{"mesh: painter's order", &g_mesh_coverage, kMeshCoverageOff, 240, 304},
+	{"mesh: coverage everywhere", &g_mesh_coverage, kMeshCoverageAlways, 240, 304},
+	{"kernels: scalar", &g_kernel_isa_max, kIsaScalar, 0, 304},
+#if KERNELS_X86
+	{"kernels: sse2", &g_kernel_isa_max, kIsaSSE2, 0, 304},
+#endif
+};
+#define BENCH_VARIANT_COUNT (sizeof(s_bench_variants)/sizeof(s_bench_variants[0]))
+
+static int s_bench_variant = 0;
+static int s_bench_segment = -1;
+static int s_bench_frame = 0;
+static float s_bench_seconds = 0.0f;
+
+static bool bench_segment_in_variant(int variant, int segment)
+{
+	const BenchVariant* var = &s_bench_variants[variant];
+	const BenchSegment* seg = &s_bench_segments[segment];
+	return seg->start_time < var->end_time && seg->end_time > var->start_time;
+}
+
+// advance to next segment (and variant); returns false when everything is done
+static bool bench_next_segment()
+{
+	static int prev_value;
+	while (s_bench_variant < BENCH_VARIANT_COUNT)
+	{
+		const BenchVariant* var = &s_bench_variants[s_bench_variant];
+		if (var->option && s_bench_segment < 0)
+		{
+			prev_value = *var->option;
+			*var->option = var->value;
+			kernels_bind_all(); // in case the option was the kernel limit
+		}
+		while (++s_bench_segment < BENCH_SEGMENT_COUNT)
+		{
+			if (bench_segment_in_variant(s_bench_variant, s_bench_segment))
+				return true;
+		}
+		if (var->option)
+		{
+			*var->option = prev_value;
+			kernels_bind_all();
+		}
+		s_bench_segment = -1;
+		s_bench_variant++;
+	}
+	return false;
+}
+
+static void bench_update()
+{
+	if (s_bench_variant >= BENCH_VARIANT_COUNT)
+		return;
+	if (s_bench_segment < 0 && !bench_next_segment())
+		return;
+
+	const BenchSegment* seg = &s_bench_segments[s_bench_segment];
+	s_section = seg->name;
+	G.frame_count++;
+	G.prev_time = G.time;
+	G.time = seg->start_time + s_bench_frame * TIME_LEN_30FPSFRAME;
+	G.beat = (int)G.time != (int)(G.time + TIME_LEN_30FPSFRAME);
+
+	float t0 = plat_time_get();
+	if (seg->update)
+		seg->update(seg->start_time, seg->end_time, invlerp(seg->start_time, seg->end_time, G.time));
+	else
+		update_effect();
+	s_bench_seconds += plat_time_get() - t0;
+	s_bench_frame++;
+
+	if (G.time + TIME_LEN_30FPSFRAME >= seg->end_time)
+	{
+		plat_sys_log("bench [%s] %s: %.2f ms/frame", s_bench_variants[s_bench_variant].name, seg->name, s_bench_seconds * 1000.0f / s_bench_frame);
+		perf_counters_log(s_bench_frame, s_bench_seconds);
+		perf_counters_reset();
+		audio_telemetry_log("  audio");
+		audio_telemetry_reset();
+		s_bench_frame = 0;
+		s_bench_seconds = 0.0f;
+		clear_screen_buffers();
+		if (!bench_next_segment())
+			plat_sys_log("bench: done");
+	}
+}
+
+#endif // #if BENCHMARK_MODE
+
 void app_update()
 {
 	// track inputs and time
@@ -201,22 +424,32 @@ void app_update()
 	G.buttons_pressed = btPushed;
 	G.crank_angle_rad = plat_input_get_crank_angle_rad();
 
-	int beat_at_end_of_frame = track_current_time();
-
 	G.framebuffer = plat_gfx_get_frame();
 	G.framebuffer_stride = SCREEN_STRIDE_BYTES;
+	hud_begin_frame(btCur, btPushed);
+
+#if BENCHMARK_MODE
+	bench_update();
+#else
+	int beat_at_end_of_frame = track_current_time();
+#if PLAY_MUSIC
+	schedule_stamps();
+#endif
 
 	// update the effect
+	float effect_t0 = hud_stage_begin();
 	update_effect();
+	hud_stage_end(kHudStageEffect, effect_t0);
 
 	s_beat_frame_done = beat_at_end_of_frame;
+#endif
 
+	float overlay_t0 = hud_stage_begin();
 	update_images();
+	hud_stage_end(kHudStageOverlay, overlay_t0);
 
-	// draw FPS, time
-#if SHOW_STATS
-	plat_gfx_draw_stats(G.time);
-#endif
+	// performance HUD (Left+Right or the Playdate system menu toggles it)
+	hud_draw(G.framebuffer, s_section, G.time);
 
 	// tell OS that we've updated the whole screen
 	plat_gfx_mark_updated_rows(0, SCREEN_Y-1);
@@ -0,0 +1,295 @@
+// SPDX-License-Identifier: Unlicense
+
+#include "gouraud.h"
+#include "render.h"
+
+#include "../platform.h"
+#include "../util/cpu_dispatch.h"
+#include "../util/perf_stats.h"
+
+#include <string.h>
+
+#if KERNELS_X86
+#include <immintrin.h>
+#endif
+#if KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+// Fills count pixels with intensities value, value + step, ... (16.16, clamped to 0..255).
+typedef void (*GouraudSpanFunc)(uint8_t* dst, int count, int32_t value, int32_t step);
+
+static void gouraud_span_scalar(uint8_t* dst, int count, int32_t value, int32_t step)
+{
+	for (int i = 0; i < count; ++i, value += step)
+	{
+		int v = value >> 16;
+		dst[i] = (uint8_t)MIN(MAX(v, 0), 255);
+	}
+}
+
+#if KERNELS_X86
+KERNEL_TARGET("sse2")
+static void gouraud_span_sse2(uint8_t* dst, int count, int32_t value, int32_t step)
+{
+	__m128i v = _mm_setr_epi32(value, value + step, value + step * 2, value + step * 3);
+	const __m128i step4 = _mm_set1_epi32(step * 4);
+	int i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i a = v;
+		__m128i b = _mm_add_epi32(a, step4);
+		__m128i c = _mm_add_epi32(b, step4);
+		__m128i d = _mm_add_epi32(c, step4);
+		v = _mm_add_epi32(d, step4);
+		// saturating packs clamp to 0..255
+		__m128i ab = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+		__m128i cd = _mm_packs_epi32(_mm_srai_epi32(c, 16), _mm_srai_epi32(d, 16));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(ab, cd));
+	}
+	gouraud_span_scalar(dst + i, count - i, value + step * i, step);
+}
+#endif // #if KERNELS_X86
+
+#if KERNELS_NEON
+static void gouraud_span_neon(uint8_t* dst, int count, int32_t value, int32_t step)
+{
+	static const int32_t kLanes[4] = { 0, 1, 2, 3 };
+	int32x4_t v = vmlaq_n_s32(vdupq_n_s32(value), vld1q_s32(kLanes), step);
+	const int32x4_t step4 = vdupq_n_s32(step * 4);
+	int i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		int32x4_t a = v;
+		int32x4_t b = vaddq_s32(a, step4);
+		int32x4_t c = vaddq_s32(b, step4);
+		int32x4_t d = vaddq_s32(c, step4);
+		v = vaddq_s32(d, step4);
+		// saturating narrows clamp to 0..255
+		int16x8_t ab = vcombine_s16(vqshrn_n_s32(a, 16), vqshrn_n_s32(b, 16));
+		int16x8_t cd = vcombine_s16(vqshrn_n_s32(c, 16), vqshrn_n_s32(d, 16));
+		vst1q_u8(dst + i, vcombine_u8(vqmovun_s16(ab), vqmovun_s16(cd)));
+	}
+	gouraud_span_scalar(dst + i, count - i, value + step * i, step);
+}
+#endif // #if KERNELS_NEON
+
+static KernelSlot s_span_slot = {
+	"gouraud_span",
+	{
+		{kIsaScalar, (KernelFunc)gouraud_span_scalar},
+#if KERNELS_X86
+		{kIsaSSE2, (KernelFunc)gouraud_span_sse2},
+#endif
+#if KERNELS_NEON
+		{kIsaNEON, (KernelFunc)gouraud_span_neon},
+#endif
+	},
+};
+
+void gouraud_init()
+{
+	kernels_register(&s_span_slot);
+}
+
+typedef struct GouraudVertex {
+	const float3* p;
+	float i;
+} GouraudVertex;
+
+// 16.16 x of an edge at the center of row y, and its step per row
+typedef struct GouraudEdge {
+	int32_t x, dx;
+} GouraudEdge;
+
+static void edge_setup(GouraudEdge* e, const float3* p0, const float3* p1, int y)
+{
+	// an edge shorter than a row is only ever evaluated at one row; keep its slope in range
+	float slope = (p1->x - p0->x) / (p1->y - p0->y);
+	slope = MIN(MAX(slope, -16384.0f), 16384.0f);
+	e->x = (int32_t)((p0->x + (y + 0.5f - p0->y) * slope) * 65536.0f);
+	e->dx = (int32_t)(slope * 65536.0f);
+}
+
+// first pixel with center at or right of a 16.16 position
+static inline int pixel_ceil(int32_t x)
+{
+	return (x - 0x8000 + 0xFFFF) >> 16;
+}
+
+static inline int row_ceil(float y)
+{
+	return MIN(MAX((int)ceilf(y - 0.5f), 0), SCREEN_Y);
+}
+
+// Pixels inside a triangle stay within its vertex intensities, but the gradient of a sliver can be
+// huge, and rounding then puts the ends of its spans far outside. Span values and steps are kept in
+// these ranges so that the 16.16 values (and the few steps the span kernels look ahead) fit; the
+// float plane is only limited enough to stay finite.
+#define GOURAUD_MAX_STEP (4096.0f) // per pixel
+#define GOURAUD_MAX_VALUE (8192.0f)
+#define GOURAUD_MAX_GRADIENT (1.0e6f)
+
+static inline float clamp_abs(float v, float limit)
+{
+	return MIN(MAX(v, -limit), limit);
+}
+
+void fillTriangleGouraud(uint8_t* buffer, int stride, const float3* p1, const float3* p2, const float3* p3, float i1, float i2, float i3)
+{
+	GouraudVertex v[3] = { {p1, i1}, {p2, i2}, {p3, i3} };
+	// sort by y
+	if (v[1].p->y < v[0].p->y) { GouraudVertex t = v[0]; v[0] = v[1]; v[1] = t; }
+	if (v[2].p->y < v[1].p->y) { GouraudVertex t = v[1]; v[1] = v[2]; v[2] = t; }
+	if (v[1].p->y < v[0].p->y) { GouraudVertex t = v[0]; v[0] = v[1]; v[1] = t; }
+	const float3* a = v[0].p;
+	const float3* b = v[1].p;
+	const float3* c = v[2].p;
+
+	float area2 = (b->x - a->x) * (c->y - a->y) - (c->x - a->x) * (b->y - a->y);
+	if (area2 == 0.0f)
+		return;
+	int y = row_ceil(a->y);
+	int y_mid = row_ceil(b->y);
+	int y_end = row_ceil(c->y);
+	if (y >= y_end)
+		return;
+
+	// intensity gradient of the triangle plane
+	float inv_area2 = 1.0f / area2;
+	float didx = ((v[1].i - v[0].i) * (c->y - a->y) - (v[2].i - v[0].i) * (b->y - a->y)) * inv_area2;
+	float didy = ((v[2].i - v[0].i) * (b->x - a->x) - (v[1].i - v[0].i) * (c->x - a->x)) * inv_area2;
+	didx = clamp_abs(didx, GOURAUD_MAX_GRADIENT);
+	didy = clamp_abs(didy, GOURAUD_MAX_GRADIENT);
+	int32_t step = (int32_t)(clamp_abs(didx, GOURAUD_MAX_STEP) * 65536.0f);
+	// intensity at the center of pixel 0 of the row
+	float row_i = v[0].i + (0.5f - a->x) * didx + (y + 0.5f - a->y) * didy;
+
+	// positive area: the middle vertex is right of the long edge
+	bool long_left = area2 > 0.0f;
+	GouraudEdge long_edge, short_edge;
+	edge_setup(&long_edge, a, c, y);
+	if (y < y_mid)
+		edge_setup(&short_edge, a, b, y);
+	else
+		edge_setup(&short_edge, b, c, y);
+
+	GouraudSpanFunc span = (GouraudSpanFunc)kernel_bound(&s_span_slot);
+	uint8_t* row = buffer + y * stride;
+	for (; y < y_end; ++y, row += stride, row_i += didy)
+	{
+		if (y == y_mid)
+			edge_setup(&short_edge, b, c, y);
+		int32_t xl = long_left ? long_edge.x : short_edge.x;
+		int32_t xr = long_left ? short_edge.x : long_edge.x;
+		int x0 = MAX(pixel_ceil(xl), 0);
+		int x1 = MIN(pixel_ceil(xr), SCREEN_X);
+		if (x0 < x1)
+		{
+			float i0 = row_i + x0 * didx;
+			float i_last = i0 + (x1 - x0 - 1) * didx;
+			int32_t span_step = step;
+			if (fabsf(i0) > GOURAUD_MAX_VALUE || fabsf(i_last) > GOURAUD_MAX_VALUE)
+			{
+				i0 = clamp_abs(i0, GOURAUD_MAX_VALUE);
+				i_last = clamp_abs(i_last, GOURAUD_MAX_VALUE);
+				float di = x1 - x0 > 1 ? (i_last - i0) / (x1 - x0 - 1) : 0.0f;
+				span_step = (int32_t)(clamp_abs(di, GOURAUD_MAX_STEP) * 65536.0f);
+			}
+			span(row + x0, x1 - x0, (int32_t)(i0 * 65536.0f), span_step);
+		}
+		long_edge.x += long_edge.dx;
+		short_edge.x += short_edge.dx;
+	}
+}
+
+#if BENCHMARK_MODE
+
+#define REPORT_TRIANGLES (512)
+#define REPORT_PASSES (64)
+
+static float3 s_report_points[REPORT_TRIANGLES][3];
+static float s_report_intensities[REPORT_TRIANGLES][3];
+static uint8_t s_report_buffer8[SCREEN_X * SCREEN_Y];
+static uint32_t s_report_buffer1[SCREEN_STRIDE_BYTES * SCREEN_Y / 4];
+
+static float time_gouraud()
+{
+	float t0 = plat_time_get();
+	for (int pass = 0; pass < REPORT_PASSES; ++pass)
+	{
+		for (int i = 0; i < REPORT_TRIANGLES; ++i)
+		{
+			const float3* p = s_report_points[i];
+			const float* in = s_report_intensities[i];
+			fillTriangleGouraud(s_report_buffer8, SCREEN_X, &p[0], &p[1], &p[2], in[0], in[1], in[2]);
+		}
+	}
+	return plat_time_get() - t0;
+}
+
+static float time_fill_1bit()
+{
+	static const uint8_t kPattern[8] = { 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55 };
+	float t0 = plat_time_get();
+	for (int pass = 0; pass < REPORT_PASSES; ++pass)
+	{
+		for (int i = 0; i < REPORT_TRIANGLES; ++i)
+		{
+			const float3* p = s_report_points[i];
+			fillTriangle((uint8_t*)s_report_buffer1, SCREEN_STRIDE_BYTES, &p[0], &p[1], &p[2], kPattern);
+		}
+	}
+	return plat_time_get() - t0;
+}
+
+void gouraud_report()
+{
+	// random on screen triangles, 4..120 pixels in size
+	uint32_t rng = 1;
+	double pixels = 0.0;
+	for (int i = 0; i < REPORT_TRIANGLES; ++i)
+	{
+		float size = 4.0f + 116.0f * RandomFloat01(&rng);
+		float cx = size + (SCREEN_X - 2 * size) * RandomFloat01(&rng);
+		float cy = MIN(size, SCREEN_Y / 2) + (SCREEN_Y - 2 * MIN(size, SCREEN_Y / 2)) * RandomFloat01(&rng);
+		for (int j = 0; j < 3; ++j)
+		{
+			float a = (j + RandomFloat01(&rng) * 0.5f) * (2.0f * M_PIf / 3.0f);
+			float3 pt = { cx + cosf(a) * size, cy + sinf(a) * MIN(size, SCREEN_Y / 2 - 1), 0 };
+			s_report_points[i][j] = pt;
+			s_report_intensities[i][j] = 255.0f * RandomFloat01(&rng);
+		}
+		const float3* p = s_report_points[i];
+		pixels += fabsf((p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y)) * 0.5f;
+	}
+	pixels *= REPORT_PASSES;
+	double tris = (double)REPORT_TRIANGLES * REPORT_PASSES;
+
+	static const char* kIsaNames[kIsaCount] = { "scalar", "sse2", "avx2", "neon" };
+	int prev_isa_max = g_kernel_isa_max;
+	for (int isa = 0; isa <= prev_isa_max; ++isa)
+	{
+		if (!kernels_isa_supported((KernelIsa)isa))
+			continue;
+		g_kernel_isa_max = isa;
+		kernels_bind_all();
+		if (s_span_slot.bound_isa != isa)
+			continue;
+		float s = time_gouraud();
+		plat_sys_log("gouraud 8-bit fill (%s): %.1f Mpix/s, %.2f Mtri/s", kIsaNames[isa], pixels / s * 1.0e-6, tris / s * 1.0e-6);
+	}
+	g_kernel_isa_max = prev_isa_max;
+	kernels_bind_all();
+
+	float s = time_fill_1bit();
+	plat_sys_log("fillTriangle 1-bit pattern fill: %.1f Mpix/s, %.2f Mtri/s", pixels / s * 1.0e-6, tris / s * 1.0e-6);
+}
+
+#else
+
+void gouraud_report()
+{
+}
+
+#endif
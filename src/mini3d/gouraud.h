@@ -0,0 +1,19 @@
+// SPDX-License-Identifier: Unlicense
+
+#pragma once
+
+#include "../mathlib.h"
+
+// Triangles into an 8-bit intensity buffer (like g_screen_buffer, SCREEN_X x SCREEN_Y), with
+// intensities interpolated from the vertices. Pixels are filled when their center is inside;
+// x and y of the points are in pixels, z is ignored. Edges step in 16.16 fixed point, and the
+// span fill (16.16 intensity steps) has SIMD variants on PC.
+
+void gouraud_init();
+
+// intensities are 0..255
+void fillTriangleGouraud(uint8_t* buffer, int stride, const float3* p1, const float3* p2, const float3* p3, float i1, float i2, float i3);
+
+// Benchmark mode: logs pixel throughput of fillTriangleGouraud (for each kernel variant) and of
+// the 1-bit fillTriangle on the same triangles.
+void gouraud_report();
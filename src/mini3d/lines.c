@@ -0,0 +1,208 @@
+// SPDX-License-Identifier: Unlicense
+
+#include "lines.h"
+#include "render.h"
+
+#include "../platform.h"
+#include "../util/perf_stats.h"
+
+// Clips the segment to [xmin, xmax] x [ymin, ymax]; false if nothing is left.
+static bool clip_segment(float* x0, float* y0, float* x1, float* y1, float xmin, float ymin, float xmax, float ymax)
+{
+	if (MIN(*x0, *x1) >= xmin && MAX(*x0, *x1) <= xmax && MIN(*y0, *y1) >= ymin && MAX(*y0, *y1) <= ymax)
+		return true;
+	float dx = *x1 - *x0, dy = *y1 - *y0;
+	float p[4] = { -dx, dx, -dy, dy };
+	float q[4] = { *x0 - xmin, xmax - *x0, *y0 - ymin, ymax - *y0 };
+	float t0 = 0.0f, t1 = 1.0f;
+	for (int i = 0; i < 4; ++i)
+	{
+		if (p[i] == 0.0f)
+		{
+			// parallel to this edge
+			if (q[i] < 0.0f)
+				return false;
+			continue;
+		}
+		float t = q[i] / p[i];
+		if (p[i] < 0.0f)
+		{
+			if (t > t1)
+				return false;
+			t0 = MAX(t0, t);
+		}
+		else
+		{
+			if (t < t0)
+				return false;
+			t1 = MIN(t1, t);
+		}
+	}
+	float sx = *x0, sy = *y0;
+	*x0 = sx + t0 * dx;
+	*y0 = sy + t0 * dy;
+	*x1 = sx + t1 * dx;
+	*y1 = sy + t1 * dy;
+	return true;
+}
+
+// pixels [x0, x1) of a row; words hold 32 pixels, leftmost in the top bit of the big endian word
+static inline void write_run(uint32_t* row, int x0, int x1, uint32_t color)
+{
+	x0 = MAX(x0, 0);
+	x1 = MIN(x1, SCREEN_X);
+	if (x0 >= x1)
+		return;
+	int w0 = x0 >> 5, w1 = (x1 - 1) >> 5;
+	uint32_t m0 = 0xFFFFFFFFu >> (x0 & 31);
+	uint32_t m1 = 0xFFFFFFFFu << (31 - ((x1 - 1) & 31));
+	if (w0 == w1)
+	{
+		uint32_t m = swap(m0 & m1);
+		row[w0] = (row[w0] & ~m) | (color & m);
+		return;
+	}
+	m0 = swap(m0);
+	m1 = swap(m1);
+	row[w0] = (row[w0] & ~m0) | (color & m0);
+	for (int w = w0 + 1; w < w1; ++w)
+		row[w] = color;
+	row[w1] = (row[w1] & ~m1) | (color & m1);
+}
+
+typedef struct LineTarget {
+	uint8_t* bitmap;
+	int rowstride;
+	int thick;
+	uint32_t colors[8]; // pattern bytes, replicated to words
+} LineTarget;
+
+static void draw_segment(const LineTarget* tgt, float x0, float y0, float x1, float y1)
+{
+	// the brush extends right and down from each pixel, so it touches the screen from up to
+	// thick-1 pixels above/left
+	int thick = tgt->thick;
+	float lo = (float)(1 - thick);
+	if (!clip_segment(&x0, &y0, &x1, &y1, lo, lo, SCREEN_X - 1.0f / 1024, SCREEN_Y - 1.0f / 1024))
+		return;
+	if (y0 > y1)
+	{
+		float t = x0; x0 = x1; x1 = t;
+		t = y0; y0 = y1; y1 = t;
+	}
+
+	// Row r of the brush stroke covers the line between y = r-thick+1 and y = r+1 (clamped to the
+	// segment); the line is monotone in x, so that is one run between the x at both ends. Both
+	// ends step along the row boundaries in 16.16.
+	int y_first = (int)floorf(y0);
+	int y_last = (int)floorf(y1);
+	int32_t fx0 = (int32_t)(x0 * 65536.0f);
+	int32_t fx1 = (int32_t)(x1 * 65536.0f);
+	int32_t step = 0, boundary = fx0;
+	if (y_last > y_first)
+	{
+		float dxdy = (x1 - x0) / (y1 - y0);
+		step = (int32_t)(dxdy * 65536.0f);
+		boundary = (int32_t)((x0 + (y_first + 1 - y0) * dxdy) * 65536.0f);
+	}
+	int32_t top = fx0, bottom = boundary;
+	int r = y_first;
+	int r_end = MIN(y_last + thick, SCREEN_Y);
+	for (; r < r_end; ++r)
+	{
+		int32_t xb = r >= y_last ? fx1 : bottom;
+		if (r >= 0)
+		{
+			uint8_t* row = tgt->bitmap + r * tgt->rowstride;
+			int run0 = MIN(top, xb) >> 16, run1 = MAX(top, xb) >> 16;
+			write_run((uint32_t*)row, run0, run1 + thick, tgt->colors[r & 7]);
+		}
+		bottom += step;
+		if (r - thick + 1 >= y_first)
+			top = r - thick + 1 == y_first ? boundary : top + step;
+	}
+}
+
+static void setup_target(LineTarget* tgt, uint8_t* bitmap, int rowstride, int thick, const uint8_t pattern[8])
+{
+	tgt->bitmap = bitmap;
+	tgt->rowstride = rowstride;
+	tgt->thick = MAX(thick, 1);
+	for (int i = 0; i < 8; ++i)
+		tgt->colors[i] = pattern[i] * 0x01010101u;
+}
+
+void lines_draw_segments(uint8_t* bitmap, int rowstride, const float3* points, int count, int thick, const uint8_t pattern[8])
+{
+	LineTarget tgt;
+	setup_target(&tgt, bitmap, rowstride, thick, pattern);
+	for (int i = 0; i < count; ++i, points += 2)
+		draw_segment(&tgt, points[0].x, points[0].y, points[1].x, points[1].y);
+	PERF_COUNT(kPerfLineSegments, count);
+}
+
+void lines_draw_polyline(uint8_t* bitmap, int rowstride, const float3* points, int count, bool closed, int thick, const uint8_t pattern[8])
+{
+	LineTarget tgt;
+	setup_target(&tgt, bitmap, rowstride, thick, pattern);
+	for (int i = 1; i < count; ++i)
+		draw_segment(&tgt, points[i - 1].x, points[i - 1].y, points[i].x, points[i].y);
+	if (closed && count > 2)
+		draw_segment(&tgt, points[count - 1].x, points[count - 1].y, points[0].x, points[0].y);
+	PERF_COUNT(kPerfLineSegments, MAX(count - 1, 0) + (closed && count > 2));
+}
+
+#if BENCHMARK_MODE
+
+#define REPORT_SEGMENTS (4096)
+#define REPORT_PASSES (32)
+
+static float3 s_report_points[REPORT_SEGMENTS * 2];
+static uint32_t s_report_buffer[SCREEN_STRIDE_BYTES * SCREEN_Y / 4];
+
+void lines_report()
+{
+	// random segments 1..200 pixels long, a quarter of them partially or fully off screen
+	uint32_t rng = 1;
+	for (int i = 0; i < REPORT_SEGMENTS; ++i)
+	{
+		float margin = (i & 3) == 0 ? 100.0f : 0.0f;
+		float x = -margin + (SCREEN_X + 2 * margin) * RandomFloat01(&rng);
+		float y = -margin + (SCREEN_Y + 2 * margin) * RandomFloat01(&rng);
+		float a = 2.0f * M_PIf * RandomFloat01(&rng);
+		float len = 1.0f + 199.0f * RandomFloat01(&rng);
+		float x1 = x + cosf(a) * len, y1 = y + sinf(a) * len;
+		if (margin == 0.0f)
+		{
+			x1 = MIN(MAX(x1, 0.0f), SCREEN_X - 1.0f);
+			y1 = MIN(MAX(y1, 0.0f), SCREEN_Y - 1.0f);
+		}
+		s_report_points[i * 2 + 0] = (float3){ x, y, 0 };
+		s_report_points[i * 2 + 1] = (float3){ x1, y1, 0 };
+	}
+	static const uint8_t kPattern[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	double segments = (double)REPORT_SEGMENTS * REPORT_PASSES;
+
+	for (int thick = 1; thick <= 3; thick += 2)
+	{
+		float t0 = plat_time_get();
+		for (int pass = 0; pass < REPORT_PASSES; ++pass)
+			lines_draw_segments((uint8_t*)s_report_buffer, SCREEN_STRIDE_BYTES, s_report_points, REPORT_SEGMENTS, thick, kPattern);
+		float t1 = plat_time_get();
+		for (int pass = 0; pass < REPORT_PASSES; ++pass)
+		{
+			for (int i = 0; i < REPORT_SEGMENTS; ++i)
+				drawLine((uint8_t*)s_report_buffer, SCREEN_STRIDE_BYTES, &s_report_points[i * 2], &s_report_points[i * 2 + 1], thick, kPattern);
+		}
+		float t2 = plat_time_get();
+		plat_sys_log("lines thickness %i: %.2f Mseg/s (mini3d drawLine %.2f Mseg/s)", thick, segments / (t1 - t0) * 1.0e-6, segments / (t2 - t1) * 1.0e-6);
+	}
+}
+
+#else
+
+void lines_report()
+{
+}
+
+#endif
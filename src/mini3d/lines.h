@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: Unlicense
+
+#pragma once
+
+#include "../mathlib.h"
+
+// Batched line drawing into the 1-bit framebuffer (SCREEN_X x SCREEN_Y). Each segment is clipped
+// to the screen once (Liang-Barsky), then written as one horizontal run per row, with 32-bit word
+// masks. Lines are thick x thick pixel brushes, filled with pattern[y % 8] like fillTriangle.
+// Point z is ignored.
+
+// count segments: points[0]-points[1], points[2]-points[3], ...
+void lines_draw_segments(uint8_t* bitmap, int rowstride, const float3* points, int count, int thick, const uint8_t pattern[8]);
+// count points connected in order; closed also connects the last one to the first
+void lines_draw_polyline(uint8_t* bitmap, int rowstride, const float3* points, int count, bool closed, int thick, const uint8_t pattern[8]);
+
+// Benchmark mode: logs segments per second of lines_draw_segments and of mini3d drawLine.
+void lines_report();
@@ -0,0 +1,313 @@
+// SPDX-License-Identifier: Unlicense
+
+#include "mesh.h"
+#include "gouraud.h"
+#include "lines.h"
+#include "render.h"
+
+#include "../platform.h"
+#include "../util/fast_math.h"
+#include "../util/perf_stats.h"
+
+#include <string.h>
+
+#define MESH_NEAR (0.05f)
+#define MESH_FOCAL ((float)SCREEN_Y)
+// Projected coordinates are kept within this many pixels from the screen center (by clipping
+// against a guard band), so that fillTriangle's 16.16 edge math can not overflow.
+#define MESH_GUARD_BAND (4096.0f)
+#define MESH_MAX_POLY (3 + 5) // a triangle clipped by the near plane and the four guard band planes
+
+typedef struct MeshTriangle {
+	float3 p[3]; // screen x, y
+	float intensity[3]; // 0..1
+	uint8_t shade; // flat, of the whole face
+} MeshTriangle;
+
+// view space vertex with its lighting
+typedef struct MeshVertex {
+	float3 p;
+	float intensity;
+} MeshVertex;
+
+static uint8_t s_shade_patterns[MESH_SHADE_LEVELS][8];
+static MeshVertex s_view_verts[MESH_MAX_VERTICES];
+static MeshTriangle s_tris[MESH_MAX_TRIANGLES];
+static uint16_t s_keys[MESH_MAX_TRIANGLES];
+static uint16_t s_order[2][MESH_MAX_TRIANGLES];
+static int s_tri_count;
+static float3 s_light_dir;
+static float s_ambient;
+static MeshFrameStats s_stats;
+
+int g_mesh_coverage = kMeshCoveragePerScene;
+
+void mesh_pose_from_angles(MeshPose* pose, float yaw, float pitch, float roll, float3 pos)
+{
+	float cy = cosf(yaw), sy = sinf(yaw);
+	float cp = cosf(pitch), sp = sinf(pitch);
+	float cr = cosf(roll), sr = sinf(roll);
+	// Rz * Rx * Ry
+	float3 ry[3] = { {cy, 0, sy}, {0, 1, 0}, {-sy, 0, cy} };
+	float3 rxy[3] = {
+		ry[0],
+		v3_sub(v3_mulfl(ry[1], cp), v3_mulfl(ry[2], sp)),
+		v3_add(v3_mulfl(ry[1], sp), v3_mulfl(ry[2], cp)),
+	};
+	pose->rot[0] = v3_sub(v3_mulfl(rxy[0], cr), v3_mulfl(rxy[1], sr));
+	pose->rot[1] = v3_add(v3_mulfl(rxy[0], sr), v3_mulfl(rxy[1], cr));
+	pose->rot[2] = rxy[2];
+	pose->pos = pos;
+}
+
+void mesh_init()
+{
+	gouraud_init();
+
+	// 8x8 Bayer matrix; level L has the L lowest cells white
+	for (int y = 0; y < 8; ++y)
+	{
+		for (int x = 0; x < 8; ++x)
+		{
+			int bayer = 0;
+			for (int bit = 0; bit < 3; ++bit)
+				bayer = (bayer << 2) | ((((x ^ y) >> bit) & 1) << 1) | ((y >> bit) & 1);
+			for (int level = 0; level < MESH_SHADE_LEVELS; ++level)
+			{
+				if (bayer < level)
+					s_shade_patterns[level][y] |= 0x80 >> x;
+			}
+		}
+	}
+}
+
+void mesh_begin_frame(float3 light_dir, float ambient)
+{
+	s_tri_count = 0;
+	s_light_dir = v3_normalize(light_dir);
+	s_ambient = ambient;
+	memset(&s_stats, 0, sizeof(s_stats));
+}
+
+static inline float vertex_intensity(float3 normal)
+{
+	return s_ambient + (1.0f - s_ambient) * MAX(v3_dot(normal, s_light_dir), 0.0f);
+}
+
+// keeps the part where dot(plane, v) + d >= 0; returns the new vertex count
+static int clip_polygon(const MeshVertex* src, int count, MeshVertex* dst, float3 plane, float d)
+{
+	int res = 0;
+	MeshVertex prev = src[count - 1];
+	float prev_dist = v3_dot(plane, prev.p) + d;
+	for (int i = 0; i < count; ++i)
+	{
+		MeshVertex cur = src[i];
+		float dist = v3_dot(plane, cur.p) + d;
+		if ((dist >= 0.0f) != (prev_dist >= 0.0f))
+		{
+			float f = prev_dist / (prev_dist - dist);
+			dst[res++] = (MeshVertex){ v3_lerp(prev.p, cur.p, f), lerp(prev.intensity, cur.intensity, f) };
+		}
+		if (dist >= 0.0f)
+			dst[res++] = cur;
+		prev = cur;
+		prev_dist = dist;
+	}
+	return res;
+}
+
+static inline bool in_guard_band(float3 v)
+{
+	float limit = v.z * (MESH_GUARD_BAND / MESH_FOCAL);
+	return v.z >= MESH_NEAR && fabsf(v.x) <= limit && fabsf(v.y) <= limit;
+}
+
+static void emit_polygon(const MeshVertex* poly, int count, uint8_t shade, uint16_t key)
+{
+	float3 screen[MESH_MAX_POLY];
+	for (int i = 0; i < count; ++i)
+	{
+		float3 p = poly[i].p;
+		float iz = MESH_FOCAL / p.z;
+		screen[i] = (float3){ SCREEN_X / 2 + p.x * iz, SCREEN_Y / 2 - p.y * iz, p.z };
+	}
+	for (int i = 2; i < count && s_tri_count < MESH_MAX_TRIANGLES; ++i)
+	{
+		MeshTriangle* tri = &s_tris[s_tri_count];
+		tri->p[0] = screen[0];
+		tri->p[1] = screen[i - 1];
+		tri->p[2] = screen[i];
+		tri->intensity[0] = poly[0].intensity;
+		tri->intensity[1] = poly[i - 1].intensity;
+		tri->intensity[2] = poly[i].intensity;
+		tri->shade = shade;
+		s_keys[s_tri_count] = key;
+		s_tri_count++;
+	}
+}
+
+void mesh_submit(const Mesh* mesh, const MeshPose* pose)
+{
+	int vertex_count = MIN(mesh->vertex_count, MESH_MAX_VERTICES);
+	for (int i = 0; i < vertex_count; ++i)
+	{
+		float3 v = mesh->vertices[i];
+		s_view_verts[i].p = (float3){
+			v3_dot(pose->rot[0], v) + pose->pos.x,
+			v3_dot(pose->rot[1], v) + pose->pos.y,
+			v3_dot(pose->rot[2], v) + pose->pos.z,
+		};
+	}
+	if (mesh->normals)
+	{
+		for (int i = 0; i < vertex_count; ++i)
+		{
+			float3 n = mesh->normals[i];
+			float3 view_n = { v3_dot(pose->rot[0], n), v3_dot(pose->rot[1], n), v3_dot(pose->rot[2], n) };
+			s_view_verts[i].intensity = vertex_intensity(view_n);
+		}
+	}
+
+	s_stats.submitted += mesh->triangle_count;
+	const uint16_t* idx = mesh->indices;
+	for (int t = 0; t < mesh->triangle_count; ++t, idx += 3)
+	{
+		if (idx[0] >= vertex_count || idx[1] >= vertex_count || idx[2] >= vertex_count)
+			continue;
+		MeshVertex poly[MESH_MAX_POLY] = { s_view_verts[idx[0]], s_view_verts[idx[1]], s_view_verts[idx[2]] };
+		float3 p0 = poly[0].p, p1 = poly[1].p, p2 = poly[2].p;
+
+		// counter-clockwise on screen has the cross product pointing away from the camera
+		float3 n = v3_cross(v3_sub(p1, p0), v3_sub(p2, p0));
+		if (v3_dot(n, p0) <= 0.0f || (p0.z < MESH_NEAR && p1.z < MESH_NEAR && p2.z < MESH_NEAR))
+		{
+			s_stats.culled++;
+			continue;
+		}
+
+		float intensity = vertex_intensity(v3_mulfl(n, -rsqrtf_approx(v3_dot(n, n))));
+		uint8_t shade = (uint8_t)(saturate(intensity) * (MESH_SHADE_LEVELS - 1) + 0.5f);
+		if (!mesh->normals)
+			poly[0].intensity = poly[1].intensity = poly[2].intensity = intensity;
+
+		// painter's order key: farther first, from the bits of the positive float depth
+		float depth = MAX((p0.z + p1.z + p2.z) * (1.0f / 3.0f), 0.0f);
+		uint32_t depth_bits;
+		memcpy(&depth_bits, &depth, sizeof(depth_bits));
+		uint16_t key = (uint16_t)(0xFFFF - (depth_bits >> 16));
+
+		int count = 3;
+		if (!in_guard_band(p0) || !in_guard_band(p1) || !in_guard_band(p2))
+		{
+			const float k = MESH_GUARD_BAND / MESH_FOCAL;
+			MeshVertex tmp[MESH_MAX_POLY];
+			count = clip_polygon(poly, count, tmp, (float3){ 0, 0, 1 }, -MESH_NEAR);
+			if (count) count = clip_polygon(tmp, count, poly, (float3){ -1, 0, k }, 0);
+			if (count) count = clip_polygon(poly, count, tmp, (float3){ 1, 0, k }, 0);
+			if (count) count = clip_polygon(tmp, count, poly, (float3){ 0, -1, k }, 0);
+			if (count) count = clip_polygon(poly, count, tmp, (float3){ 0, 1, k }, 0);
+			memcpy(poly, tmp, count * sizeof(poly[0]));
+			if (count < 3)
+			{
+				s_stats.culled++;
+				continue;
+			}
+		}
+		emit_polygon(poly, count, shade, key);
+	}
+}
+
+// back to front triangle order: LSD radix sort by the 16 bit keys, 8 bits per pass
+static const uint16_t* sort_triangles()
+{
+	uint16_t* src = s_order[0];
+	uint16_t* dst = s_order[1];
+	for (int i = 0; i < s_tri_count; ++i)
+		src[i] = (uint16_t)i;
+	for (int shift = 0; shift < 16; shift += 8)
+	{
+		int offsets[256] = { 0 };
+		for (int i = 0; i < s_tri_count; ++i)
+			offsets[(s_keys[i] >> shift) & 0xFF]++;
+		int sum = 0;
+		for (int b = 0; b < 256; ++b)
+		{
+			int c = offsets[b];
+			offsets[b] = sum;
+			sum += c;
+		}
+		for (int i = 0; i < s_tri_count; ++i)
+		{
+			uint16_t t = src[i];
+			dst[offsets[(s_keys[t] >> shift) & 0xFF]++] = t;
+		}
+		uint16_t* tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+	return src;
+}
+
+static void finish_stats(MeshFrameStats* stats)
+{
+	FillStats fill;
+	getFillStats(&fill);
+	s_stats.drawn = s_tri_count;
+	s_stats.occluded = (int)fill.occluded_triangles;
+	s_stats.rasterized_pixels = (int)fill.rasterized;
+	s_stats.written_pixels = (int)fill.written;
+	PERF_COUNT(kPerfMeshSubmitted, s_stats.submitted);
+	PERF_COUNT(kPerfMeshCulled, s_stats.culled);
+	PERF_COUNT(kPerfMeshDrawn, s_stats.drawn);
+	PERF_COUNT(kPerfMeshOccluded, s_stats.occluded);
+	PERF_COUNT(kPerfMeshRasterized, s_stats.rasterized_pixels);
+	PERF_COUNT(kPerfMeshWritten, s_stats.written_pixels);
+	if (stats)
+		*stats = s_stats;
+}
+
+void mesh_end_frame(uint8_t* bitmap, int rowstride, bool coverage, MeshFrameStats* stats)
+{
+	const uint16_t* order = sort_triangles();
+	if (g_mesh_coverage != kMeshCoveragePerScene)
+		coverage = g_mesh_coverage == kMeshCoverageAlways;
+	if (coverage)
+	{
+		coverageReset();
+		for (int i = s_tri_count - 1; i >= 0; --i)
+		{
+			const MeshTriangle* tri = &s_tris[order[i]];
+			fillTriangleCovered(bitmap, rowstride, &tri->p[0], &tri->p[1], &tri->p[2], s_shade_patterns[tri->shade]);
+		}
+	}
+	else
+	{
+		for (int i = 0; i < s_tri_count; ++i)
+		{
+			const MeshTriangle* tri = &s_tris[order[i]];
+			fillTriangle(bitmap, rowstride, &tri->p[0], &tri->p[1], &tri->p[2], s_shade_patterns[tri->shade]);
+		}
+	}
+
+	finish_stats(stats);
+}
+
+void mesh_end_frame_gouraud(uint8_t* buffer, int stride, MeshFrameStats* stats)
+{
+	const uint16_t* order = sort_triangles();
+	for (int i = 0; i < s_tri_count; ++i)
+	{
+		const MeshTriangle* tri = &s_tris[order[i]];
+		fillTriangleGouraud(buffer, stride, &tri->p[0], &tri->p[1], &tri->p[2],
+			tri->intensity[0] * 255.0f, tri->intensity[1] * 255.0f, tri->intensity[2] * 255.0f);
+	}
+	finish_stats(stats);
+}
+
+void mesh_end_frame_wireframe(uint8_t* bitmap, int rowstride, int thick, const uint8_t pattern[8], MeshFrameStats* stats)
+{
+	for (int i = 0; i < s_tri_count; ++i)
+		lines_draw_polyline(bitmap, rowstride, s_tris[i].p, 3, true, thick, pattern);
+	finish_stats(stats);
+}
@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: Unlicense
+
+#pragma once
+
+#include "../mathlib.h"
+
+// Triangle meshes. Per frame: mesh_begin_frame, then mesh_submit for each object, then one of:
+// - mesh_end_frame: flat shaded into the 1-bit framebuffer with fillTriangle. The triangles of all
+//   objects get sorted by depth, and filled front to back through the coverage buffer (each
+//   pixel written once) when the scene asks for it, or back to front (painter's algorithm).
+//   Coverage pays off with a high depth complexity; on sparse scenes the span bookkeeping
+//   costs more than the overdraw it saves. g_mesh_coverage overrides the scene's choice.
+// - mesh_end_frame_gouraud: back to front with fillTriangleGouraud into an 8-bit buffer, e.g.
+//   g_screen_buffer, to go through the dithering like the other effects. Meshes with vertex
+//   normals get their lighting interpolated, others are flat shaded.
+// - mesh_end_frame_wireframe: outlines of the front facing triangles, with the batched lines.
+//
+// View space: camera at the origin looking down +z, x right, y up. Front faces are the ones
+// that are counter-clockwise as seen from the camera.
+
+typedef struct Mesh {
+	const float3* vertices;
+	int vertex_count;
+	const uint16_t* indices; // 3 per triangle
+	int triangle_count;
+	const float3* normals; // per vertex (unit length), or NULL
+} Mesh;
+
+// object to view space: view = rot * p + pos (rot given as rows)
+typedef struct MeshPose {
+	float3 rot[3];
+	float3 pos;
+} MeshPose;
+
+// rotation about y (yaw), then x (pitch), then z (roll)
+void mesh_pose_from_angles(MeshPose* pose, float yaw, float pitch, float roll, float3 pos);
+
+#define MESH_MAX_VERTICES (4096) // per mesh_submit
+#define MESH_MAX_TRIANGLES (8192) // per frame, after clipping
+#define MESH_SHADE_LEVELS (65) // 8x8 ordered dither patterns, 0 is black
+
+typedef enum {
+	kMeshCoverageOff, // always painter's order
+	kMeshCoveragePerScene, // as passed to mesh_end_frame
+	kMeshCoverageAlways,
+} MeshCoverageMode;
+
+extern int g_mesh_coverage; // MeshCoverageMode
+
+typedef struct MeshFrameStats {
+	int submitted; // triangles given to mesh_submit
+	int culled; // back facing, or fully behind the near plane
+	int drawn; // triangles filled, after clipping
+	int occluded; // drawn triangles that were fully hidden by the coverage buffer
+	int rasterized_pixels; // on screen pixels of the drawn triangles
+	int written_pixels; // pixels actually filled
+} MeshFrameStats;
+
+void mesh_init();
+// light_dir is in view space, towards the light; ambient is the shade of faces turned away from it
+void mesh_begin_frame(float3 light_dir, float ambient);
+void mesh_submit(const Mesh* mesh, const MeshPose* pose);
+void mesh_end_frame(uint8_t* bitmap, int rowstride, bool coverage, MeshFrameStats* stats);
+void mesh_end_frame_gouraud(uint8_t* buffer, int stride, MeshFrameStats* stats);
+void mesh_end_frame_wireframe(uint8_t* bitmap, int rowstride, int thick, const uint8_t pattern[8], MeshFrameStats* stats);
@@ -13,6 +13,24 @@
 #define SCREEN_Y 240
 #define SCREEN_X 400
 
+// Coverage buffer: per row, sorted [x0, x1) intervals that are already filled, never touching
+// each other. Rows of the mesh scenes end up with at most 8 of them; a row that runs out of
+// spans switches to a bit per pixel for the rest of the frame (COVERAGE_ROW_BITS count).
+#define COVERAGE_MAX_SPANS (16)
+#define COVERAGE_ROW_BITS (0xFF)
+#define COVERAGE_ROW_WORDS ((SCREEN_X + 31) / 32)
+
+typedef struct CoverageSpan {
+	int16_t x0, x1;
+} CoverageSpan;
+
+static CoverageSpan s_coverage_spans[SCREEN_Y][COVERAGE_MAX_SPANS];
+static uint8_t s_coverage_counts[SCREEN_Y];
+// pixel x is bit 31-(x%32) of word x/32, like the framebuffer words before swap()
+static uint32_t s_coverage_bits[SCREEN_Y][COVERAGE_ROW_WORDS];
+
+static FillStats s_fill_stats;
+
 static inline void
 _drawMaskPattern(uint32_t* p, uint32_t mask, uint32_t color)
 {
@@ -81,6 +99,138 @@ drawFragment(uint32_t* row, int x1, int x2, uint32_t color)
 	}
 }
 
+void coverageReset(void)
+{
+	memset(s_coverage_counts, 0, sizeof(s_coverage_counts));
+}
+
+void getFillStats(FillStats* stats)
+{
+	*stats = s_fill_stats;
+	memset(&s_fill_stats, 0, sizeof(s_fill_stats));
+}
+
+static inline int popcount32(uint32_t v)
+{
+	v = v - ((v >> 1) & 0x55555555);
+	v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+	return (int)((((v + (v >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+}
+
+// bits of pixels [x1, x2) within word col
+static inline uint32_t coverageBitsMask(int col, int x1, int x2)
+{
+	int b0 = MAX(x1 - col * 32, 0), b1 = MIN(x2 - col * 32, 32);
+	uint32_t mask = 0xffffffff >> b0;
+	if ( b1 < 32 )
+		mask &= ~(0xffffffff >> b1);
+	return mask;
+}
+
+// switches a row that has no span left to the bit per pixel coverage
+static void coverageRowToBits(int y)
+{
+	uint32_t* bits = s_coverage_bits[y];
+	memset(bits, 0, sizeof(s_coverage_bits[y]));
+	for ( int i = 0; i < s_coverage_counts[y]; ++i )
+	{
+		const CoverageSpan* span = &s_coverage_spans[y][i];
+		for ( int col = span->x0 / 32; col <= (span->x1 - 1) / 32; ++col )
+			bits[col] |= coverageBitsMask(col, span->x0, span->x1);
+	}
+	s_coverage_counts[y] = COVERAGE_ROW_BITS;
+}
+
+static int drawFragmentCoveredBits(uint32_t* row, int y, int x1, int x2, uint32_t color)
+{
+	uint32_t* bits = s_coverage_bits[y];
+	int written = 0;
+	for ( int col = x1 / 32; col <= (x2 - 1) / 32; ++col )
+	{
+		uint32_t fresh = coverageBitsMask(col, x1, x2) & ~bits[col];
+		if ( fresh == 0 )
+			continue;
+		bits[col] |= fresh;
+		_drawMaskPattern(row + col, swap(fresh), color);
+		written += popcount32(fresh);
+	}
+	return written;
+}
+
+// Fills the parts of [x1, x2) not covered on row y yet and adds it to the coverage; returns the
+// number of pixels written.
+static int drawFragmentCovered(uint32_t* row, int y, int x1, int x2, uint32_t color)
+{
+	if ( x1 < 0 )
+		x1 = 0;
+	
+	if ( x2 > SCREEN_X )
+		x2 = SCREEN_X;
+	
+	if ( x1 >= x2 )
+		return 0;
+	
+	if ( s_coverage_counts[y] == COVERAGE_MAX_SPANS )
+		coverageRowToBits(y);
+	if ( s_coverage_counts[y] == COVERAGE_ROW_BITS )
+		return drawFragmentCoveredBits(row, y, x1, x2, color);
+	
+	CoverageSpan* spans = s_coverage_spans[y];
+	int count = s_coverage_counts[y];
+	
+	// first span that ends at or after x1 (touching ones get merged too)
+	int lo = 0, hi = count;
+	while ( lo < hi )
+	{
+		int mid = (lo + hi) >> 1;
+		if ( spans[mid].x1 < x1 )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	// fully within one span: occluded
+	if ( lo < count && spans[lo].x0 <= x1 && spans[lo].x1 >= x2 )
+		return 0;
+	
+	int written = 0;
+	int x = x1;
+	int end = lo;
+	while ( end < count && spans[end].x0 <= x2 )
+	{
+		if ( spans[end].x0 > x )
+		{
+			drawFragment(row, x, spans[end].x0, color);
+			written += spans[end].x0 - x;
+		}
+		if ( spans[end].x1 > x )
+			x = spans[end].x1;
+		++end;
+	}
+	if ( x < x2 )
+	{
+		drawFragment(row, x, x2, color);
+		written += x2 - x;
+	}
+	
+	// spans lo..end-1 and the fragment become one
+	CoverageSpan merged = { (int16_t)x1, (int16_t)x2 };
+	if ( end > lo )
+	{
+		merged.x0 = MIN(merged.x0, spans[lo].x0);
+		merged.x1 = MAX(merged.x1, spans[end - 1].x1);
+	}
+	int removed = end - lo;
+	if ( removed != 1 )
+	{
+		memmove(&spans[lo + 1], &spans[end], (count - end) * sizeof(spans[0]));
+		count += 1 - removed;
+		s_coverage_counts[y] = (uint8_t)count;
+	}
+	spans[lo] = merged;
+	return written;
+}
+
 static inline int32_t slope(float x1, float y1, float x2, float y2)
 {
 	float dx = x2-x1;
@@ -141,7 +291,7 @@ void drawLine(uint8_t* bitmap, int rowstride, const float3* p1, const float3* p2
 	}
 }
 
-static void fillRange(uint8_t* bitmap, int rowstride, int y, int endy, int32_t* x1p, int32_t dx1, int32_t* x2p, int32_t dx2, const uint8_t pattern[8])
+static void fillRange(uint8_t* bitmap, int rowstride, int y, int endy, int32_t* x1p, int32_t dx1, int32_t* x2p, int32_t dx2, const uint8_t pattern[8], bool covered)
 {
 	int32_t x1 = *x1p, x2 = *x2p;
 	
@@ -165,7 +315,13 @@ static void fillRange(uint8_t* bitmap, int rowstride, int y, int endy, int32_t*
 		uint8_t p = pattern[y%8];
 		uint32_t color = (p<<24) | (p<<16) | (p<<8) | p;
 		
-		drawFragment((uint32_t*)&bitmap[y*rowstride], (x1>>16), (x2>>16)+1, color);
+		int fx1 = x1>>16, fx2 = (x2>>16)+1;
+		s_fill_stats.rasterized += MAX(0, MIN(fx2, SCREEN_X) - MAX(fx1, 0));
+		
+		if ( covered )
+			s_fill_stats.written += drawFragmentCovered((uint32_t*)&bitmap[y*rowstride], y, fx1, fx2, color);
+		else
+			drawFragment((uint32_t*)&bitmap[y*rowstride], fx1, fx2, color);
 		
 		x1 += dx1;
 		x2 += dx2;
@@ -218,7 +374,7 @@ static inline void sortTri(const float3** p1, const float3** p2, const float3**
 
 }
 
-void fillTriangle(uint8_t* bitmap, int rowstride, const float3* p1, const float3* p2, const float3* p3, const uint8_t pattern[8])
+static void fillTriangleImpl(uint8_t* bitmap, int rowstride, const float3* p1, const float3* p2, const float3* p3, const uint8_t pattern[8], bool covered)
 {
 	// sort by y coord
 	
@@ -238,18 +394,33 @@ void fillTriangle(uint8_t* bitmap, int rowstride, const float3* p1, const float3
 	int32_t dx1 = MIN(sb, sc);
 	int32_t dx2 = MAX(sb, sc);
 	
-	fillRange(bitmap, rowstride, (int)p1->y, MIN(SCREEN_Y, (int)p2->y), &x1, dx1, &x2, dx2, pattern);
+	fillRange(bitmap, rowstride, (int)p1->y, MIN(SCREEN_Y, (int)p2->y), &x1, dx1, &x2, dx2, pattern, covered);
 	
 	int dx = slope(p2->x, p2->y, p3->x, p3->y);
 	
 	if ( sb < sc )
 	{
 		x1 = (int32_t)(p2->x * (1<<16));
-		fillRange(bitmap, rowstride, (int)p2->y, endy, &x1, dx, &x2, dx2, pattern);
+		fillRange(bitmap, rowstride, (int)p2->y, endy, &x1, dx, &x2, dx2, pattern, covered);
 	}
 	else
 	{
 		x2 = (int32_t)(p2->x * (1<<16));
-		fillRange(bitmap, rowstride, (int)p2->y, endy, &x1, dx1, &x2, dx, pattern);
+		fillRange(bitmap, rowstride, (int)p2->y, endy, &x1, dx1, &x2, dx, pattern, covered);
 	}
 }
+
+void fillTriangle(uint8_t* bitmap, int rowstride, const float3* p1, const float3* p2, const float3* p3, const uint8_t pattern[8])
+{
+	uint32_t rasterized = s_fill_stats.rasterized;
+	fillTriangleImpl(bitmap, rowstride, p1, p2, p3, pattern, false);
+	s_fill_stats.written += s_fill_stats.rasterized - rasterized;
+}
+
+void fillTriangleCovered(uint8_t* bitmap, int rowstride, const float3* p1, const float3* p2, const float3* p3, const uint8_t pattern[8])
+{
+	uint32_t written = s_fill_stats.written;
+	fillTriangleImpl(bitmap, rowstride, p1, p2, p3, pattern, true);
+	if ( s_fill_stats.written == written )
+		s_fill_stats.occluded_triangles++;
+}
@@ -4,3 +4,17 @@
 
 void drawLine(uint8_t* bitmap, int rowstride, const float3* p1, const float3* p2, int thick, const uint8_t pattern[8]);
 void fillTriangle(uint8_t* bitmap, int rowstride, const float3* p1, const float3* p2, const float3* p3, const uint8_t pattern[8]);
+
+// Front to back filling: fillTriangleCovered only writes the pixels that no triangle drawn since
+// coverageReset has covered yet.
+void coverageReset(void);
+void fillTriangleCovered(uint8_t* bitmap, int rowstride, const float3* p1, const float3* p2, const float3* p3, const uint8_t pattern[8]);
+
+// pixel counts of fillTriangle/fillTriangleCovered since the previous call
+typedef struct FillStats {
+	uint32_t rasterized; // pixels within the triangles (on screen)
+	uint32_t written; // pixels actually filled
+	uint32_t occluded_triangles; // fillTriangleCovered calls that wrote nothing
+} FillStats;
+
+void getFillStats(FillStats* stats);
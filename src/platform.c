@@ -1,6 +1,8 @@
 // SPDX-License-Identifier: Unlicense
 
 #include "platform.h"
+#include "util/audio_analysis.h"
+#include <math.h>
 #include <stdarg.h>
 
 void app_initialize();
@@ -11,9 +13,6 @@ void app_update();
 
 #include "pd_api.h"
 
-static const char* kFontPath = "/System/Fonts/Roobert-10-Bold.pft";
-static LCDFont* s_font = NULL;
-
 static PlaydateAPI* s_pd;
 
 void* plat_malloc(size_t size)
@@ -42,16 +41,6 @@ void plat_gfx_mark_updated_rows(int start, int end)
 {
 	s_pd->graphics->markUpdatedRows(start, end);
 }
-void plat_gfx_draw_stats(float par1)
-{
-	s_pd->graphics->fillRect(0, 0, 40, 32, kColorWhite);
-	char* buf;
-	int bufLen = s_pd->system->formatString(&buf, "t %i", (int)par1);
-	s_pd->graphics->setFont(s_font);
-	s_pd->graphics->drawText(buf, bufLen, kASCIIEncoding, 0, 16);
-	plat_free(buf);
-	s_pd->system->drawFPS(0, 0);
-}
 
 PlatBitmap* plat_gfx_load_bitmap(const char* file_path, const char** outerr)
 {
@@ -80,6 +69,22 @@ void plat_file_close(PlatFile* file)
 	s_pd->file->close((SDFile*)file);
 }
 
+static void plat_sys_log_impl(const char* fmt, va_list args)
+{
+	char* buf;
+	s_pd->system->vaFormatString(&buf, fmt, args);
+	s_pd->system->logToConsole("%s", buf);
+	plat_free(buf);
+}
+
+void plat_sys_log(const char* fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	plat_sys_log_impl(fmt, args);
+	va_end(args);
+}
+
 static void plat_sys_log_error_impl(const char* fmt, va_list args)
 {
 	s_pd->system->error(fmt, args);
@@ -93,13 +98,57 @@ void plat_sys_log_error(const char* fmt, ...)
 	va_end(args);
 }
 
+#define PLAT_MENU_TOGGLE_COUNT (3) // the system menu has room for three items
+static PDMenuItem* s_menu_items[PLAT_MENU_TOGGLE_COUNT];
+static bool* s_menu_values[PLAT_MENU_TOGGLE_COUNT];
+static int s_menu_item_count;
+
+static void menu_toggle_changed(void* userdata)
+{
+	int index = (int)(intptr_t)userdata;
+	*s_menu_values[index] = s_pd->system->getMenuItemValue(s_menu_items[index]) != 0;
+}
+
+void plat_sys_add_menu_toggle(const char* title, bool* value)
+{
+	if (s_menu_item_count == PLAT_MENU_TOGGLE_COUNT)
+		return;
+	int index = s_menu_item_count++;
+	s_menu_values[index] = value;
+	s_menu_items[index] = s_pd->system->addCheckmarkMenuItem(title, *value ? 1 : 0, menu_toggle_changed, (void*)(intptr_t)index);
+}
+
+// the values may have been changed by other means since the menu was last open
+static void sync_menu_toggles()
+{
+	for (int i = 0; i < s_menu_item_count; ++i)
+		s_pd->system->setMenuItemValue(s_menu_items[i], *s_menu_values[i] ? 1 : 0);
+}
+
+// Pass-through effect on the main channel that feeds the mixed (mono) output to the analysis.
+static int audio_analysis_effect(SoundEffect* effect, int32_t* left, int32_t* right, int nsamples, int bufactive)
+{
+	if (bufactive)
+		audio_analysis_feed_q24(left, nsamples);
+	return bufactive;
+}
+
+static FilePlayer* s_current_music;
+
 PlatFileMusicPlayer* plat_audio_play_file(const char* file_path)
 {
 	FilePlayer* music = s_pd->sound->fileplayer->newPlayer();
 	bool s_music_ok = s_pd->sound->fileplayer->loadIntoPlayer(music, file_path) != 0;
 	if (s_music_ok)
 	{
+		static SoundEffect* s_analysis_effect;
+		if (s_analysis_effect == NULL)
+		{
+			s_analysis_effect = s_pd->sound->effect->newEffect(audio_analysis_effect, NULL);
+			s_pd->sound->channel->addEffect(s_pd->sound->getDefaultChannel(), s_analysis_effect);
+		}
 		s_pd->sound->fileplayer->play(music, 1);
+		s_current_music = music;
 		return (PlatFileMusicPlayer*)music;
 	}
 	return NULL;
@@ -120,6 +169,99 @@ void plat_audio_set_time(PlatFileMusicPlayer* music, float t)
 	s_pd->sound->fileplayer->setOffset((FilePlayer*)music, t);
 }
 
+// Voices are sampled synths on their own channel (so that the music analysis does not hear them),
+// started with the sound engine's sample accurate note scheduling.
+#define PLAT_VOICE_COUNT (16)
+static SoundChannel* s_voice_channel;
+static PDSynth* s_voice_synths[PLAT_VOICE_COUNT];
+static uint32_t s_voice_generation[PLAT_VOICE_COUNT];
+static uint32_t s_voice_start[PLAT_VOICE_COUNT]; // sound engine time of the scheduled start
+
+PlatSample* plat_audio_load_sample(const char* file_path)
+{
+	return (PlatSample*)s_pd->sound->sample->load(file_path);
+}
+
+static PDSynth* voice_synth(PlatVoice voice)
+{
+	int slot = (int)(voice & 0xFF) - 1;
+	if (slot < 0 || slot >= PLAT_VOICE_COUNT || s_voice_generation[slot] != voice >> 8)
+		return NULL;
+	return s_voice_synths[slot];
+}
+
+static void voice_volume(PDSynth* synth, float gain, float pan)
+{
+	float a = (pan < -1.0f ? -1.0f : pan > 1.0f ? 1.0f : pan) + 1.0f;
+	a *= 3.14159265358979323846f * 0.25f;
+	s_pd->sound->source->setVolume((SoundSource*)synth, gain * cosf(a), gain * sinf(a));
+}
+
+PlatVoice plat_audio_play_sample(PlatSample* sample, float gain, float pan, float start_time)
+{
+	if (s_voice_channel == NULL)
+	{
+		s_voice_channel = s_pd->sound->channel->newChannel();
+		s_pd->sound->addChannel(s_voice_channel);
+	}
+	uint32_t now = s_pd->sound->getCurrentTime();
+	int slot = 0;
+	for (; slot < PLAT_VOICE_COUNT; ++slot)
+	{
+		PDSynth* synth = s_voice_synths[slot];
+		if (synth == NULL || (!s_pd->sound->source->isPlaying((SoundSource*)synth) && (int32_t)(now - s_voice_start[slot]) >= 0))
+			break;
+	}
+	if (slot == PLAT_VOICE_COUNT)
+		return 0;
+	if (s_voice_synths[slot] == NULL)
+	{
+		s_voice_synths[slot] = s_pd->sound->synth->newSynth();
+		s_pd->sound->channel->addSource(s_voice_channel, (SoundSource*)s_voice_synths[slot]);
+	}
+	PDSynth* synth = s_voice_synths[slot];
+
+	uint32_t when = now;
+	if (s_current_music != NULL)
+	{
+		float ahead = start_time - s_pd->sound->fileplayer->getOffset(s_current_music);
+		if (ahead > 0.0f)
+			when += (uint32_t)(ahead * 44100.0f);
+	}
+	s_voice_start[slot] = when;
+	s_pd->sound->synth->setSample(synth, (AudioSample*)sample, 0, 0);
+	voice_volume(synth, gain, pan);
+	// a sampled synth plays the sample at its recorded rate for C4; no sustain loop, so it ends
+	// with the sample
+	s_pd->sound->synth->playMIDINote(synth, NOTE_C4, 1.0f, -1.0f, when);
+	s_voice_generation[slot] = (s_voice_generation[slot] + 1) & 0xFFFFFF;
+	return (s_voice_generation[slot] << 8) | (uint32_t)(slot + 1);
+}
+
+void plat_audio_set_voice(PlatVoice voice, float gain, float pan)
+{
+	PDSynth* synth = voice_synth(voice);
+	if (synth != NULL)
+		voice_volume(synth, gain, pan);
+}
+
+void plat_audio_stop_voice(PlatVoice voice)
+{
+	PDSynth* synth = voice_synth(voice);
+	if (synth != NULL)
+		s_pd->sound->synth->stop(synth);
+}
+
+bool plat_audio_is_voice_playing(PlatVoice voice)
+{
+	int slot = (int)(voice & 0xFF) - 1;
+	PDSynth* synth = voice_synth(voice);
+	if (synth == NULL)
+		return false;
+	// scheduled but not started yet counts as playing
+	return s_pd->sound->source->isPlaying((SoundSource*)synth) || (int32_t)(s_pd->sound->getCurrentTime() - s_voice_start[slot]) < 0;
+}
+
 float plat_time_get()
 {
 	return s_pd->system->getElapsedTime();
@@ -160,16 +302,15 @@ int eventHandler(PlaydateAPI* pd, PDSystemEvent event, uint32_t arg)
 	if (event == kEventInit)
 	{
 		s_pd = pd;
-
-		const char* err;
-		s_font = pd->graphics->loadFont(kFontPath, &err);
-		if (s_font == NULL)
-			pd->system->error("Could not load font %s: %s", kFontPath, err);
-
 		app_initialize();
 		pd->system->resetElapsedTime();
 		pd->system->setUpdateCallback(eventUpdate, pd);
 	}
+	else if (event == kEventPause)
+	{
+		// the system menu is about to show
+		sync_menu_toggles();
+	}
 	return 0;
 }
 
@@ -197,6 +338,10 @@ int eventHandler(PlaydateAPI* pd, PDSystemEvent event, uint32_t arg)
 #define STBI_ONLY_PNG
 #include "external/stb/stb_image.h"
 
+#include "util/audio_clock.h"
+#include "util/audio_mixer.h"
+#include "util/audio_telemetry.h"
+#include "util/perf_stats.h"
 #include "util/wav_ima_adpcm.h"
 
 #include <stdio.h>
@@ -247,6 +392,7 @@ static inline void put_pixel_white(uint8_t* row, int x)
 	row[x >> 3] |= mask;
 }
 
+#if defined(__EMSCRIPTEN__)
 // from fpsunflower/nanofont https://gist.github.com/fpsunflower/7e6311c9580409c115a0
 //
 // Glyphs from http://font.gohu.org/ (8x14 version, most common ascii characters only)
@@ -306,24 +452,7 @@ static void draw_text(const char* msg, int bx, int by)
 		++msg;
 	}
 }
-
-void plat_gfx_draw_stats(float par1)
-{
-	// clear rect to white
-	int rectx = 48;
-	int recty = 16;
-	for (int y = 0; y < recty; ++y)
-	{
-		uint8_t* row = s_screen_buffer + y * SCREEN_STRIDE_BYTES;
-		for (int x = 0; x < rectx / 8; ++x)
-			row[x] = 0xFF;
-	}
-
-	// draw text
-	char buf[100];
-	snprintf(buf, sizeof(buf), "t %i", (int)par1);
-	draw_text(buf, 1, 1);
-}
+#endif // #if defined(__EMSCRIPTEN__)
 
 static char s_data_path[1000];
 
@@ -392,6 +521,21 @@ void plat_file_close(PlatFile* file)
 	fclose((FILE*)file);
 }
 
+static void plat_sys_log_impl(const char* fmt, va_list args)
+{
+	char buf[1000];
+	vsnprintf(buf, sizeof(buf), fmt, args);
+	slog_func("demo", 3, 0, buf, 0, "", NULL);
+}
+
+void plat_sys_log(const char* fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	plat_sys_log_impl(fmt, args);
+	va_end(args);
+}
+
 static void plat_sys_log_error_impl(const char* fmt, va_list args)
 {
 	char buf[1000];
@@ -407,6 +551,10 @@ void plat_sys_log_error(const char* fmt, ...)
 	va_end(args);
 }
 
+void plat_sys_add_menu_toggle(const char* title, bool* value)
+{
+}
+
 typedef struct PlatFileMusicPlayer {
 	uint8_t* file;
 	int file_size;
@@ -417,11 +565,9 @@ typedef struct PlatFileMusicPlayer {
 
 static PlatFileMusicPlayer* s_current_music;
 
-PlatFileMusicPlayer* plat_audio_play_file(const char* file_path)
+// reads the .wav file that stands in for a Playdate audio file (.pda) into memory
+static uint8_t* read_wav_file(const char* file_path, int* size)
 {
-	s_current_music = NULL;
-
-	// read file into memory
 	char path[1000];
 	snprintf(path, sizeof(path), "%s/%s", s_data_path, file_path);
 	size_t path_len = strlen(path);
@@ -432,15 +578,28 @@ PlatFileMusicPlayer* plat_audio_play_file(const char* file_path)
 	FILE* file = fopen(path, "rb");
 	if (file == NULL)
 		return NULL;
-
-	PlatFileMusicPlayer* res = (PlatFileMusicPlayer*)plat_malloc(sizeof(PlatFileMusicPlayer));
-	res->decode_pos = 0;
 	fseek(file, 0, SEEK_END);
-	res->file_size = (int)ftell(file);
+	*size = (int)ftell(file);
 	fseek(file, 0, SEEK_SET);
-	res->file = plat_malloc(res->file_size);
-	fread(res->file, 1, res->file_size, file);
+	uint8_t* res = plat_malloc(*size);
+	fread(res, 1, *size, file);
 	fclose(file);
+	return res;
+}
+
+PlatFileMusicPlayer* plat_audio_play_file(const char* file_path)
+{
+	s_current_music = NULL;
+
+	int file_size;
+	uint8_t* file = read_wav_file(file_path, &file_size);
+	if (file == NULL)
+		return NULL;
+
+	PlatFileMusicPlayer* res = (PlatFileMusicPlayer*)plat_malloc(sizeof(PlatFileMusicPlayer));
+	res->decode_pos = 0;
+	res->file_size = file_size;
+	res->file = file;
 
 	// parse wav header
 	if (!wav_parse_header(res->file, res->file_size, &res->wav))
@@ -450,6 +609,8 @@ PlatFileMusicPlayer* plat_audio_play_file(const char* file_path)
 		return NULL;
 
 	wav_decode_state_init(&res->wav, &res->decode_state);
+	audio_clock_init(res->wav.sample_rate);
+	audio_clock_seek(0);
 
 	s_current_music = res;
 	return res;
@@ -462,17 +623,64 @@ bool plat_audio_is_playing(PlatFileMusicPlayer* music)
 
 float plat_audio_get_time(PlatFileMusicPlayer* music)
 {
-	return music->decode_pos / 44100.0f;
+	// the chunk that a callback fills starts playing after the buffer that is queued before it
+	double latency = (double)saudio_buffer_frames() / saudio_sample_rate();
+	return audio_clock_get(stm_sec(stm_now()), latency);
 }
 
 void plat_audio_set_time(PlatFileMusicPlayer* music, float t)
 {
-	int sample_pos = (int)(t * 44100.0f);
+	int sample_pos = (int)(t * music->wav.sample_rate);
 	if (sample_pos < 0)
 		sample_pos = 0;
 	if (sample_pos > music->wav.sample_count)
 		sample_pos = music->wav.sample_count;
-	music->decode_pos = sample_pos;
+	// applied by the next audio callback
+	audio_clock_seek(sample_pos);
+}
+
+typedef struct PlatSample {
+	uint8_t* file;
+	MixerSound sound;
+} PlatSample;
+
+PlatSample* plat_audio_load_sample(const char* file_path)
+{
+	int file_size;
+	uint8_t* file = read_wav_file(file_path, &file_size);
+	if (file == NULL)
+		return NULL;
+	PlatSample* res = (PlatSample*)plat_malloc(sizeof(PlatSample));
+	res->file = file;
+	if (!mixer_sound_from_wav(file, file_size, &res->sound))
+	{
+		plat_free(file);
+		plat_free(res);
+		return NULL;
+	}
+	return res;
+}
+
+PlatVoice plat_audio_play_sample(PlatSample* sample, float gain, float pan, float start_time)
+{
+	// mixer positions are music samples (44.1kHz)
+	int64_t start_pos = start_time < 0.0f ? -1 : (int64_t)((double)start_time * 44100.0);
+	return mixer_play(&sample->sound, gain, pan, start_pos);
+}
+
+void plat_audio_set_voice(PlatVoice voice, float gain, float pan)
+{
+	mixer_set(voice, gain, pan);
+}
+
+void plat_audio_stop_voice(PlatVoice voice)
+{
+	mixer_stop(voice);
+}
+
+bool plat_audio_is_voice_playing(PlatVoice voice)
+{
+	return mixer_is_playing(voice);
 }
 
 static uint64_t sok_start_time;
@@ -505,30 +713,84 @@ float plat_input_get_crank_angle_rad()
 
 // sokol_app setup
 
+static float s_music_chunk[MIXER_CHUNK_FRAMES];
+static int64_t s_stream_pos; // voice timeline while no music plays
+
+// Music decoded in chunks, mixed to the center of the stereo output with the voices on top.
 static void audio_sample_cb(float* buffer, int num_frames, int num_channels)
 {
-	if (s_current_music == NULL)
+	assert(2 == num_channels);
+	memset(buffer, 0, num_frames * num_channels * sizeof(buffer[0]));
+
+	double now = stm_sec(stm_now());
+	double decode_seconds = 0.0;
+	PlatFileMusicPlayer* music = s_current_music;
+	int music_start = 0;
+	if (music != NULL)
 	{
-		memset(buffer, 0, num_frames * num_channels * sizeof(buffer[0]));
-		return;
+		music->decode_pos = audio_clock_callback_pos(music->decode_pos);
+		music_start = music->decode_pos;
+		s_stream_pos = music_start;
 	}
 
-	assert(1 == num_channels);
+	for (int done = 0; done < num_frames; done += MIXER_CHUNK_FRAMES)
+	{
+		int frames = num_frames - done;
+		if (frames > MIXER_CHUNK_FRAMES)
+			frames = MIXER_CHUNK_FRAMES;
+		float* out = buffer + done * 2;
+		if (music != NULL)
+		{
+			int decode_frames = frames;
+			if (decode_frames > music->wav.sample_count - music->decode_pos)
+				decode_frames = music->wav.sample_count - music->decode_pos;
+			if (decode_frames < 0)
+				decode_frames = 0;
+			uint64_t decode_start = stm_now();
+			wav_ima_adpcm_decode(s_music_chunk, music->decode_pos, decode_frames, music->wav.sample_data, &music->decode_state);
+			decode_seconds += stm_sec(stm_since(decode_start));
+			memset(s_music_chunk + decode_frames, 0, (frames - decode_frames) * sizeof(s_music_chunk[0]));
+			music->decode_pos += decode_frames;
+			audio_analysis_feed(s_music_chunk, frames);
+			mixer_add_mono(out, s_music_chunk, frames, 1.0f);
+		}
+#if !BENCHMARK_MODE // the benchmark runs the mixer on the main thread
+		mixer_render(out, frames, s_stream_pos + done);
+#endif
+	}
+	mixer_soft_clip(buffer, num_frames * 2);
 
-	int decode_frames = num_frames;
-	if (decode_frames > s_current_music->wav.sample_count - s_current_music->decode_pos)
-		decode_frames = s_current_music->wav.sample_count - s_current_music->decode_pos;
-	if (decode_frames < 0)
-		decode_frames = 0;
+	if (music != NULL)
+		audio_clock_callback_done(music_start, music->decode_pos - music_start, now);
+	s_stream_pos += num_frames;
+	audio_telemetry_callback(now, stm_sec(stm_now()), decode_seconds, num_frames, saudio_sample_rate(), saudio_buffer_frames());
+}
 
-	wav_ima_adpcm_decode(buffer, s_current_music->decode_pos, decode_frames, s_current_music->wav.sample_data, &s_current_music->decode_state);
+static void audio_setup(int buffer_frames)
+{
+	saudio_setup(&(saudio_desc) {
+		.sample_rate = 44100,
+		.num_channels = 2,
+		.buffer_frames = buffer_frames,
+		.stream_cb = audio_sample_cb,
+		.logger.func = slog_func,
+	});
+}
 
-	if (decode_frames < num_frames)
-	{
-		memset(buffer + decode_frames * num_channels, 0, (num_frames - decode_frames) * num_channels * sizeof(buffer[0]));
-	}
-	s_current_music->decode_pos += decode_frames;
+#if AUDIO_ADAPTIVE_BUFFER
+// restarts the stream with a larger buffer after underruns
+static void adapt_audio_buffer()
+{
+	int buffer_frames = saudio_buffer_frames();
+	int new_frames = audio_telemetry_adapt_buffer(buffer_frames);
+	if (new_frames == buffer_frames)
+		return;
+	plat_sys_log("audio: underruns, growing the buffer from %i to %i frames", buffer_frames, new_frames);
+	saudio_shutdown();
+	audio_telemetry_restart();
+	audio_setup(new_frames);
 }
+#endif
 
 static const char* kSokolVertexSource =
 #if defined(SOKOL_METAL) || defined(SOKOL_D3D11)
@@ -674,23 +936,22 @@ static void sapp_init(void)
 		.cull_mode = SG_CULLMODE_NONE,
 	});
 
-	// audio
-	saudio_setup(&(saudio_desc) {
-		.sample_rate = 44100,
-		.num_channels = 1,
-		.stream_cb = audio_sample_cb,
-		.logger.func = slog_func,
-	});
-
+	// the audio callback reads the timer from its first call on
 	stm_setup();
 	sok_start_time = stm_now();
 
+	// audio
+	audio_setup(0); // default buffer size
+
 	app_initialize();
 }
 
 static void sapp_frame(void)
 {
 	app_update();
+#if AUDIO_ADAPTIVE_BUFFER
+	adapt_audio_buffer();
+#endif
 
 	#if defined(__EMSCRIPTEN__)
 	if (saudio_suspended()) {
@@ -733,6 +994,7 @@ static void sapp_frame(void)
 static void sapp_cleanup(void)
 {
 	saudio_shutdown();
+	audio_telemetry_log("audio");
 	sg_shutdown();
 }
 
@@ -28,11 +28,12 @@ typedef enum // match order of PDButtons
 typedef struct PlatBitmap PlatBitmap;
 typedef struct PlatFile PlatFile;
 typedef struct PlatFileMusicPlayer PlatFileMusicPlayer;
+typedef struct PlatSample PlatSample;
+typedef uint32_t PlatVoice; // 0 is no voice
 
 void plat_gfx_clear(SolidColor color);
 uint8_t* plat_gfx_get_frame();
 void plat_gfx_mark_updated_rows(int start, int end);
-void plat_gfx_draw_stats(float par1);
 
 PlatBitmap* plat_gfx_load_bitmap(const char* file_path, const char** outerr);
 void plat_gfx_draw_bitmap(PlatBitmap* bitmap, int x, int y);
@@ -47,6 +48,16 @@ bool plat_audio_is_playing(PlatFileMusicPlayer* music);
 float plat_audio_get_time(PlatFileMusicPlayer* music);
 void plat_audio_set_time(PlatFileMusicPlayer* music, float t);
 
+// One-shot sounds on top of the music. start_time is the music time (plat_audio_get_time) to start
+// at, sample accurate; a time that has passed (e.g. -1) starts right away. pan is -1..1.
+// Up to 16 voices play at once on Playdate (sound engine synths), 32 on PC (MIXER_VOICE_COUNT);
+// plat_audio_play_sample returns 0 when all of them are busy.
+PlatSample* plat_audio_load_sample(const char* file_path);
+PlatVoice plat_audio_play_sample(PlatSample* sample, float gain, float pan, float start_time);
+void plat_audio_set_voice(PlatVoice voice, float gain, float pan);
+void plat_audio_stop_voice(PlatVoice voice);
+bool plat_audio_is_voice_playing(PlatVoice voice);
+
 float plat_time_get();
 void plat_time_reset();
 
@@ -54,7 +65,11 @@ void plat_input_get_buttons(PlatButtons* current, PlatButtons* pushed, PlatButto
 float plat_input_get_crank_angle_rad();
 
 
+void plat_sys_log(const char* fmt, ...);
 void plat_sys_log_error(const char* fmt, ...);
+// Playdate: a checkmark item in the system menu that shows and sets *value (it is synced from
+// *value whenever the menu opens). Other platforms have no such menu, and ignore it.
+void plat_sys_add_menu_toggle(const char* title, bool* value);
 
 void* plat_malloc(size_t size);
 void* plat_realloc(void* ptr, size_t size);
@@ -0,0 +1,272 @@
+// SPDX-License-Identifier: Unlicense
+
+#include "audio_analysis.h"
+
+#include "../mathlib.h"
+#include "../platform.h"
+#include "seqlock.h"
+#include "perf_stats.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+// Band edges in FFT bins (172Hz each at 44.1kHz): octaves from 172Hz up. The bass band also takes
+// bin 0: the 5.8ms window holds less than a cycle of a kick drum, so most of the energy below
+// 172Hz lands there (the music has no DC offset to speak of).
+static const int kBandBins[AUDIO_BAND_COUNT + 1] = { 0, 2, 3, 5, 9, 17, 33, 65, 129 };
+
+// Band values map log2 of the band power linearly to 0..1: a full scale sine (after the Hann
+// window and the 1/N scaling of the FFT) has a power of 2^26, and 60dB below that is zero.
+#define LOG_POWER_FLOOR (6.0f)
+#define LOG_POWER_RANGE (20.0f)
+// envelope release per FFT frame (0..1 in about 0.25s)
+#define BAND_RELEASE (0.025f)
+// onsets: flux above its running average by a factor and a margin, at most one per ~70ms
+#define FLUX_AVERAGE_RATE (1.0f / 32.0f)
+#define ONSET_FLUX_FACTOR (1.5f)
+#define ONSET_FLUX_MARGIN (0.2f)
+#define ONSET_HOLD_FRAMES (12)
+
+typedef struct Complex16 {
+	int16_t re, im;
+} Complex16;
+
+static int16_t s_window[AUDIO_FFT_SIZE]; // Q15 Hann window
+static Complex16 s_twiddles[AUDIO_FFT_SIZE]; // Q15 exp(-2 pi i k / N)
+static uint8_t s_digit_reverse[AUDIO_FFT_SIZE]; // base 4 digit reversal of the index
+
+// audio thread state
+static int16_t s_input[AUDIO_FFT_SIZE];
+static int s_input_count;
+static int32_t s_re[AUDIO_FFT_SIZE], s_im[AUDIO_FFT_SIZE];
+static float s_flux_average;
+static int s_onset_hold;
+static AudioAnalysis s_state;
+static atomic_bool s_reset_requested;
+
+// published results
+static AudioAnalysis s_published;
+static Seqlock s_lock;
+
+void audio_analysis_init()
+{
+	int digits = 0;
+	while ((1 << (digits * 2)) < AUDIO_FFT_SIZE)
+		digits++;
+	for (int i = 0; i < AUDIO_FFT_SIZE; ++i)
+	{
+		float a = 2.0f * M_PIf * i / AUDIO_FFT_SIZE;
+		s_window[i] = (int16_t)((0.5f - 0.5f * cosf(a)) * 32767.0f);
+		s_twiddles[i].re = (int16_t)(cosf(a) * 32767.0f);
+		s_twiddles[i].im = (int16_t)(-sinf(a) * 32767.0f);
+		int r = 0;
+		for (int d = 0; d < digits; ++d)
+			r |= ((i >> (d * 2)) & 3) << ((digits - 1 - d) * 2);
+		s_digit_reverse[i] = (uint8_t)r;
+	}
+	audio_analysis_reset();
+}
+
+void audio_analysis_reset()
+{
+	atomic_store(&s_reset_requested, true);
+}
+
+static void reset_state()
+{
+	s_input_count = 0;
+	s_flux_average = 0.0f;
+	s_onset_hold = 0;
+	memset(s_state.bands, 0, sizeof(s_state.bands));
+	s_state.level = 0.0f;
+}
+
+// (re + i im) * twiddle k, Q15
+static inline void twiddle_mul(int32_t* re, int32_t* im, int k)
+{
+	Complex16 w = s_twiddles[k];
+	int32_t r = *re, i = *im;
+	*re = ((r * w.re) >> 15) - ((i * w.im) >> 15);
+	*im = ((r * w.im) >> 15) + ((i * w.re) >> 15);
+}
+
+// In place radix-4 decimation in time over digit reversed input. Every butterfly divides by 4,
+// so the result is the DFT / N and never exceeds the input magnitude (Q15 in, Q15 out).
+static void fft_radix4(int32_t* re, int32_t* im)
+{
+	for (int len = 4, tw_step = AUDIO_FFT_SIZE / 4; len <= AUDIO_FFT_SIZE; len *= 4, tw_step /= 4)
+	{
+		int q = len / 4;
+		for (int base = 0; base < AUDIO_FFT_SIZE; base += len)
+		{
+			for (int j = 0; j < q; ++j)
+			{
+				int i0 = base + j, i1 = i0 + q, i2 = i1 + q, i3 = i2 + q;
+				int32_t r0 = re[i0], m0 = im[i0];
+				int32_t r1 = re[i1], m1 = im[i1];
+				int32_t r2 = re[i2], m2 = im[i2];
+				int32_t r3 = re[i3], m3 = im[i3];
+				if (j != 0)
+				{
+					twiddle_mul(&r1, &m1, j * tw_step);
+					twiddle_mul(&r2, &m2, j * tw_step * 2);
+					twiddle_mul(&r3, &m3, j * tw_step * 3);
+				}
+				int32_t br0 = r0 + r2, bm0 = m0 + m2;
+				int32_t br1 = r0 - r2, bm1 = m0 - m2;
+				int32_t br2 = r1 + r3, bm2 = m1 + m3;
+				int32_t br3 = r1 - r3, bm3 = m1 - m3;
+				re[i0] = (br0 + br2) >> 2; im[i0] = (bm0 + bm2) >> 2;
+				re[i2] = (br0 - br2) >> 2; im[i2] = (bm0 - bm2) >> 2;
+				// X1 = b1 - i b3, X3 = b1 + i b3
+				re[i1] = (br1 + bm3) >> 2; im[i1] = (bm1 - br3) >> 2;
+				re[i3] = (br1 - bm3) >> 2; im[i3] = (bm1 + br3) >> 2;
+			}
+		}
+	}
+}
+
+static inline float log_power_to_unit(uint64_t power)
+{
+	float v = (log2f((float)power + 1.0f) - LOG_POWER_FLOOR) * (1.0f / LOG_POWER_RANGE);
+	return MIN(MAX(v, 0.0f), 1.0f);
+}
+
+static void publish()
+{
+	seqlock_publish(&s_lock, &s_published, &s_state, sizeof(s_state));
+}
+
+static void analyze_frame()
+{
+	for (int i = 0; i < AUDIO_FFT_SIZE; ++i)
+	{
+		int j = s_digit_reverse[i];
+		s_re[j] = (s_input[i] * s_window[i]) >> 15;
+		s_im[j] = 0;
+	}
+	fft_radix4(s_re, s_im);
+
+	uint64_t total = 0;
+	float flux = 0.0f;
+	for (int b = 0; b < AUDIO_BAND_COUNT; ++b)
+	{
+		uint64_t power = 0;
+		for (int k = kBandBins[b]; k < kBandBins[b + 1]; ++k)
+			power += (uint32_t)(s_re[k] * s_re[k]) + (uint32_t)(s_im[k] * s_im[k]);
+		total += power;
+		// flux against the envelope, so that the frame to frame noise of a decaying sound does
+		// not count as new onsets
+		float v = log_power_to_unit(power);
+		flux += MAX(v - s_state.bands[b], 0.0f);
+		s_state.bands[b] = MAX(v, s_state.bands[b] - BAND_RELEASE);
+	}
+	s_state.level = MAX(log_power_to_unit(total), s_state.level - BAND_RELEASE);
+
+	if (s_onset_hold > 0)
+		s_onset_hold--;
+	if (s_onset_hold == 0 && flux > s_flux_average * ONSET_FLUX_FACTOR + ONSET_FLUX_MARGIN)
+	{
+		s_state.onset_count++;
+		s_state.onset_strength = flux;
+		s_onset_hold = ONSET_HOLD_FRAMES;
+	}
+	s_flux_average += (flux - s_flux_average) * FLUX_AVERAGE_RATE;
+	s_state.frame_count++;
+	publish();
+}
+
+static inline void feed_sample(int16_t v)
+{
+	s_input[s_input_count++] = v;
+	if (s_input_count == AUDIO_FFT_SIZE)
+	{
+		analyze_frame();
+		s_input_count = 0;
+	}
+}
+
+void audio_analysis_feed(const float* samples, int count)
+{
+	if (atomic_exchange(&s_reset_requested, false))
+		reset_state();
+	for (int i = 0; i < count; ++i)
+	{
+		float v = MIN(MAX(samples[i], -1.0f), 1.0f);
+		feed_sample((int16_t)(v * 32767.0f));
+	}
+}
+
+void audio_analysis_feed_q24(const int32_t* samples, int count)
+{
+	if (atomic_exchange(&s_reset_requested, false))
+		reset_state();
+	for (int i = 0; i < count; ++i)
+	{
+		int32_t v = samples[i] >> 9;
+		feed_sample((int16_t)MIN(MAX(v, -32768), 32767));
+	}
+}
+
+void audio_analysis_read(AudioAnalysis* res)
+{
+	seqlock_read(&s_lock, res, &s_published, sizeof(*res));
+}
+
+#if BENCHMARK_MODE
+
+#define REPORT_SAMPLE_RATE (44100)
+#define REPORT_SECONDS (20)
+#define REPORT_CHUNK (512)
+
+// Sample i of the report signal: a two note pad, a kick (decaying 120..50Hz sweep) every half
+// second and a noise snare in between, every other beat.
+static float report_signal(int i, uint32_t* rng)
+{
+	float t = (float)i / REPORT_SAMPLE_RATE;
+	float v = 0.15f * sinf(2.0f * M_PIf * 220.0f * t) + 0.1f * sinf(2.0f * M_PIf * 330.0f * t);
+	float beat_t = fmodf(t, 0.5f);
+	float kick_f = 50.0f + 70.0f * expf(-beat_t * 30.0f);
+	v += 0.6f * expf(-beat_t * 12.0f) * sinf(2.0f * M_PIf * kick_f * beat_t);
+	float snare_t = fmodf(t + 0.25f, 1.0f);
+	v += 0.4f * expf(-snare_t * 25.0f) * (RandomFloat01(rng) * 2.0f - 1.0f);
+	return v;
+}
+
+void audio_analysis_report()
+{
+	reset_state();
+	AudioAnalysis before;
+	audio_analysis_read(&before);
+
+	float chunk[REPORT_CHUNK];
+	uint32_t rng = 1;
+	float seconds = 0.0f;
+	for (int i = 0; i < REPORT_SAMPLE_RATE * REPORT_SECONDS; i += REPORT_CHUNK)
+	{
+		int count = MIN(REPORT_CHUNK, REPORT_SAMPLE_RATE * REPORT_SECONDS - i);
+		for (int j = 0; j < count; ++j)
+			chunk[j] = report_signal(i + j, &rng);
+		float t0 = plat_time_get();
+		audio_analysis_feed(chunk, count);
+		seconds += plat_time_get() - t0;
+	}
+	AudioAnalysis after;
+	audio_analysis_read(&after);
+
+	int frames = (int)(after.frame_count - before.frame_count);
+	int hits = REPORT_SECONDS * 3;
+	float ms_per_second = seconds * 1000.0f / REPORT_SECONDS;
+	plat_sys_log("audio analysis: %.1f us per %i sample FFT frame, %.2f ms per second of audio (%.2f%% of a core); %i onsets for %i drum hits",
+		seconds * 1.0e6f / MAX(frames, 1), AUDIO_FFT_SIZE, ms_per_second, ms_per_second * 0.1f,
+		(int)(after.onset_count - before.onset_count), hits);
+	audio_analysis_reset();
+}
+
+#else
+
+void audio_analysis_report()
+{
+}
+
+#endif
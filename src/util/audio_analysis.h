@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: Unlicense
+
+#pragma once
+
+#include <stdint.h>
+#include "../globals.h"
+
+// Spectrum analysis of the music as it is played. The audio thread feeds the decoded samples;
+// every AUDIO_FFT_SIZE samples (no overlap, 5.8ms at 44.1kHz) get a Hann window and a fixed point
+// radix-4 FFT, and the spectrum is reduced to AUDIO_BAND_COUNT octave bands plus an onset detector
+// (spectral flux of the bands against its running average). The work per sample is fixed, so the
+// cost is bounded by the sample rate; audio_analysis_report() measures it.
+//
+// Results are published after every FFT through a sequence counter, and read without locking
+// from the main thread (a read that overlaps a publish is retried).
+
+#define AUDIO_FFT_SIZE (256)
+
+typedef struct AudioAnalysis {
+	float bands[AUDIO_BAND_COUNT]; // 0..1 log energy, fast attack and slow release; band 0 is bass
+	float level; // 0..1, same for the whole spectrum
+	float onset_strength; // spectral flux of the latest onset
+	uint32_t onset_count; // number of onsets detected so far
+	uint32_t frame_count; // number of FFT frames analyzed so far
+} AudioAnalysis;
+
+void audio_analysis_init();
+// forget the history (e.g. when seeking)
+void audio_analysis_reset();
+
+// audio thread: mono samples, -1..1 floats or Q8.24 integers
+void audio_analysis_feed(const float* samples, int count);
+void audio_analysis_feed_q24(const int32_t* samples, int count);
+
+// main thread: latest published results
+void audio_analysis_read(AudioAnalysis* res);
+
+// Benchmark mode: logs the analysis cost per second of audio (on synthetic drums over a tone),
+// and how many of the drum hits were detected as onsets.
+void audio_analysis_report();
@@ -0,0 +1,241 @@
+// SPDX-License-Identifier: Unlicense
+
+#include "audio_clock.h"
+
+#include "../mathlib.h"
+#include "../platform.h"
+#include "perf_stats.h"
+#include "seqlock.h"
+
+#include <stdatomic.h>
+
+// offset smoothing per callback, and how far off a callback has to be to snap to it instead
+#define OFFSET_SMOOTHING (0.1)
+#define OFFSET_SNAP_SECONDS (0.05)
+
+typedef struct ClockAnchor {
+	double time; // timer seconds when the callback started
+	int pos; // decode position at that time
+	int count; // samples decoded by the callback
+	unsigned seek_gen; // seeks applied before this callback
+	bool valid;
+} ClockAnchor;
+
+static int s_sample_rate = 44100;
+
+// seek requests: position, then generation
+static atomic_int s_seek_pos;
+static atomic_uint s_seek_gen;
+static unsigned s_applied_seek_gen; // audio thread
+
+// latest callback
+static ClockAnchor s_anchor;
+static Seqlock s_anchor_lock;
+
+// main thread
+static bool s_clock_valid;
+static unsigned s_clock_seek_gen;
+static double s_clock_anchor_time;
+static double s_clock_offset;
+static float s_clock_last;
+static double s_seek_target;
+static bool s_seek_jump; // the next time may go backwards
+
+void audio_clock_init(int sample_rate)
+{
+	s_sample_rate = sample_rate;
+}
+
+void audio_clock_seek(int sample_pos)
+{
+	atomic_store_explicit(&s_seek_pos, sample_pos, memory_order_relaxed);
+	atomic_fetch_add_explicit(&s_seek_gen, 1, memory_order_release);
+	s_seek_target = (double)sample_pos / s_sample_rate;
+	s_seek_jump = true;
+}
+
+int audio_clock_callback_pos(int sample_pos)
+{
+	unsigned gen = atomic_load_explicit(&s_seek_gen, memory_order_acquire);
+	if (gen != s_applied_seek_gen)
+	{
+		// a seek that lands in between the two loads is applied again on the next callback
+		sample_pos = atomic_load_explicit(&s_seek_pos, memory_order_relaxed);
+		s_applied_seek_gen = gen;
+	}
+	return sample_pos;
+}
+
+void audio_clock_callback_done(int sample_pos, int count, double now)
+{
+	ClockAnchor anchor = { now, sample_pos, count, s_applied_seek_gen, true };
+	seqlock_publish(&s_anchor_lock, &s_anchor, &anchor, sizeof(anchor));
+}
+
+static ClockAnchor read_anchor()
+{
+	ClockAnchor res;
+	seqlock_read(&s_anchor_lock, &res, &s_anchor, sizeof(res));
+	return res;
+}
+
+#if AUDIO_CLOCK_JITTER_LOG || BENCHMARK_MODE
+typedef struct JitterStats {
+	float prev;
+	double sum_sq;
+	float max;
+} JitterStats;
+
+static void jitter_add(JitterStats* st, float t, double dt_timer)
+{
+	float err = (float)((t - st->prev) - dt_timer);
+	st->sum_sq += err * err;
+	st->max = MAX(st->max, fabsf(err));
+	st->prev = t;
+}
+#endif
+
+#if AUDIO_CLOCK_JITTER_LOG
+#define JITTER_LOG_FRAMES (300)
+
+static double s_jitter_prev_now = -1.0;
+static int s_jitter_frames;
+static JitterStats s_jitter_raw, s_jitter_clock;
+
+static void jitter_track(double now, float raw, float clock, bool seeked)
+{
+	double dt = now - s_jitter_prev_now;
+	bool first = s_jitter_prev_now < 0.0;
+	s_jitter_prev_now = now;
+	if (seeked || first)
+	{
+		s_jitter_raw.prev = raw;
+		s_jitter_clock.prev = clock;
+		return;
+	}
+	jitter_add(&s_jitter_raw, raw, dt);
+	jitter_add(&s_jitter_clock, clock, dt);
+	if (++s_jitter_frames == JITTER_LOG_FRAMES)
+	{
+		plat_sys_log("audio clock jitter over %i frames: decode position %.2fms rms %.2fms max, interpolated %.2fms rms %.2fms max",
+			s_jitter_frames,
+			sqrt(s_jitter_raw.sum_sq / s_jitter_frames) * 1000.0, s_jitter_raw.max * 1000.0f,
+			sqrt(s_jitter_clock.sum_sq / s_jitter_frames) * 1000.0, s_jitter_clock.max * 1000.0f);
+		s_jitter_frames = 0;
+		s_jitter_raw.sum_sq = s_jitter_clock.sum_sq = 0.0;
+		s_jitter_raw.max = s_jitter_clock.max = 0.0f;
+	}
+}
+#endif // #if AUDIO_CLOCK_JITTER_LOG
+
+float audio_clock_get(double now, double latency)
+{
+	ClockAnchor a = read_anchor();
+	unsigned seek_gen = atomic_load_explicit(&s_seek_gen, memory_order_relaxed);
+	float t;
+	if (!a.valid || a.seek_gen != seek_gen)
+	{
+		// no callback yet since the start or the last seek: the first one will be at the target
+		t = (float)(s_seek_target - latency);
+		s_clock_valid = false;
+	}
+	else
+	{
+		double offset = (double)a.pos / s_sample_rate - latency - a.time;
+		bool snap = !s_clock_valid || a.seek_gen != s_clock_seek_gen || fabs(offset - s_clock_offset) > OFFSET_SNAP_SECONDS;
+		if (snap)
+			s_clock_offset = offset;
+		else if (a.time != s_clock_anchor_time)
+			s_clock_offset += (offset - s_clock_offset) * OFFSET_SMOOTHING;
+		s_clock_anchor_time = a.time;
+		s_clock_seek_gen = a.seek_gen;
+		s_clock_valid = true;
+		// nothing past the decoded samples can be audible yet
+		t = (float)MIN(now + s_clock_offset, (double)(a.pos + a.count) / s_sample_rate);
+	}
+	t = MAX(t, 0.0f);
+	bool seeked = s_seek_jump;
+	if (!seeked)
+		t = MAX(t, s_clock_last);
+	s_seek_jump = false;
+	s_clock_last = t;
+
+#if AUDIO_CLOCK_JITTER_LOG
+	jitter_track(now, (float)(a.pos + a.count) / s_sample_rate, t, seeked);
+#endif
+	return t;
+}
+
+#if BENCHMARK_MODE
+
+#define REPORT_SAMPLE_RATE (44100)
+#define REPORT_CALLBACK_FRAMES (2048)
+#define REPORT_FPS (30)
+#define REPORT_SECONDS (20)
+#define REPORT_CALLBACK_JITTER (0.005) // +- seconds
+#define REPORT_FRAME_JITTER (0.003)
+#define REPORT_WARMUP_FRAMES (REPORT_FPS) // until the clock has settled after the start
+
+static double report_jitter(uint32_t* rng, double amount)
+{
+	*rng = *rng * 1664525u + 1013904223u;
+	return ((*rng >> 8) * (2.0 / 16777216.0) - 1.0) * amount;
+}
+
+void audio_clock_report()
+{
+	// each chunk starts playing one buffer after its callback
+	const double period = (double)REPORT_CALLBACK_FRAMES / REPORT_SAMPLE_RATE;
+	const double latency = period;
+	uint32_t rng = 1;
+	audio_clock_init(REPORT_SAMPLE_RATE);
+	audio_clock_seek(0);
+
+	JitterStats raw = { 0 }, clock = { 0 };
+	double max_error = 0.0, prev_now = 0.0;
+	double callback_time = report_jitter(&rng, REPORT_CALLBACK_JITTER);
+	int callbacks = 0, decode_pos = 0;
+	const int frames = REPORT_SECONDS * REPORT_FPS, measured = frames - REPORT_WARMUP_FRAMES - 1;
+	for (int f = 0; f < frames; ++f)
+	{
+		double now = (double)f / REPORT_FPS + report_jitter(&rng, REPORT_FRAME_JITTER);
+		while (callback_time <= now)
+		{
+			int pos = audio_clock_callback_pos(decode_pos);
+			audio_clock_callback_done(pos, REPORT_CALLBACK_FRAMES, callback_time);
+			decode_pos = pos + REPORT_CALLBACK_FRAMES;
+			callbacks++;
+			callback_time = callbacks * period + report_jitter(&rng, REPORT_CALLBACK_JITTER);
+		}
+		float t_raw = (float)decode_pos / REPORT_SAMPLE_RATE;
+		float t = audio_clock_get(now, latency);
+		if (f <= REPORT_WARMUP_FRAMES)
+		{
+			raw.prev = t_raw;
+			clock.prev = t;
+		}
+		else
+		{
+			jitter_add(&raw, t_raw, now - prev_now);
+			jitter_add(&clock, t, now - prev_now);
+		}
+		prev_now = now;
+		// callback n decodes what is audible from n * period + latency on
+		if (f > REPORT_WARMUP_FRAMES)
+			max_error = MAX(max_error, fabs(t - (now - latency)));
+	}
+
+	plat_sys_log("audio clock: %i callbacks of %i samples +-%.0fms, %i frames +-%.0fms; after the first second, frame to frame jitter %.2fms rms %.2fms max from the decode position, %.2fms rms %.2fms max interpolated, which is at most %.2fms off the audible position",
+		callbacks, REPORT_CALLBACK_FRAMES, REPORT_CALLBACK_JITTER * 1000.0, frames, REPORT_FRAME_JITTER * 1000.0,
+		sqrt(raw.sum_sq / measured) * 1000.0, raw.max * 1000.0f,
+		sqrt(clock.sum_sq / measured) * 1000.0, clock.max * 1000.0f, max_error * 1000.0);
+	// the clock is set up again by the next audio_clock_init/audio_clock_seek
+}
+
+#else
+
+void audio_clock_report()
+{
+}
+
+#endif
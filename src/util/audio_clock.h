@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: Unlicense
+
+#pragma once
+
+#include <stdint.h>
+
+// Playback clock of a sound that is decoded in an audio callback (PC platform).
+//
+// The decode position only advances in whole callback chunks, and runs ahead of what is audible
+// by the output buffer latency. So every callback publishes its decode position together with a
+// high resolution timer stamp, and the main thread turns the latest one into an offset between
+// the timer and the audible position: smoothed over callbacks (they are jittery), minus the
+// output latency. The time is then the current timer value plus that offset, never going
+// backwards except for seeks.
+//
+// Seeks go through here too, so that the callback applies them at a chunk boundary, and the
+// clock holds the seek target until a callback at the new position arrives.
+
+// Set to 1 to log the frame to frame jitter of the clock (against the timer) every few seconds,
+// for both the decode position based time and the interpolated one.
+#define AUDIO_CLOCK_JITTER_LOG 0
+
+void audio_clock_init(int sample_rate);
+
+// main thread
+void audio_clock_seek(int sample_pos);
+// audible time in seconds, at timer time now (seconds), with the given output latency
+float audio_clock_get(double now, double latency);
+
+// audio thread: decode position for this callback (sample_pos, or a pending seek target), and
+// the publish after decoding count samples from it at timer time now
+int audio_clock_callback_pos(int sample_pos);
+void audio_clock_callback_done(int sample_pos, int count, double now);
+
+// Benchmark mode: drives the clock with simulated jittery callbacks and frames (before any music
+// plays), and logs the frame to frame jitter of the decode position and of the clock.
+void audio_clock_report();
@@ -0,0 +1,497 @@
+// SPDX-License-Identifier: Unlicense
+
+#include "audio_mixer.h"
+
+#include "../mathlib.h"
+#include "../platform.h"
+#include "cpu_dispatch.h"
+#include "perf_stats.h"
+#include "wav_ima_adpcm.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+#if KERNELS_X86
+#include <immintrin.h>
+#endif
+#if KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+#define SOFT_CLIP_KNEE (0.9f)
+
+// Adds src to interleaved stereo dst, with left/right gains ramping by dgl/dgr per sample.
+typedef void (*MixFunc)(float* dst, const float* src, int count, float gl, float gr, float dgl, float dgr);
+typedef void (*SoftClipFunc)(float* samples, int count);
+
+static void mix_scalar(float* dst, const float* src, int count, float gl, float gr, float dgl, float dgr)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		dst[i * 2 + 0] += src[i] * (gl + dgl * i);
+		dst[i * 2 + 1] += src[i] * (gr + dgr * i);
+	}
+}
+
+static void soft_clip_scalar(float* samples, int count)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		float x = samples[i];
+		float a = fabsf(x);
+		if (a <= SOFT_CLIP_KNEE)
+			continue;
+		// u / (1 + u) has slope 1 at the knee and approaches 1
+		float u = (a - SOFT_CLIP_KNEE) * (1.0f / (1.0f - SOFT_CLIP_KNEE));
+		float y = SOFT_CLIP_KNEE + (1.0f - SOFT_CLIP_KNEE) * u / (1.0f + u);
+		samples[i] = x < 0.0f ? -y : y;
+	}
+}
+
+#if KERNELS_X86
+KERNEL_TARGET("sse2")
+static void mix_sse2(float* dst, const float* src, int count, float gl, float gr, float dgl, float dgr)
+{
+	__m128 g0 = _mm_setr_ps(gl, gr, gl + dgl, gr + dgr);
+	__m128 g1 = _mm_add_ps(g0, _mm_setr_ps(dgl * 2, dgr * 2, dgl * 2, dgr * 2));
+	const __m128 step = _mm_setr_ps(dgl * 4, dgr * 4, dgl * 4, dgr * 4);
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 s = _mm_loadu_ps(src + i);
+		__m128 lo = _mm_unpacklo_ps(s, s); // s0 s0 s1 s1
+		__m128 hi = _mm_unpackhi_ps(s, s);
+		_mm_storeu_ps(dst + i * 2 + 0, _mm_add_ps(_mm_loadu_ps(dst + i * 2 + 0), _mm_mul_ps(lo, g0)));
+		_mm_storeu_ps(dst + i * 2 + 4, _mm_add_ps(_mm_loadu_ps(dst + i * 2 + 4), _mm_mul_ps(hi, g1)));
+		g0 = _mm_add_ps(g0, step);
+		g1 = _mm_add_ps(g1, step);
+	}
+	mix_scalar(dst + i * 2, src + i, count - i, gl + dgl * i, gr + dgr * i, dgl, dgr);
+}
+
+KERNEL_TARGET("sse2")
+static void soft_clip_sse2(float* samples, int count)
+{
+	const __m128 sign_mask = _mm_set1_ps(-0.0f);
+	const __m128 knee = _mm_set1_ps(SOFT_CLIP_KNEE);
+	const __m128 inv_range = _mm_set1_ps(1.0f / (1.0f - SOFT_CLIP_KNEE));
+	const __m128 range = _mm_set1_ps(1.0f - SOFT_CLIP_KNEE);
+	const __m128 one = _mm_set1_ps(1.0f);
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(samples + i);
+		__m128 sign = _mm_and_ps(x, sign_mask);
+		__m128 a = _mm_andnot_ps(sign_mask, x);
+		__m128 u = _mm_mul_ps(_mm_max_ps(_mm_sub_ps(a, knee), _mm_setzero_ps()), inv_range);
+		__m128 y = _mm_add_ps(_mm_min_ps(a, knee), _mm_div_ps(_mm_mul_ps(range, u), _mm_add_ps(one, u)));
+		_mm_storeu_ps(samples + i, _mm_or_ps(y, sign));
+	}
+	soft_clip_scalar(samples + i, count - i);
+}
+#endif // #if KERNELS_X86
+
+#if KERNELS_NEON
+static void mix_neon(float* dst, const float* src, int count, float gl, float gr, float dgl, float dgr)
+{
+	const float g[4] = { gl, gr, gl + dgl, gr + dgr };
+	const float d[4] = { dgl, dgr, dgl, dgr };
+	float32x4_t dd = vld1q_f32(d);
+	float32x4_t g0 = vld1q_f32(g);
+	float32x4_t g1 = vmlaq_n_f32(g0, dd, 2.0f);
+	const float32x4_t step = vmulq_n_f32(dd, 4.0f);
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		float32x4x2_t s = vzipq_f32(vld1q_f32(src + i), vld1q_f32(src + i)); // s0 s0 s1 s1, s2 s2 s3 s3
+		vst1q_f32(dst + i * 2 + 0, vmlaq_f32(vld1q_f32(dst + i * 2 + 0), s.val[0], g0));
+		vst1q_f32(dst + i * 2 + 4, vmlaq_f32(vld1q_f32(dst + i * 2 + 4), s.val[1], g1));
+		g0 = vaddq_f32(g0, step);
+		g1 = vaddq_f32(g1, step);
+	}
+	mix_scalar(dst + i * 2, src + i, count - i, gl + dgl * i, gr + dgr * i, dgl, dgr);
+}
+
+static void soft_clip_neon(float* samples, int count)
+{
+	const uint32x4_t sign_mask = vdupq_n_u32(0x80000000u);
+	const float32x4_t knee = vdupq_n_f32(SOFT_CLIP_KNEE);
+	const float32x4_t one = vdupq_n_f32(1.0f);
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		float32x4_t x = vld1q_f32(samples + i);
+		uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(x), sign_mask);
+		float32x4_t a = vabsq_f32(x);
+		float32x4_t u = vmulq_n_f32(vmaxq_f32(vsubq_f32(a, knee), vdupq_n_f32(0.0f)), 1.0f / (1.0f - SOFT_CLIP_KNEE));
+		float32x4_t y = vaddq_f32(vminq_f32(a, knee), vdivq_f32(vmulq_n_f32(u, 1.0f - SOFT_CLIP_KNEE), vaddq_f32(one, u)));
+		vst1q_f32(samples + i, vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(y), sign)));
+	}
+	soft_clip_scalar(samples + i, count - i);
+}
+#endif // #if KERNELS_NEON
+
+// Bound to the scalar variants up front: the audio callback may run before mixer_init.
+static KernelSlot s_mix_slot = {
+	"mixer_mix",
+	{
+		{kIsaScalar, (KernelFunc)mix_scalar},
+#if KERNELS_X86
+		{kIsaSSE2, (KernelFunc)mix_sse2},
+#endif
+#if KERNELS_NEON
+		{kIsaNEON, (KernelFunc)mix_neon},
+#endif
+	},
+	(KernelFunc)mix_scalar,
+};
+
+static KernelSlot s_soft_clip_slot = {
+	"mixer_soft_clip",
+	{
+		{kIsaScalar, (KernelFunc)soft_clip_scalar},
+#if KERNELS_X86
+		{kIsaSSE2, (KernelFunc)soft_clip_sse2},
+#endif
+#if KERNELS_NEON
+		{kIsaNEON, (KernelFunc)soft_clip_neon},
+#endif
+	},
+	(KernelFunc)soft_clip_scalar,
+};
+
+typedef enum CommandType {
+	kCommandPlay,
+	kCommandSet,
+	kCommandStop,
+} CommandType;
+
+typedef struct Command {
+	CommandType type;
+	int slot;
+	float gain_l, gain_r;
+	int64_t start_pos;
+	MixerSound sound;
+} Command;
+
+#define COMMAND_QUEUE_SIZE (64)
+
+// single producer (main thread), single consumer (audio thread)
+static Command s_commands[COMMAND_QUEUE_SIZE];
+static atomic_uint s_command_head; // next to write
+static atomic_uint s_command_tail; // next to read
+
+// bit per slot: set by the main thread when it starts a voice, cleared by the audio thread when the
+// voice is done
+static atomic_uint s_busy_slots;
+static uint32_t s_slot_generation[MIXER_VOICE_COUNT]; // main thread
+
+typedef struct Voice {
+	MixerSound sound;
+	wav_decode_state adpcm;
+	int64_t start_pos;
+	int pos; // frames played so far
+	float gain_l, gain_r;
+	float target_l, target_r;
+	bool active;
+} Voice;
+
+// audio thread
+static Voice s_voices[MIXER_VOICE_COUNT];
+static float s_adpcm_blocks[MIXER_VOICE_COUNT][MIXER_ADPCM_BLOCK_MAX];
+static float s_source[MIXER_CHUNK_FRAMES];
+
+void mixer_init()
+{
+	kernels_register(&s_mix_slot);
+	kernels_register(&s_soft_clip_slot);
+}
+
+bool mixer_sound_from_wav(const void* data, size_t size, MixerSound* res)
+{
+	wav_file_desc desc;
+	if (!wav_parse_header(data, size, &desc) || desc.channel_count != 1)
+	{
+		plat_sys_log_error("mixer: sounds need to be mono .wav files");
+		return false;
+	}
+	res->data = desc.sample_data;
+	res->frame_count = desc.sample_count;
+	res->block_size = desc.block_size;
+	res->samples_per_block = desc.samples_per_block;
+	res->bits_per_sample = desc.bits_per_sample;
+	if (desc.sample_format == 1 && desc.block_size == 2)
+		res->format = kMixerPcm16;
+	else if (desc.sample_format == 0x11 && desc.samples_per_block <= MIXER_ADPCM_BLOCK_MAX)
+		res->format = kMixerImaAdpcm;
+	else
+	{
+		plat_sys_log_error("mixer: unsupported sound (format %i, %i bits, %i samples per block, at most %i for ADPCM)",
+			desc.sample_format, desc.bits_per_sample, desc.samples_per_block, MIXER_ADPCM_BLOCK_MAX);
+		return false;
+	}
+	return true;
+}
+
+// constant power pan
+static void pan_gains(float gain, float pan, float* gl, float* gr)
+{
+	float a = (MIN(MAX(pan, -1.0f), 1.0f) + 1.0f) * (M_PIf * 0.25f);
+	*gl = gain * cosf(a);
+	*gr = gain * sinf(a);
+}
+
+static bool push_command(const Command* cmd)
+{
+	unsigned head = atomic_load_explicit(&s_command_head, memory_order_relaxed);
+	unsigned tail = atomic_load_explicit(&s_command_tail, memory_order_acquire);
+	if (head - tail >= COMMAND_QUEUE_SIZE)
+		return false;
+	s_commands[head % COMMAND_QUEUE_SIZE] = *cmd;
+	atomic_store_explicit(&s_command_head, head + 1, memory_order_release);
+	return true;
+}
+
+// handles are generation << 8 | (slot + 1)
+static int voice_slot(MixerVoice voice)
+{
+	int slot = (int)(voice & 0xFF) - 1;
+	if (slot < 0 || slot >= MIXER_VOICE_COUNT || s_slot_generation[slot] != voice >> 8)
+		return -1;
+	if ((atomic_load(&s_busy_slots) & (1u << slot)) == 0)
+		return -1;
+	return slot;
+}
+
+MixerVoice mixer_play(const MixerSound* sound, float gain, float pan, int64_t start_pos)
+{
+	uint32_t busy = atomic_load(&s_busy_slots);
+	int slot = 0;
+	while (slot < MIXER_VOICE_COUNT && (busy & (1u << slot)))
+		slot++;
+	if (slot == MIXER_VOICE_COUNT)
+		return 0;
+
+	Command cmd = { kCommandPlay, slot };
+	pan_gains(gain, pan, &cmd.gain_l, &cmd.gain_r);
+	cmd.start_pos = start_pos;
+	cmd.sound = *sound;
+	atomic_fetch_or(&s_busy_slots, 1u << slot);
+	if (!push_command(&cmd))
+	{
+		atomic_fetch_and(&s_busy_slots, ~(1u << slot));
+		return 0;
+	}
+	s_slot_generation[slot] = (s_slot_generation[slot] + 1) & 0xFFFFFF;
+	return (s_slot_generation[slot] << 8) | (uint32_t)(slot + 1);
+}
+
+void mixer_set(MixerVoice voice, float gain, float pan)
+{
+	int slot = voice_slot(voice);
+	if (slot < 0)
+		return;
+	Command cmd = { kCommandSet, slot };
+	pan_gains(gain, pan, &cmd.gain_l, &cmd.gain_r);
+	push_command(&cmd);
+}
+
+void mixer_stop(MixerVoice voice)
+{
+	int slot = voice_slot(voice);
+	if (slot < 0)
+		return;
+	Command cmd = { kCommandStop, slot };
+	push_command(&cmd);
+}
+
+bool mixer_is_playing(MixerVoice voice)
+{
+	return voice_slot(voice) >= 0;
+}
+
+static void voice_finish(int slot)
+{
+	s_voices[slot].active = false;
+	atomic_fetch_and(&s_busy_slots, ~(1u << slot));
+}
+
+static void apply_commands()
+{
+	unsigned tail = atomic_load_explicit(&s_command_tail, memory_order_relaxed);
+	unsigned head = atomic_load_explicit(&s_command_head, memory_order_acquire);
+	for (; tail != head; ++tail)
+	{
+		const Command* cmd = &s_commands[tail % COMMAND_QUEUE_SIZE];
+		Voice* v = &s_voices[cmd->slot];
+		switch (cmd->type)
+		{
+		case kCommandPlay:
+			v->sound = cmd->sound;
+			v->start_pos = cmd->start_pos;
+			v->pos = 0;
+			v->gain_l = v->target_l = cmd->gain_l;
+			v->gain_r = v->target_r = cmd->gain_r;
+			v->adpcm.block = s_adpcm_blocks[cmd->slot];
+			v->adpcm.block_index = -1;
+			v->adpcm.block_size_bytes = cmd->sound.block_size;
+			v->adpcm.samples_per_block = cmd->sound.samples_per_block;
+			v->adpcm.bits_per_sample = cmd->sound.bits_per_sample;
+			v->active = true;
+			break;
+		case kCommandSet:
+			v->target_l = cmd->gain_l;
+			v->target_r = cmd->gain_r;
+			break;
+		case kCommandStop:
+			if (v->active)
+				voice_finish(cmd->slot);
+			break;
+		}
+	}
+	atomic_store_explicit(&s_command_tail, tail, memory_order_release);
+}
+
+// count samples of the voice source, from its current position, into s_source
+static void fetch_source(Voice* v, int count)
+{
+	if (v->sound.format == kMixerImaAdpcm)
+	{
+		wav_ima_adpcm_decode(s_source, v->pos, count, v->sound.data, &v->adpcm);
+		return;
+	}
+	const int16_t* src = (const int16_t*)v->sound.data + v->pos;
+	for (int i = 0; i < count; ++i)
+		s_source[i] = src[i] * (1.0f / 32768.0f);
+}
+
+static void render_chunk(float* stereo, int frames, int64_t pos)
+{
+	MixFunc mix = (MixFunc)kernel_bound(&s_mix_slot);
+	for (int slot = 0; slot < MIXER_VOICE_COUNT; ++slot)
+	{
+		Voice* v = &s_voices[slot];
+		if (!v->active)
+			continue;
+		// sample accurate start within the chunk
+		int64_t offset = v->start_pos - pos;
+		if (offset >= frames)
+			continue;
+		if (offset < 0 || v->pos > 0)
+			offset = 0;
+		int count = MIN(frames - (int)offset, v->sound.frame_count - v->pos);
+		if (count > 0)
+		{
+			fetch_source(v, count);
+			float inv = 1.0f / count;
+			mix(stereo + offset * 2, s_source, count, v->gain_l, v->gain_r, (v->target_l - v->gain_l) * inv, (v->target_r - v->gain_r) * inv);
+			v->gain_l = v->target_l;
+			v->gain_r = v->target_r;
+			v->pos += count;
+		}
+		if (v->pos >= v->sound.frame_count)
+			voice_finish(slot);
+	}
+}
+
+void mixer_render(float* stereo, int frames, int64_t pos)
+{
+	apply_commands();
+	for (int done = 0; done < frames; done += MIXER_CHUNK_FRAMES)
+		render_chunk(stereo + done * 2, MIN(frames - done, MIXER_CHUNK_FRAMES), pos + done);
+}
+
+void mixer_add_mono(float* stereo, const float* mono, int frames, float gain)
+{
+	((MixFunc)kernel_bound(&s_mix_slot))(stereo, mono, frames, gain, gain, 0.0f, 0.0f);
+}
+
+void mixer_soft_clip(float* samples, int count)
+{
+	((SoftClipFunc)kernel_bound(&s_soft_clip_slot))(samples, count);
+}
+
+#if BENCHMARK_MODE
+
+#define REPORT_SAMPLE_RATE (44100)
+#define REPORT_SECONDS (4)
+#define REPORT_SOUND_FRAMES (REPORT_SAMPLE_RATE * 2)
+#define REPORT_ADPCM_BLOCK (1024)
+
+static int16_t s_report_pcm[REPORT_SOUND_FRAMES];
+static uint8_t s_report_adpcm[REPORT_SOUND_FRAMES / 2 + REPORT_ADPCM_BLOCK * 2];
+static float s_report_out[MIXER_CHUNK_FRAMES * 2];
+
+// seconds to render REPORT_SECONDS with all voices playing the sound, with their gains changing
+static float time_voices(const MixerSound* sound)
+{
+	MixerVoice voices[MIXER_VOICE_COUNT] = { 0 };
+	float seconds = 0.0f;
+	for (int frame = 0; frame < REPORT_SAMPLE_RATE * REPORT_SECONDS; frame += MIXER_CHUNK_FRAMES)
+	{
+		for (int i = 0; i < MIXER_VOICE_COUNT; ++i)
+		{
+			float pan = (i & 7) / 3.5f - 1.0f;
+			if (!mixer_is_playing(voices[i]))
+				voices[i] = mixer_play(sound, 0.1f, pan, -1);
+			else
+				mixer_set(voices[i], (frame & 1024) ? 0.05f : 0.1f, pan);
+		}
+		memset(s_report_out, 0, sizeof(s_report_out));
+		float t0 = plat_time_get();
+		mixer_render(s_report_out, MIXER_CHUNK_FRAMES, frame);
+		seconds += plat_time_get() - t0;
+	}
+	for (int i = 0; i < MIXER_VOICE_COUNT; ++i)
+		mixer_stop(voices[i]);
+	apply_commands();
+	return seconds;
+}
+
+void mixer_report()
+{
+	// a second of a chord with a little noise
+	uint32_t rng = 1;
+	for (int i = 0; i < REPORT_SOUND_FRAMES; ++i)
+	{
+		float t = (float)i / REPORT_SAMPLE_RATE;
+		float v = 0.3f * sinf(2.0f * M_PIf * 220.0f * t) + 0.2f * sinf(2.0f * M_PIf * 277.0f * t) + 0.2f * sinf(2.0f * M_PIf * 330.0f * t);
+		v += 0.05f * (RandomFloat01(&rng) * 2.0f - 1.0f);
+		s_report_pcm[i] = (int16_t)(v * 32767.0f);
+	}
+	MixerSound pcm = { s_report_pcm, REPORT_SOUND_FRAMES, kMixerPcm16, 2, 1, 16 };
+	wav_ima_adpcm_encode(s_report_adpcm, s_report_pcm, REPORT_SOUND_FRAMES, REPORT_ADPCM_BLOCK, 4);
+	MixerSound adpcm = { s_report_adpcm, REPORT_SOUND_FRAMES, kMixerImaAdpcm, REPORT_ADPCM_BLOCK, wav_ima_adpcm_samples_per_block(REPORT_ADPCM_BLOCK, 4), 4 };
+
+	static const char* kIsaNames[kIsaCount] = { "scalar", "sse2", "avx2", "neon" };
+	double voice_seconds = (double)MIXER_VOICE_COUNT * REPORT_SECONDS;
+	int prev_isa_max = g_kernel_isa_max;
+	for (int isa = 0; isa <= prev_isa_max; ++isa)
+	{
+		if (!kernels_isa_supported((KernelIsa)isa))
+			continue;
+		g_kernel_isa_max = isa;
+		kernels_bind_all();
+		if (s_mix_slot.bound_isa != isa)
+			continue;
+		// a voice costs this fraction of a core; 1% of a core fits 0.01 / that many
+		double pcm_cost = time_voices(&pcm) / voice_seconds;
+		double adpcm_cost = time_voices(&adpcm) / voice_seconds;
+		float t0 = plat_time_get();
+		for (int i = 0; i < REPORT_SAMPLE_RATE * REPORT_SECONDS; i += MIXER_CHUNK_FRAMES)
+			mixer_soft_clip(s_report_out, MIXER_CHUNK_FRAMES * 2);
+		double clip_cost = (plat_time_get() - t0) / REPORT_SECONDS;
+		plat_sys_log("mixer (%s): voices in 1%% of a core at 44.1kHz: %.0f PCM16, %.0f ADPCM; soft clip %.3f%% of a core",
+			kIsaNames[isa], 0.01 / pcm_cost, 0.01 / adpcm_cost, clip_cost * 100.0);
+	}
+	g_kernel_isa_max = prev_isa_max;
+	kernels_bind_all();
+}
+
+#else
+
+void mixer_report()
+{
+}
+
+#endif
@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: Unlicense
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Software mixer of the PC audio callback: up to MIXER_VOICE_COUNT mono sounds (16 bit PCM or IMA
+// ADPCM) added to a stereo float buffer on top of the music, with per voice gain and constant power
+// pan. A voice starts at a given stream position (the music decode position), at the exact sample
+// of the chunk that contains it. Gain/pan changes ramp over a chunk. The mix loop and the soft
+// clipper have SIMD variants (see cpu_dispatch.h).
+//
+// The main thread controls voices through a lock-free command queue; the audio thread owns the
+// voice state, and hands finished voices back through an atomic bitmask.
+
+#define MIXER_VOICE_COUNT (32)
+// mixer_render splits longer buffers into chunks of this size
+#define MIXER_CHUNK_FRAMES (512)
+// longest ADPCM block (in samples) that voices can decode
+#define MIXER_ADPCM_BLOCK_MAX (4096)
+
+typedef enum MixerFormat {
+	kMixerPcm16,
+	kMixerImaAdpcm,
+} MixerFormat;
+
+typedef struct MixerSound {
+	const void* data;
+	int frame_count;
+	MixerFormat format;
+	int block_size; // ADPCM block size in bytes, samples in it, and bits per sample
+	int samples_per_block;
+	int bits_per_sample;
+} MixerSound;
+
+typedef uint32_t MixerVoice; // 0 is no voice
+
+void mixer_init();
+// mono 16 bit PCM or IMA ADPCM (4, 3 or 2 bit) .wav file contents; the sound keeps pointing into data
+bool mixer_sound_from_wav(const void* data, size_t size, MixerSound* res);
+
+// main thread; pan is -1 (left) .. 1 (right). Positions before the current one start right away.
+// Returns 0 if all voices are busy.
+MixerVoice mixer_play(const MixerSound* sound, float gain, float pan, int64_t start_pos);
+void mixer_set(MixerVoice voice, float gain, float pan);
+void mixer_stop(MixerVoice voice);
+bool mixer_is_playing(MixerVoice voice);
+
+// audio thread: adds the voices to frames of interleaved stereo that start at stream position pos
+void mixer_render(float* stereo, int frames, int64_t pos);
+// adds mono * gain to both channels of stereo
+void mixer_add_mono(float* stereo, const float* mono, int frames, float gain);
+// in place: linear up to a knee, then rounding off towards +-1
+void mixer_soft_clip(float* samples, int count);
+
+// Benchmark mode: logs how many voices (16 bit PCM and ADPCM) fit in 1% of a core at 44.1kHz,
+// for each mix kernel variant.
+void mixer_report();
@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: Unlicense
+
+#include "audio_telemetry.h"
+
+#include "../mathlib.h"
+#include "../platform.h"
+#include "seqlock.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+// histogram bucket upper edges, relative to the callback period
+static const float kCostEdges[AUDIO_TELEMETRY_BUCKETS - 1] = { 0.01f, 0.02f, 0.04f, 0.08f, 0.16f, 0.32f, 0.64f, 1.0f };
+static const float kIntervalEdges[AUDIO_TELEMETRY_BUCKETS - 1] = { 0.25f, 0.5f, 0.75f, 0.9f, 1.1f, 1.25f, 1.5f, 2.0f };
+
+// audio thread state
+static AudioTelemetry s_state;
+static double s_prev_start = -1.0;
+static double s_prev_period;
+static atomic_bool s_reset_requested;
+static atomic_bool s_restarted;
+
+// published results
+static AudioTelemetry s_published;
+static Seqlock s_lock;
+
+// main thread: underruns seen by the last adapt_buffer
+static uint32_t s_adapt_underruns;
+
+void audio_telemetry_reset()
+{
+	atomic_store(&s_reset_requested, true);
+}
+
+void audio_telemetry_restart()
+{
+	atomic_store(&s_restarted, true);
+}
+
+static int bucket_index(const float* edges, float v)
+{
+	int i = 0;
+	while (i < AUDIO_TELEMETRY_BUCKETS - 1 && v >= edges[i])
+		i++;
+	return i;
+}
+
+static void publish()
+{
+	seqlock_publish(&s_lock, &s_published, &s_state, sizeof(s_state));
+}
+
+void audio_telemetry_callback(double start, double end, double decode_seconds, int frame_count, int sample_rate, int buffer_frames)
+{
+	if (atomic_exchange(&s_reset_requested, false))
+		memset(&s_state, 0, sizeof(s_state));
+	if (atomic_exchange(&s_restarted, false))
+		s_prev_start = -1.0;
+
+	AudioTelemetry* st = &s_state;
+	double period = (double)frame_count / sample_rate;
+	float cost = (float)(end - start);
+	st->callbacks++;
+	st->frames += frame_count;
+	st->period = (float)period;
+	st->cost_sum += cost;
+	st->cost_max = MAX(st->cost_max, cost);
+	st->decode_sum += decode_seconds;
+	st->decode_max = MAX(st->decode_max, (float)decode_seconds);
+	if (period > 0.0)
+	{
+		st->cost_histogram[bucket_index(kCostEdges, (float)(cost / period))]++;
+		if (cost > period)
+			st->deadline_misses++;
+	}
+	if (s_prev_start >= 0.0 && s_prev_period > 0.0)
+	{
+		// the previous callback's frames and whatever was queued before them have played out
+		float interval = (float)(start - s_prev_start);
+		st->interval_max = MAX(st->interval_max, interval);
+		st->interval_histogram[bucket_index(kIntervalEdges, (float)(interval / s_prev_period))]++;
+		if (interval > s_prev_period + (double)buffer_frames / sample_rate)
+			st->gaps++;
+	}
+	s_prev_start = start;
+	s_prev_period = period;
+	publish();
+}
+
+void audio_telemetry_read(AudioTelemetry* res)
+{
+	seqlock_read(&s_lock, res, &s_published, sizeof(*res));
+}
+
+static void format_histogram(char* buf, size_t size, const uint32_t* histogram)
+{
+	int len = 0;
+	buf[0] = 0;
+	for (int i = 0; i < AUDIO_TELEMETRY_BUCKETS && len < (int)size; ++i)
+		len += snprintf(buf + len, size - len, i == 0 ? "%u" : " %u", histogram[i]);
+}
+
+void audio_telemetry_log(const char* name)
+{
+	AudioTelemetry t;
+	audio_telemetry_read(&t);
+	if (t.callbacks == 0)
+		return;
+	float period_ms = t.period * 1000.0f;
+	plat_sys_log("%s: %u callbacks of %.1fms, %u underruns (%u deadline misses, %u gaps); cost avg %.3fms max %.3fms (decode avg %.3fms max %.3fms), longest interval %.1fms",
+		name, t.callbacks, period_ms, audio_telemetry_underruns(&t), t.deadline_misses, t.gaps,
+		t.cost_sum * 1000.0 / t.callbacks, t.cost_max * 1000.0f,
+		t.decode_sum * 1000.0 / t.callbacks, t.decode_max * 1000.0f, t.interval_max * 1000.0f);
+	char buf[200];
+	format_histogram(buf, sizeof(buf), t.cost_histogram);
+	plat_sys_log("  cost/period histogram (<1%% <2%% <4%% <8%% <16%% <32%% <64%% <100%% more): %s", buf);
+	format_histogram(buf, sizeof(buf), t.interval_histogram);
+	plat_sys_log("  interval/period histogram (<0.25 <0.5 <0.75 <0.9 <1.1 <1.25 <1.5 <2 more): %s", buf);
+}
+
+int audio_telemetry_adapt_buffer(int buffer_frames)
+{
+	AudioTelemetry t;
+	audio_telemetry_read(&t);
+	uint32_t underruns = audio_telemetry_underruns(&t);
+	// a reset of the statistics starts the count over
+	if (underruns < s_adapt_underruns)
+		s_adapt_underruns = 0;
+	if (underruns == s_adapt_underruns || buffer_frames >= AUDIO_BUFFER_FRAMES_MAX)
+		return buffer_frames;
+	s_adapt_underruns = underruns;
+	return MIN(buffer_frames * 2, AUDIO_BUFFER_FRAMES_MAX);
+}
@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: Unlicense
+
+#pragma once
+
+#include <stdint.h>
+
+// Timing of the audio callback (PC platform), to tell whether audio keeps up while the main
+// thread is busy.
+//
+// Every callback reports when it started and ended, how long its music decoding took, and how
+// many frames it produced. Its period is the play time of those frames. A callback that takes
+// longer than its period is a deadline miss: the output can't keep up. A callback that starts
+// later than the previous one's frames plus the output buffer could cover is a gap: the audio
+// thread was not scheduled in time. Both count as underruns. Callback costs and start to start
+// intervals (both relative to the period) also go into histograms.
+//
+// The audio thread owns the statistics and publishes a snapshot after every callback.
+
+// Set to 1 to double the output buffer (up to AUDIO_BUFFER_FRAMES_MAX) whenever underruns
+// happened since the last check, at the cost of that much more latency.
+#define AUDIO_ADAPTIVE_BUFFER 0
+#define AUDIO_BUFFER_FRAMES_MAX (16384)
+
+#define AUDIO_TELEMETRY_BUCKETS (9)
+
+typedef struct AudioTelemetry {
+	uint32_t callbacks;
+	uint32_t frames;
+	uint32_t deadline_misses;
+	uint32_t gaps;
+	float period; // seconds, of the latest callback
+	double cost_sum, decode_sum; // seconds, whole callback and its music decoding part
+	float cost_max, decode_max;
+	float interval_max; // seconds between callback starts
+	// callback cost / period: below 1%, 2%, 4%, .. 64%, 100%, and above
+	uint32_t cost_histogram[AUDIO_TELEMETRY_BUCKETS];
+	// start to start interval / period: below 0.25, 0.5, 0.75, 0.9, 1.1, 1.25, 1.5, 2, and above
+	uint32_t interval_histogram[AUDIO_TELEMETRY_BUCKETS];
+} AudioTelemetry;
+
+// main thread
+void audio_telemetry_reset(); // applied by the next callback
+// the stream is about to be restarted: the next callback has no previous one to measure against
+void audio_telemetry_restart();
+void audio_telemetry_read(AudioTelemetry* res);
+static inline uint32_t audio_telemetry_underruns(const AudioTelemetry* t)
+{
+	return t->deadline_misses + t->gaps;
+}
+// logs the statistics (if there were callbacks since the last reset) with a name prefix
+void audio_telemetry_log(const char* name);
+// adaptive buffering: the buffer size in frames to use from now on, given the current one
+int audio_telemetry_adapt_buffer(int buffer_frames);
+
+// audio thread: one callback of frame_count frames, with timer times (seconds) at its start and
+// end, and the time spent decoding music in it. The output runs at sample_rate, with a buffer of
+// buffer_frames.
+void audio_telemetry_callback(double start, double end, double decode_seconds, int frame_count, int sample_rate, int buffer_frames);
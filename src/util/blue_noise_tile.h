@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: Unlicense
+
+// Generated by tools/blue_noise_tile.c, do not edit.
+
+#pragma once
+
+#include <stdint.h>
+
+#define BLUE_NOISE_TILE_SIZE 64
+
+static const uint8_t kBlueNoiseTile[BLUE_NOISE_TILE_SIZE * BLUE_NOISE_TILE_SIZE] = {
+	57,115,140,166,231,52,249,2,106,226,62,254,179,76,230,133,45,107,76,16,120,184,55,130,39,195,72,254,13,221,101,22,151,229,175,39,207,162,73,101,196,232,175,146,224,182,33,245,154,52,135,229,42,211,141,248,51,205,117,23,60,198,35,144,
+	178,239,29,76,204,100,142,208,170,130,35,147,4,207,21,188,27,204,162,222,36,159,245,78,151,23,125,47,185,67,141,48,212,63,12,140,85,225,24,243,127,16,53,118,94,162,210,70,25,199,83,111,158,15,77,164,4,179,142,245,185,131,97,209,
+	83,47,194,134,10,183,41,72,20,240,78,216,97,136,66,116,236,92,129,58,191,92,2,179,218,100,205,164,87,116,240,169,93,190,112,247,53,119,145,38,169,68,207,248,22,47,112,142,236,170,0,252,63,193,220,106,237,86,41,161,77,6,164,22,
+	127,156,102,252,64,114,236,159,95,193,117,184,48,172,247,153,50,173,8,254,110,212,140,115,60,244,6,136,233,25,194,2,130,33,155,197,16,177,201,82,218,105,139,184,78,230,195,11,88,125,49,207,143,119,31,57,128,200,17,103,235,49,217,247,
+	184,2,208,34,169,215,25,123,221,45,10,151,224,30,88,12,220,74,203,146,26,71,44,235,30,169,80,40,215,59,150,79,252,215,66,90,230,104,61,235,1,155,43,14,129,97,158,60,213,181,99,27,177,90,233,184,152,71,228,124,191,147,114,63,
+	95,225,77,124,150,91,55,180,144,66,250,107,71,125,209,187,139,113,40,89,178,224,158,190,96,143,197,112,159,94,205,37,108,171,9,127,43,166,21,133,189,87,241,199,168,29,249,137,36,230,151,243,71,11,134,46,23,213,171,57,29,86,200,37,
+	171,145,48,240,13,198,247,3,85,205,170,22,236,163,56,99,27,230,156,241,120,14,83,126,10,222,56,251,11,178,123,224,55,142,238,183,211,149,253,115,53,214,109,65,223,51,188,115,80,7,57,114,216,164,202,255,116,94,1,143,249,168,10,234,
+	111,17,205,101,177,73,112,136,231,31,126,92,192,0,144,251,68,177,5,63,198,50,238,209,66,175,34,132,73,235,19,86,191,24,73,97,29,64,86,180,31,165,11,148,122,90,19,220,167,201,135,189,40,102,61,83,157,231,195,75,108,210,131,72,
+	254,183,128,63,147,39,217,164,47,194,153,57,219,116,44,201,127,87,217,136,105,170,144,24,109,152,230,95,188,46,140,166,245,115,159,221,122,195,7,219,140,80,249,39,183,234,154,65,105,252,91,18,239,149,5,186,31,54,123,237,43,23,157,52,
+	85,34,220,20,237,193,16,97,69,109,243,25,80,181,233,18,167,37,187,21,252,36,93,182,244,80,1,202,154,106,215,66,36,207,2,52,246,137,102,236,59,196,97,208,70,4,129,207,24,43,156,74,176,123,229,207,135,178,12,160,186,96,227,193,
+	139,160,94,168,114,82,133,252,174,6,209,133,166,100,61,149,110,242,97,69,157,206,62,130,45,210,118,60,28,249,11,129,96,143,184,83,173,22,161,43,127,170,21,133,162,99,246,53,177,120,195,225,54,34,88,109,69,224,100,61,216,76,122,3,
+	214,66,246,44,203,59,183,36,223,145,72,42,238,9,221,79,210,53,141,222,121,7,231,190,15,164,138,224,182,78,172,201,240,58,226,112,39,213,73,203,10,111,240,50,224,35,193,82,145,238,1,105,134,190,249,15,155,35,245,136,19,148,242,47,
+	178,120,12,134,226,4,157,119,56,94,201,116,188,155,124,33,172,2,197,30,178,83,149,108,73,255,90,39,110,149,49,87,16,158,24,133,237,95,149,251,183,66,212,87,180,116,138,14,216,60,89,208,22,147,58,170,211,84,196,115,179,37,199,107,
+	27,232,190,79,150,103,240,209,16,167,249,20,84,51,198,255,134,88,239,113,50,248,25,220,48,176,19,197,242,6,231,125,190,100,209,69,188,4,120,49,92,145,31,153,8,64,232,169,110,34,153,173,241,82,219,123,45,142,4,54,235,71,161,88,
+	56,152,98,39,199,61,30,84,190,131,38,148,229,111,13,98,58,186,151,74,168,195,92,133,203,114,152,59,132,93,213,66,167,40,253,150,54,165,229,26,130,235,197,107,247,205,23,77,201,254,124,68,38,112,12,184,99,253,173,97,208,132,9,251,
+	136,207,20,165,254,129,178,109,230,64,103,182,68,174,211,163,228,23,42,232,9,119,60,162,3,237,76,218,175,45,153,30,204,117,80,15,108,200,79,215,172,12,76,47,166,130,99,147,51,182,7,228,193,161,234,67,26,216,74,152,24,113,218,175,
+	108,71,228,115,77,9,222,43,155,1,207,240,17,138,40,75,130,110,217,97,138,206,241,39,188,99,33,122,18,194,107,245,1,143,218,175,240,36,136,102,59,188,121,217,89,36,187,239,26,86,106,142,54,91,132,204,158,126,41,231,185,51,81,38,
+	239,0,179,54,216,141,167,71,247,138,85,52,118,223,94,245,4,202,176,55,163,17,82,148,67,211,171,250,83,230,137,75,179,94,46,126,72,159,6,243,151,29,252,143,2,231,62,159,126,224,171,214,23,250,3,47,105,190,12,91,135,243,161,200,
+	92,130,153,30,191,98,23,202,117,33,168,197,152,28,188,159,46,145,82,29,253,110,172,222,128,21,141,54,156,9,59,211,32,232,196,18,224,192,53,209,80,109,202,66,173,204,112,12,198,59,35,78,119,183,148,225,72,242,166,209,64,8,118,28,
+	55,187,232,79,123,245,52,92,180,216,106,11,252,59,112,217,67,234,192,125,65,210,26,50,107,233,90,206,116,189,102,167,119,151,62,106,146,87,119,167,41,179,19,97,46,135,78,247,95,138,241,157,205,62,98,177,30,120,51,144,104,191,221,150,
+	250,104,44,211,7,154,223,134,19,63,231,79,129,176,85,15,135,105,12,223,150,186,96,246,179,7,45,169,26,226,41,254,16,84,241,173,39,252,21,219,139,228,128,239,155,219,30,168,42,182,10,102,31,236,15,133,200,88,222,26,247,43,174,73,
+	207,14,142,171,111,40,174,75,249,158,41,147,194,37,211,163,246,38,167,90,47,0,138,68,151,196,130,247,73,148,91,137,191,48,208,3,131,183,73,101,9,58,84,182,13,105,189,124,225,75,210,129,187,85,168,55,255,6,184,161,79,132,98,24,
+	120,180,86,242,67,198,100,10,187,123,205,101,3,236,121,56,190,76,120,241,203,112,217,33,84,230,62,104,213,4,180,63,218,127,156,93,227,56,152,193,246,162,201,37,75,254,60,5,99,149,55,251,44,144,228,106,155,128,68,110,214,4,232,146,
+	38,225,57,132,22,231,143,217,49,84,26,228,70,154,93,23,146,228,177,25,66,155,238,171,122,14,164,31,192,117,243,30,108,13,70,198,113,24,213,124,30,93,119,217,148,127,208,162,234,27,173,115,0,204,72,34,217,45,234,20,193,154,51,199,
+	110,158,2,209,162,89,32,116,153,242,170,111,185,48,254,206,102,5,53,132,193,89,17,57,203,94,222,136,53,151,81,163,229,178,244,43,170,238,82,46,146,230,1,54,177,18,81,42,135,199,68,223,93,180,125,18,189,96,174,137,62,93,253,81,
+	189,70,247,118,46,182,254,64,200,7,59,141,220,15,173,134,63,218,160,250,104,39,185,132,255,43,181,78,238,14,211,45,94,145,27,86,135,6,163,107,186,69,165,241,101,221,192,109,246,90,16,139,161,49,248,209,140,77,245,29,225,119,169,25,
+	234,35,96,194,77,134,14,166,92,131,213,33,87,121,74,37,191,113,81,15,203,234,150,70,105,156,2,115,203,101,176,133,65,200,118,188,221,65,199,251,17,210,135,79,40,143,26,166,57,128,186,240,28,108,84,157,54,14,122,163,44,206,10,144,
+	122,177,139,10,236,206,107,223,42,189,101,234,162,198,240,152,227,27,182,143,61,120,7,224,29,198,233,144,67,36,242,21,224,0,253,49,103,148,35,129,57,98,28,199,115,250,67,228,4,212,39,78,219,190,5,116,228,185,212,103,80,184,65,218,
+	85,51,213,157,63,39,153,73,245,20,150,68,0,50,104,13,86,126,245,40,174,93,208,163,85,125,56,23,164,194,121,155,103,171,79,158,16,237,85,176,221,153,236,180,7,160,94,183,147,105,174,121,149,66,243,168,34,67,146,1,232,135,106,29,
+	162,243,21,103,186,126,17,181,114,56,176,124,251,181,133,215,168,53,205,77,222,20,134,51,244,179,100,212,252,89,48,71,207,35,129,215,181,121,208,11,112,75,45,126,58,207,130,40,82,223,60,22,205,42,131,81,205,96,253,57,166,36,248,199,
+	113,73,130,228,84,251,213,89,142,199,227,88,26,208,71,33,232,106,5,156,116,237,68,195,36,10,150,75,131,5,232,185,136,237,59,97,26,72,52,161,243,24,171,219,85,237,19,196,244,12,138,254,98,181,15,232,141,18,176,123,222,91,149,7,
+	223,191,35,170,1,53,159,34,241,11,41,164,113,157,96,146,64,178,131,193,32,97,167,146,109,205,229,41,188,108,166,28,92,8,187,227,140,248,191,133,91,200,141,105,31,152,113,54,158,117,187,80,153,222,114,58,195,106,44,202,24,70,187,47,
+	93,138,58,209,145,114,192,67,128,106,79,218,54,241,7,197,250,22,88,241,49,210,2,253,81,127,63,160,21,223,141,64,247,160,111,42,168,86,2,40,227,64,9,251,187,68,175,216,74,32,210,49,4,69,172,36,161,241,78,147,110,215,127,166,
+	255,16,235,100,70,225,17,233,172,208,146,186,21,173,132,47,115,153,221,71,144,124,185,56,27,176,242,103,197,80,37,212,123,198,77,17,204,120,219,108,154,183,122,52,212,96,1,129,240,106,167,231,125,203,246,89,132,14,226,180,5,243,59,26,
+	179,77,156,195,40,178,137,87,50,3,255,65,116,90,227,75,214,36,186,10,173,83,229,107,220,144,15,51,124,250,181,99,13,52,134,242,148,49,175,73,19,238,93,165,25,144,226,41,183,14,87,142,30,101,147,24,218,63,122,47,94,157,196,108,
+	213,46,125,6,250,106,25,163,201,100,38,137,236,195,28,164,100,136,59,113,249,19,41,160,69,201,91,213,153,1,58,148,235,169,215,100,67,28,253,201,139,37,207,74,231,116,195,82,137,55,199,251,65,191,48,176,196,99,165,201,235,75,39,140,
+	95,232,173,84,132,211,76,237,119,148,219,85,13,146,62,182,0,234,199,90,209,151,122,192,7,130,39,235,71,173,116,207,38,90,22,188,231,161,91,114,57,171,126,6,156,34,61,244,161,219,120,19,158,224,82,117,0,249,31,138,16,118,227,8,
+	61,113,28,197,58,156,43,186,63,21,165,181,51,213,123,252,78,157,28,169,47,74,232,94,246,169,109,186,137,32,241,76,185,141,56,118,4,131,184,14,221,242,99,188,255,107,174,8,102,31,77,180,108,11,134,235,69,153,86,216,53,178,148,205,
+	165,248,144,219,15,243,114,5,206,248,71,113,233,95,38,204,107,53,120,244,139,23,174,55,31,214,61,11,89,196,103,9,124,252,160,220,74,209,47,83,151,22,69,46,139,80,208,131,193,231,151,46,240,195,37,168,213,50,126,190,104,252,85,24,
+	192,74,41,102,180,86,139,172,98,131,34,197,5,154,174,17,143,189,215,8,103,221,198,118,146,84,156,255,220,53,165,210,64,31,194,102,36,149,247,192,124,211,161,201,14,221,52,24,89,60,128,210,90,64,147,98,18,179,242,21,70,160,43,132,
+	229,3,126,160,62,226,38,236,54,159,229,88,126,246,58,84,237,32,73,177,61,159,77,2,234,194,18,113,142,21,128,233,154,92,15,238,174,111,9,57,104,32,235,92,121,163,239,145,176,250,2,160,27,121,254,202,78,113,40,143,233,7,202,107,
+	91,176,237,209,18,120,200,13,81,214,20,149,44,191,111,210,165,96,137,240,123,37,251,95,129,42,172,71,205,178,80,43,112,222,137,51,85,214,136,232,176,76,138,54,184,34,75,113,214,41,101,197,225,175,6,54,227,159,200,90,172,119,217,57,
+	33,151,51,82,185,147,104,162,187,116,64,177,217,75,27,128,3,223,44,200,12,212,148,182,63,225,101,241,34,97,249,8,200,179,74,161,193,26,68,159,17,195,244,0,226,101,199,10,64,166,125,72,44,106,141,186,125,16,62,220,29,79,138,183,
+	254,121,100,25,246,46,70,239,40,140,255,99,8,138,242,179,68,154,114,84,169,104,52,17,200,152,24,133,60,192,159,131,61,35,243,0,114,255,98,223,45,94,118,148,67,157,248,137,191,230,21,245,154,83,236,33,93,242,140,104,190,49,230,19,
+	72,189,221,170,135,216,0,203,95,15,197,51,161,224,89,48,202,253,29,191,65,227,135,245,115,82,211,167,232,18,108,227,171,95,127,202,150,38,180,122,151,209,28,175,213,23,50,94,32,79,142,178,10,218,61,165,206,45,170,1,247,156,98,164,
+	44,139,6,64,112,80,165,122,152,67,233,128,189,33,117,146,16,100,134,217,20,161,89,39,175,55,3,113,88,150,49,77,212,22,230,56,84,216,62,5,78,249,56,85,106,132,181,223,163,109,203,56,119,192,134,13,114,77,225,118,69,130,11,208,
+	243,90,202,236,30,190,250,27,214,172,86,23,107,70,205,229,171,78,180,48,117,234,9,204,145,238,184,220,36,204,246,5,136,162,104,186,13,131,240,205,164,125,186,225,8,243,75,123,3,255,39,96,238,30,99,184,253,148,28,196,215,38,180,111,
+	152,19,118,159,50,145,91,58,110,40,220,149,249,175,6,58,127,36,244,147,74,185,128,62,99,26,75,131,62,172,117,91,196,65,35,250,169,93,146,35,103,17,42,143,200,158,34,215,60,183,136,210,70,160,216,40,65,177,100,55,162,88,222,58,
+	194,227,68,181,101,219,8,229,185,132,11,192,43,85,155,238,92,194,0,221,98,29,252,167,213,117,157,250,11,143,188,33,238,151,214,116,52,23,182,75,195,236,170,70,112,53,98,195,146,81,23,172,5,138,86,231,125,6,239,143,21,251,136,27,
+	81,127,38,242,18,200,129,158,75,246,95,66,124,216,109,20,212,158,113,60,199,151,44,81,7,230,48,192,103,76,228,57,111,20,79,140,202,237,120,227,48,137,87,253,22,227,170,14,234,108,219,122,246,49,199,24,156,209,82,116,187,68,105,170,
+	2,212,166,87,142,64,105,46,23,165,203,142,239,29,186,140,46,72,177,137,13,226,110,190,139,175,90,31,218,164,17,131,181,224,171,12,101,67,152,11,109,214,1,130,181,119,69,131,44,164,29,74,185,95,167,112,73,184,45,228,10,206,42,238,
+	141,53,110,191,33,253,174,232,211,115,41,2,173,56,76,254,102,227,28,247,90,164,59,239,20,67,203,149,120,50,202,255,67,95,48,247,188,38,218,172,65,185,157,59,219,37,242,204,88,250,54,202,147,18,233,55,244,17,134,166,91,150,117,183,
+	94,248,14,222,159,83,6,138,91,63,226,155,100,211,121,166,8,200,128,50,212,35,125,208,98,132,248,0,235,83,146,105,4,162,204,122,155,88,134,28,248,98,32,201,103,82,155,4,188,141,100,228,117,42,206,127,153,102,216,57,249,32,220,62,
+	194,154,72,129,51,203,119,183,19,194,130,78,235,16,191,37,148,83,182,106,149,187,81,26,170,42,110,61,174,28,194,42,215,138,32,72,7,238,52,206,126,77,230,140,19,125,178,62,115,25,168,9,69,179,88,4,189,80,27,198,129,74,168,22,
+	119,41,229,176,104,29,239,53,152,245,27,177,48,145,92,219,55,244,18,68,231,3,255,141,226,189,158,214,97,225,121,168,81,245,115,226,170,196,111,162,13,194,49,168,251,206,33,237,215,76,196,241,137,216,157,252,40,233,163,107,8,189,99,233,
+	5,201,89,20,214,142,79,217,104,72,121,204,108,250,69,124,169,109,207,135,43,173,96,50,74,9,86,34,139,11,69,237,22,185,58,98,139,25,69,92,234,150,107,5,79,55,137,96,150,36,125,94,49,27,108,59,142,117,65,223,145,244,50,136,
+	63,169,147,251,65,190,163,0,171,43,230,8,160,31,197,3,235,32,158,87,198,114,156,211,124,236,198,118,252,187,150,48,102,154,14,211,44,253,181,215,34,61,182,221,118,188,229,11,172,253,60,221,163,193,82,225,202,12,185,46,87,29,157,210,
+	241,102,45,127,13,112,38,128,255,192,144,96,59,227,135,178,96,64,222,9,244,65,17,182,31,147,60,173,45,81,218,129,201,233,123,178,86,153,1,133,114,248,89,145,25,161,87,47,111,186,22,145,0,243,130,20,171,97,249,127,206,179,114,82,
+	187,28,224,198,85,238,206,93,60,19,80,218,187,111,81,44,204,141,117,184,38,140,225,89,246,107,13,226,96,24,169,2,63,83,35,225,61,104,203,50,167,12,196,42,244,66,199,135,214,71,103,206,118,66,184,47,136,70,33,165,1,70,235,15,
+	120,144,71,175,154,54,140,183,226,157,124,35,167,12,239,155,19,253,50,160,97,201,121,46,165,77,207,153,127,240,109,193,245,174,145,10,191,126,239,80,223,140,73,126,212,102,5,239,30,165,233,84,173,32,95,204,233,158,213,103,226,142,47,163,
+	57,248,3,108,31,220,9,76,32,104,203,248,52,129,208,72,105,193,84,15,234,71,175,3,219,118,34,68,196,49,144,30,95,45,109,249,163,21,37,176,99,27,236,169,20,180,152,115,58,143,12,48,218,155,255,112,15,88,55,122,25,192,93,217,
+	195,83,208,133,244,99,168,121,242,177,7,70,149,95,177,32,226,123,171,212,133,30,251,61,143,189,243,174,6,231,78,162,223,135,210,67,91,222,139,65,206,160,52,111,89,45,228,78,193,250,123,197,133,6,73,147,41,196,246,180,76,237,128,32,
+	105,154,43,181,66,197,37,216,55,139,90,222,197,16,244,56,144,1,66,42,102,194,156,111,86,16,52,134,88,117,202,60,8,189,25,156,51,198,110,251,10,123,217,189,254,141,204,14,175,35,72,101,239,56,190,224,172,132,9,150,44,159,8,174,
+	229,13,220,92,18,126,155,83,192,25,164,119,41,110,160,87,215,181,247,149,229,81,18,210,234,166,105,212,154,37,176,248,122,79,103,240,124,4,182,46,152,87,33,76,3,62,128,92,109,220,167,20,179,91,121,26,101,69,228,93,214,110,254,74,
+};
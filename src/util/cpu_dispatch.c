@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: Unlicense
+
+#include "cpu_dispatch.h"
+
+#include "../platform.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if KERNELS_X86 && defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+static const char* kIsaNames[kIsaCount] = { "scalar", "sse2", "avx2", "neon" };
+
+int g_kernel_isa_max = kIsaCount - 1;
+
+static bool s_isa_supported[kIsaCount];
+
+#define MAX_KERNEL_SLOTS 16
+static KernelSlot* s_slots[MAX_KERNEL_SLOTS];
+static int s_slot_count;
+
+static void detect_cpu_features()
+{
+	s_isa_supported[kIsaScalar] = true;
+#if KERNELS_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+	int regs[4];
+	__cpuid(regs, 1);
+	s_isa_supported[kIsaSSE2] = (regs[3] & (1 << 26)) != 0;
+	// AVX2 also needs the OS to save the ymm registers
+	bool os_ymm = (regs[2] & (1 << 27)) && (regs[2] & (1 << 28)) && ((_xgetbv(0) & 6) == 6);
+	__cpuidex(regs, 7, 0);
+	s_isa_supported[kIsaAVX2] = os_ymm && (regs[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	s_isa_supported[kIsaSSE2] = __builtin_cpu_supports("sse2");
+	s_isa_supported[kIsaAVX2] = __builtin_cpu_supports("avx2");
+#endif
+#endif
+#if KERNELS_NEON
+	s_isa_supported[kIsaNEON] = true; // baseline on arm64
+#endif
+}
+
+void kernels_init()
+{
+	detect_cpu_features();
+
+#if defined(BUILD_PLATFORM_PC)
+	const char* limit = getenv("CTW_KERNELS");
+	if (limit != NULL)
+	{
+		for (int i = 0; i < kIsaCount; ++i)
+		{
+			if (strcmp(limit, kIsaNames[i]) == 0)
+				g_kernel_isa_max = i;
+		}
+	}
+#endif
+
+	char line[64] = "";
+	int best = kIsaScalar;
+	for (int i = 0; i < kIsaCount; ++i)
+	{
+		if (!s_isa_supported[i])
+			continue;
+		strcat(line, " ");
+		strcat(line, kIsaNames[i]);
+		if (i <= g_kernel_isa_max)
+			best = i;
+	}
+	plat_sys_log("kernels: cpu has%s, using up to %s", line, kIsaNames[best]);
+}
+
+bool kernels_isa_supported(KernelIsa isa)
+{
+	return s_isa_supported[isa];
+}
+
+static void kernel_bind(KernelSlot* slot)
+{
+	int best = 0;
+	for (int i = 1; i < KERNEL_MAX_VARIANTS && slot->variants[i].func != NULL; ++i)
+	{
+		KernelIsa isa = slot->variants[i].isa;
+		if (s_isa_supported[isa] && (int)isa <= g_kernel_isa_max && isa > slot->variants[best].isa)
+			best = i;
+	}
+	atomic_store_explicit(&slot->bound, slot->variants[best].func, memory_order_relaxed);
+	slot->bound_isa = slot->variants[best].isa;
+}
+
+void kernels_register(KernelSlot* slot)
+{
+	if (s_slot_count >= MAX_KERNEL_SLOTS)
+	{
+		plat_sys_log_error("kernels: too many slots, %s stays scalar", slot->name);
+		atomic_store_explicit(&slot->bound, slot->variants[0].func, memory_order_relaxed);
+		slot->bound_isa = kIsaScalar;
+		return;
+	}
+	s_slots[s_slot_count++] = slot;
+	kernel_bind(slot);
+	plat_sys_log("kernels: %s -> %s", slot->name, kIsaNames[slot->bound_isa]);
+}
+
+void kernels_bind_all()
+{
+	for (int i = 0; i < s_slot_count; ++i)
+		kernel_bind(s_slots[i]);
+}
@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: Unlicense
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Runtime selection of SIMD kernel variants on PC builds. A module keeps a KernelSlot for each hot
+// kernel, listing the variants it has, and calls through the bound one. Binding picks the best
+// variant that the CPU supports and that is not above g_kernel_isa_max; the CTW_KERNELS environment
+// variable (scalar, sse2, avx2, neon) lowers that limit, e.g. to compare variants in benchmark mode.
+
+typedef enum KernelIsa {
+	kIsaScalar,
+	kIsaSSE2,
+	kIsaAVX2,
+	kIsaNEON,
+	kIsaCount
+} KernelIsa;
+
+// Playdate builds (device and simulator) only have the scalar kernels, so that the simulator runs
+// the same code as the device.
+#if defined(BUILD_PLATFORM_PC) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#define KERNELS_X86 1
+#else
+#define KERNELS_X86 0
+#endif
+
+#if defined(BUILD_PLATFORM_PC) && (defined(__aarch64__) || defined(_M_ARM64))
+#define KERNELS_NEON 1
+#else
+#define KERNELS_NEON 0
+#endif
+
+// functions using intrinsics of an instruction set that the whole build is not compiled for
+#if defined(_MSC_VER) && !defined(__clang__)
+#define KERNEL_TARGET(isa)
+#else
+#define KERNEL_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+typedef void (*KernelFunc)(void);
+
+typedef struct KernelVariant {
+	KernelIsa isa;
+	KernelFunc func;
+} KernelVariant;
+
+#define KERNEL_MAX_VARIANTS 4
+
+typedef struct KernelSlot {
+	const char* name;
+	KernelVariant variants[KERNEL_MAX_VARIANTS]; // scalar one first; unused entries have NULL func
+	_Atomic(KernelFunc) bound; // rebinding can happen while the audio thread calls through it
+	KernelIsa bound_isa;
+} KernelSlot;
+
+static inline KernelFunc kernel_bound(KernelSlot* slot)
+{
+	return atomic_load_explicit(&slot->bound, memory_order_relaxed);
+}
+
+extern int g_kernel_isa_max; // KernelIsa
+
+// detects CPU features and reads CTW_KERNELS; call before any kernels_register
+void kernels_init();
+bool kernels_isa_supported(KernelIsa isa);
+// adds the slot to the registry and binds it
+void kernels_register(KernelSlot* slot);
+// rebinds all registered slots, e.g. after g_kernel_isa_max changed
+void kernels_bind_all();
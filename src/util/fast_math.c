@@ -0,0 +1,159 @@
+// SPDX-License-Identifier: Unlicense
+
+#include "fast_math.h"
+#include "perf_stats.h"
+#include "../platform.h"
+
+float g_sin_table[SIN_TABLE_SIZE + 1];
+
+void fast_math_init()
+{
+	for (int i = 0; i <= SIN_TABLE_SIZE; ++i)
+		g_sin_table[i] = sinf(i * (2.0f * M_PIf / SIN_TABLE_SIZE));
+}
+
+#if BENCHMARK_MODE
+
+#define REPORT_INPUT_COUNT (4096)
+#define REPORT_TIMING_PASSES (256)
+
+typedef float (*UnaryFunc)(float);
+typedef float (*TimingFunc)();
+
+static float s_inputs[REPORT_INPUT_COUNT];
+
+// timing loop with the function inlined, nanoseconds per call
+#define DEFINE_TIMING(func) \
+	static float time_##func() \
+	{ \
+		volatile float sink = 0.0f; \
+		float t0 = plat_time_get(); \
+		for (int pass = 0; pass < REPORT_TIMING_PASSES; ++pass) \
+		{ \
+			float sum = 0.0f; \
+			for (int i = 0; i < REPORT_INPUT_COUNT; ++i) \
+				sum += func(s_inputs[i]); \
+			sink += sum; \
+		} \
+		float t1 = plat_time_get(); \
+		(void)sink; \
+		return (t1 - t0) * 1.0e9f / (REPORT_TIMING_PASSES * REPORT_INPUT_COUNT); \
+	}
+
+static float ref_rsqrtf(float v) { return 1.0f / sqrtf(v); }
+static float ref_rcpf(float v) { return 1.0f / v; }
+static double exact_rsqrt(double v) { return 1.0 / sqrt(v); }
+static double exact_rcp(double v) { return 1.0 / v; }
+static double exact_fract(double v) { return v - floor(v); }
+
+DEFINE_TIMING(sinf_poly)
+DEFINE_TIMING(cosf_poly)
+DEFINE_TIMING(sinf_table)
+DEFINE_TIMING(cosf_table)
+DEFINE_TIMING(floorf_fast)
+DEFINE_TIMING(ceilf_fast)
+DEFINE_TIMING(fract_fast)
+DEFINE_TIMING(rsqrtf_approx)
+DEFINE_TIMING(rcpf_approx)
+DEFINE_TIMING(sinf)
+DEFINE_TIMING(cosf)
+DEFINE_TIMING(floorf)
+DEFINE_TIMING(ceilf)
+DEFINE_TIMING(fract)
+DEFINE_TIMING(ref_rsqrtf)
+DEFINE_TIMING(ref_rcpf)
+
+typedef struct FastMathCase {
+	const char* name;
+	UnaryFunc func;
+	TimingFunc time_func, time_ref;
+	double (*exact)(double);
+	float range_min, range_max;
+	bool relative;
+} FastMathCase;
+
+static const FastMathCase kCases[] = {
+	{"sinf_poly", sinf_poly, time_sinf_poly, time_sinf, sin, -1000.0f, 1000.0f, false},
+	{"cosf_poly", cosf_poly, time_cosf_poly, time_cosf, cos, -1000.0f, 1000.0f, false},
+	{"sinf_table", sinf_table, time_sinf_table, time_sinf, sin, -100.0f, 100.0f, false},
+	{"cosf_table", cosf_table, time_cosf_table, time_cosf, cos, -100.0f, 100.0f, false},
+	{"sinf_table", sinf_table, time_sinf_table, time_sinf, sin, -1000.0f, 1000.0f, false},
+	{"cosf_table", cosf_table, time_cosf_table, time_cosf, cos, -1000.0f, 1000.0f, false},
+	{"floorf_fast", floorf_fast, time_floorf_fast, time_floorf, floor, -1000.0f, 1000.0f, false},
+	{"ceilf_fast", ceilf_fast, time_ceilf_fast, time_ceilf, ceil, -1000.0f, 1000.0f, false},
+	{"fract_fast", fract_fast, time_fract_fast, time_fract, exact_fract, -1000.0f, 1000.0f, false},
+	{"rsqrtf_approx", rsqrtf_approx, time_rsqrtf_approx, time_ref_rsqrtf, exact_rsqrt, 0.001f, 1000.0f, true},
+	{"rcpf_approx", rcpf_approx, time_rcpf_approx, time_ref_rcpf, exact_rcp, 0.001f, 1000.0f, true},
+};
+#define CASE_COUNT (sizeof(kCases)/sizeof(kCases[0]))
+
+// v3_normalize_fast: max error of the result components (relative to unit length), against
+// v3_normalize; inputs have random directions and lengths in [0.001..1000]
+static void report_normalize(uint32_t* rng)
+{
+	float3 inputs[REPORT_INPUT_COUNT];
+	double max_err = 0.0;
+	for (int i = 0; i < REPORT_INPUT_COUNT; ++i)
+	{
+		float3 dir = { RandomFloat01(rng) * 2.0f - 1.0f, RandomFloat01(rng) * 2.0f - 1.0f, RandomFloat01(rng) * 2.0f - 1.0f };
+		float len = sqrtf(v3_dot(dir, dir));
+		if (len < 0.01f)
+			dir = (float3){ 1.0f, 0.0f, 0.0f }, len = 1.0f;
+		inputs[i] = v3_mulfl(dir, (0.001f + 999.999f * RandomFloat01(rng)) / len);
+		float3 v = inputs[i];
+		double len_exact = sqrt((double)v.x * v.x + (double)v.y * v.y + (double)v.z * v.z);
+		float3 r = v3_normalize_fast(v);
+		max_err = MAX(max_err, fabs(r.x - v.x / len_exact));
+		max_err = MAX(max_err, fabs(r.y - v.y / len_exact));
+		max_err = MAX(max_err, fabs(r.z - v.z / len_exact));
+	}
+
+	float ns[2];
+	for (int variant = 0; variant < 2; ++variant)
+	{
+		volatile float sink = 0.0f;
+		float t0 = plat_time_get();
+		for (int pass = 0; pass < REPORT_TIMING_PASSES; ++pass)
+		{
+			float3 sum = { 0.0f, 0.0f, 0.0f };
+			for (int i = 0; i < REPORT_INPUT_COUNT; ++i)
+				sum = v3_add(sum, variant == 0 ? v3_normalize_fast(inputs[i]) : v3_normalize(inputs[i]));
+			sink += sum.x + sum.y + sum.z;
+		}
+		(void)sink;
+		ns[variant] = (plat_time_get() - t0) * 1.0e9f / (REPORT_TIMING_PASSES * REPORT_INPUT_COUNT);
+	}
+	plat_sys_log("fast math v3_normalize_fast [len 0.001..1000]: max abs err %.2e, %.2f ns/call (libm %.2f ns)", max_err, ns[0], ns[1]);
+}
+
+void fast_math_report()
+{
+	uint32_t rng = 1;
+	for (int ci = 0; ci < CASE_COUNT; ++ci)
+	{
+		const FastMathCase* c = &kCases[ci];
+		for (int i = 0; i < REPORT_INPUT_COUNT; ++i)
+			s_inputs[i] = c->range_min + (c->range_max - c->range_min) * RandomFloat01(&rng);
+
+		double max_err = 0.0;
+		for (int i = 0; i < REPORT_INPUT_COUNT; ++i)
+		{
+			double exact = c->exact(s_inputs[i]);
+			double scale = c->relative ? fabs(exact) : 1.0;
+			max_err = MAX(max_err, fabs(c->func(s_inputs[i]) - exact) / scale);
+		}
+		float ns = c->time_func();
+		float ns_ref = c->time_ref();
+		plat_sys_log("fast math %s [%g..%g]: max %s err %.2e, %.2f ns/call (libm %.2f ns)",
+			c->name, c->range_min, c->range_max, c->relative ? "rel" : "abs", max_err, ns, ns_ref);
+	}
+	report_normalize(&rng);
+}
+
+#else
+
+void fast_math_report()
+{
+}
+
+#endif
@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: Unlicense
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "../mathlib.h"
+
+// Approximations of libm functions. Nothing uses them implicitly; an effect calls them explicitly
+// at the places where it can live with the error. Max errors below are measured against libm
+// (double precision) by fast_math_report() over the stated input ranges.
+
+// Exact for |v| < 2^31 (same result as floorf/ceilf/fract), just without the libm call.
+static inline float floorf_fast(float v)
+{
+	int i = (int)v;
+	return (float)(i - (v < (float)i));
+}
+
+static inline float ceilf_fast(float v)
+{
+	int i = (int)v;
+	return (float)(i + (v > (float)i));
+}
+
+static inline float fract_fast(float v)
+{
+	return v - floorf_fast(v);
+}
+
+static inline float3 v3_fract_fast(float3 v)
+{
+	float3 r = { fract_fast(v.x), fract_fast(v.y), fract_fast(v.z) };
+	return r;
+}
+
+// Degree 7 odd minimax polynomial for sin on [-pi/2, pi/2].
+static inline float sinf_poly_kernel(float r)
+{
+	float r2 = r * r;
+	return r * (0.99999660f + r2 * (-0.16664824f + r2 * (0.00830629f + r2 * -0.00018363f)));
+}
+
+// x - n*pi, with pi split into two constants so that the reduction stays accurate
+static inline float reduce_pi(float x, float n)
+{
+	return (x - n * 3.140625f) - n * 9.67653589793e-4f;
+}
+
+static inline float round_to_int(float v)
+{
+	return (float)(int)(v + (v >= 0.0f ? 0.5f : -0.5f));
+}
+
+// Polynomial sin/cos. Max abs error 7e-7 for |x| < 1000.
+static inline float sinf_poly(float x)
+{
+	float n = round_to_int(x * (1.0f / M_PIf));
+	float s = sinf_poly_kernel(reduce_pi(x, n));
+	return ((int)n & 1) ? -s : s;
+}
+
+static inline float cosf_poly(float x)
+{
+	float n = round_to_int(x * (1.0f / M_PIf) + 0.5f);
+	float s = sinf_poly_kernel(reduce_pi(x, n) + M_PIf * 0.5f);
+	return ((int)n & 1) ? -s : s;
+}
+
+// 256 entries per period with linear interpolation. Max abs error 7.6e-5 for |x| < 100,
+// 1.2e-4 for |x| < 1000 (precision of the table position).
+#define SIN_TABLE_SIZE 256
+extern float g_sin_table[SIN_TABLE_SIZE + 1];
+
+static inline float sinf_table(float x)
+{
+	float u = x * (SIN_TABLE_SIZE / (2.0f * M_PIf));
+	float fl = floorf_fast(u);
+	float f = u - fl;
+	int idx = (int)fl & (SIN_TABLE_SIZE - 1);
+	return g_sin_table[idx] + (g_sin_table[idx + 1] - g_sin_table[idx]) * f;
+}
+
+static inline float cosf_table(float x)
+{
+	return sinf_table(x + M_PIf * 0.5f);
+}
+
+// Bit trick estimate plus one Newton step. Max rel error 1.8e-3 for positive normal floats.
+static inline float rsqrtf_approx(float v)
+{
+	uint32_t i;
+	memcpy(&i, &v, sizeof(i));
+	i = 0x5F375A86u - (i >> 1);
+	float r;
+	memcpy(&r, &i, sizeof(r));
+	return r * (1.5f - 0.5f * v * r * r);
+}
+
+// Bit trick estimate plus two Newton steps. Max rel error 7e-6 for normal floats.
+static inline float rcpf_approx(float v)
+{
+	uint32_t i;
+	memcpy(&i, &v, sizeof(i));
+	i = 0x7EF311C3u - i;
+	float r;
+	memcpy(&r, &i, sizeof(r));
+	r = r * (2.0f - v * r);
+	r = r * (2.0f - v * r);
+	return r;
+}
+
+// v3_normalize with rsqrtf_approx; same relative error as that.
+static inline float3 v3_normalize_fast(float3 v)
+{
+	float id = rsqrtf_approx(v.x * v.x + v.y * v.y + v.z * v.z);
+	float3 r = { v.x * id, v.y * id, v.z * id };
+	return r;
+}
+
+void fast_math_init();
+// Benchmark mode: logs max errors against libm and time per call of both.
+void fast_math_report();
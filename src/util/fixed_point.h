@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: Unlicense
+
+#pragma once
+
+#include <stdint.h>
+#include "../mathlib.h"
+
+// Q16.16 fixed point numbers: 16 integer bits (signed), 16 fractional bits.
+// fract() is just a mask (also for negative numbers, same as v - floor(v)).
+typedef int32_t fx32;
+
+typedef struct fx3 {
+	fx32 x, y, z;
+} fx3;
+
+#define FX_SHIFT 16
+#define FX_ONE (1 << FX_SHIFT)
+#define FX_HALF (1 << (FX_SHIFT - 1))
+#define FX_FRACT_MASK (FX_ONE - 1)
+// compile time constant from a float literal
+#define FX_CONST(v) ((fx32)((v) * (float)FX_ONE + ((v) >= 0 ? 0.5f : -0.5f)))
+
+static inline fx32 fx_from_float(float v)
+{
+	return (fx32)(v * (float)FX_ONE);
+}
+
+static inline float fx_to_float(fx32 v)
+{
+	return (float)v * (1.0f / FX_ONE);
+}
+
+static inline fx32 fx_mul(fx32 a, fx32 b)
+{
+	return (fx32)(((int64_t)a * b) >> FX_SHIFT);
+}
+
+// product of two values that are both below 0.7 in magnitude, without going to 64 bits
+static inline fx32 fx_mul_small(fx32 a, fx32 b)
+{
+	return (a * b) >> FX_SHIFT;
+}
+
+static inline fx32 fx_fract(fx32 v)
+{
+	return v & FX_FRACT_MASK;
+}
+
+static inline fx32 fx_abs(fx32 v)
+{
+	return v < 0 ? -v : v;
+}
+
+static inline fx3 fx3_from_float3(float3 v)
+{
+	return (fx3){ fx_from_float(v.x), fx_from_float(v.y), fx_from_float(v.z) };
+}
+
+static inline fx3 fx3_add(fx3 a, fx3 b)
+{
+	return (fx3){ a.x + b.x, a.y + b.y, a.z + b.z };
+}
+
+static inline fx3 fx3_mul(fx3 a, fx32 b)
+{
+	return (fx3){ fx_mul(a.x, b), fx_mul(a.y, b), fx_mul(a.z, b) };
+}
+
+// fract(v) - 0.5 in each component
+static inline fx3 fx3_fract_centered(fx3 v)
+{
+	return (fx3){ fx_fract(v.x) - FX_HALF, fx_fract(v.y) - FX_HALF, fx_fract(v.z) - FX_HALF };
+}
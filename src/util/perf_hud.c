@@ -0,0 +1,340 @@
+// SPDX-License-Identifier: Unlicense
+
+#include "perf_hud.h"
+
+#include "audio_telemetry.h"
+#include "perf_stats.h"
+#include "../mathlib.h"
+
+#include <string.h>
+
+#define HUD_WIDTH (128) // pixels, multiple of 32
+#define HUD_CELL_W (4)
+#define HUD_CELL_H (6)
+#define HUD_LINE_COUNT (4)
+#define HUD_LINE_CHARS (HUD_WIDTH / HUD_CELL_W)
+#define HUD_GRAPH_Y (HUD_LINE_COUNT * HUD_CELL_H + 2)
+#define HUD_GRAPH_H (24)
+#define HUD_HEIGHT (HUD_GRAPH_Y + HUD_GRAPH_H + 1)
+#define HUD_GRAPH_MS_PER_PIXEL (2.0f)
+#define HUD_TARGET_FRAME_MS (1000.0f / 30.0f) // dotted line in the graph
+#define HUD_FPS_FRAMES (30) // frame time and FPS are averaged over this many frames
+#define HUD_SMOOTHING (0.1f) // per frame, for the stage times
+#define HUD_AUDIO_INTERVAL (0.5f) // seconds between audio load updates
+
+// 3x5 pixel glyphs for ' ' to '_' (lowercase letters use the uppercase ones): 5 rows of 3 bits,
+// top row in the highest bits
+static const uint16_t kFontGlyphs[64] = {
+	0x0000, 0x2482, 0x5A00, 0x5F7D, 0x3C9E, 0x42A1, 0x2AAB, 0x2400,
+	0x1491, 0x4494, 0x0AA8, 0x05D0, 0x0014, 0x01C0, 0x0002, 0x12A4,
+	0x7B6F, 0x2C97, 0x62A7, 0x628E, 0x5BC9, 0x798E, 0x39EF, 0x7292,
+	0x7BEF, 0x7BCE, 0x0410, 0x0414, 0x1511, 0x0E38, 0x4454, 0x6282,
+	0x2BE3, 0x2BED, 0x6BAE, 0x3923, 0x6B6E, 0x79A7, 0x79A4, 0x396B,
+	0x5BED, 0x7497, 0x126A, 0x5BAD, 0x4927, 0x5FED, 0x6B6D, 0x2B6A,
+	0x6BA4, 0x2B7B, 0x6BAD, 0x388E, 0x7492, 0x5B6F, 0x5B52, 0x5BFD,
+	0x5AAD, 0x5A92, 0x72A7, 0x6926, 0x4889, 0x324B, 0x2A00, 0x0007,
+};
+
+// glyph rows as the nibbles of their cells: empty column on the left, empty row at the bottom
+static uint8_t s_atlas[64][HUD_CELL_H];
+
+bool g_hud_visible;
+static bool s_was_visible;
+float g_hud_stage_seconds[kHudStageCount];
+
+static float s_frame_start = -1.0f;
+static float s_frame_ms[HUD_WIDTH]; // ring buffer, newest at s_frame_pos - 1
+static int s_frame_pos;
+static int s_frame_filled;
+static float s_stage_ms[kHudStageCount]; // smoothed
+static bool s_stage_valid;
+static float s_hud_ms;
+
+static float s_audio_time = -1.0f;
+static double s_audio_cost;
+static float s_audio_load; // fraction of a core
+
+void hud_init()
+{
+	for (int c = 0; c < 64; ++c)
+	{
+		for (int y = 0; y < 5; ++y)
+			s_atlas[c][y] = (kFontGlyphs[c] >> ((4 - y) * 3)) & 7;
+		s_atlas[c][5] = 0;
+	}
+	plat_sys_add_menu_toggle("perf HUD", &g_hud_visible);
+}
+
+void hud_begin_frame(uint32_t buttons_cur, uint32_t buttons_pressed)
+{
+	const uint32_t combo = kPlatButtonLeft | kPlatButtonRight;
+	if ((buttons_cur & combo) == combo && (buttons_pressed & combo) != 0)
+		g_hud_visible = !g_hud_visible;
+	// toggled by the combo, or from the system menu
+	if (g_hud_visible != s_was_visible)
+	{
+		s_was_visible = g_hud_visible;
+		s_stage_valid = false;
+		memset(g_hud_stage_seconds, 0, sizeof(g_hud_stage_seconds));
+	}
+
+	// the timer goes back to zero when the music ends
+	float now = plat_time_get();
+	if (s_frame_start >= 0.0f && now > s_frame_start)
+	{
+		s_frame_ms[s_frame_pos] = (now - s_frame_start) * 1000.0f;
+		s_frame_pos = (s_frame_pos + 1) % HUD_WIDTH;
+		s_frame_filled = MIN(s_frame_filled + 1, HUD_WIDTH);
+	}
+	s_frame_start = now;
+
+	if (!g_hud_visible)
+		return;
+	for (int i = 0; i < kHudStageCount; ++i)
+	{
+		float ms = g_hud_stage_seconds[i] * 1000.0f;
+		s_stage_ms[i] = s_stage_valid ? s_stage_ms[i] + (ms - s_stage_ms[i]) * HUD_SMOOTHING : ms;
+		g_hud_stage_seconds[i] = 0.0f;
+	}
+	s_stage_valid = true;
+}
+
+static inline int glyph_index(char c)
+{
+	if (c >= 'a' && c <= 'z')
+		c -= 'a' - 'A';
+	if (c < ' ' || c > '_')
+		c = ' ';
+	return c - ' ';
+}
+
+void hud_draw_text(uint8_t* framebuffer, int x, int y, const char* text)
+{
+	int len = (int)strlen(text);
+	int max_chars = (SCREEN_X - x) / HUD_CELL_W;
+	if (len > max_chars)
+		len = max_chars;
+	uint8_t* dst = framebuffer + y * SCREEN_STRIDE_BYTES + x / 8;
+	for (int i = 0; i < len; i += 8, dst += 4)
+	{
+		const uint8_t* glyphs[8];
+		int n = len - i < 8 ? len - i : 8;
+		for (int k = 0; k < n; ++k)
+			glyphs[k] = s_atlas[glyph_index(text[i + k])];
+		int bytes = (n + 1) / 2;
+		for (int r = 0; r < HUD_CELL_H; ++r)
+		{
+			if (y + r < 0 || y + r >= SCREEN_Y)
+				continue;
+			// 8 cells of one pixel row, leftmost in the top nibble
+			uint32_t bits = 0;
+			for (int k = 0; k < n; ++k)
+				bits = (bits << 4) | glyphs[k][r];
+			bits <<= (8 - n) * 4;
+			uint8_t* row = dst + r * SCREEN_STRIDE_BYTES;
+			for (int b = 0; b < bytes; ++b)
+				row[b] &= ~(uint8_t)(bits >> (24 - b * 8));
+		}
+	}
+}
+
+// Line of HUD text, built without printf (no float formatting on device)
+typedef struct HudLine {
+	char text[HUD_LINE_CHARS + 1];
+	int len;
+} HudLine;
+
+static void line_str(HudLine* line, const char* s)
+{
+	while (*s && line->len < HUD_LINE_CHARS)
+		line->text[line->len++] = *s++;
+	line->text[line->len] = 0;
+}
+
+static void line_int(HudLine* line, int v)
+{
+	char buf[12];
+	int n = 0;
+	if (v < 0)
+	{
+		line_str(line, "-");
+		v = -v;
+	}
+	do
+	{
+		buf[n++] = (char)('0' + v % 10);
+		v /= 10;
+	} while (v > 0 && n < 11);
+	char s[12];
+	for (int i = 0; i < n; ++i)
+		s[i] = buf[n - 1 - i];
+	s[n] = 0;
+	line_str(line, s);
+}
+
+// non-negative value with a fixed number of decimals (up to 3)
+static void line_fixed(HudLine* line, float v, int decimals)
+{
+	static const int kScales[4] = { 1, 10, 100, 1000 };
+	int scale = kScales[decimals];
+	int scaled = (int)(MAX(v, 0.0f) * scale + 0.5f);
+	line_int(line, scaled / scale);
+	if (decimals == 0)
+		return;
+	line_str(line, ".");
+	int frac = scaled % scale;
+	for (int d = decimals - 1; d >= 0; --d)
+	{
+		char c[2] = { (char)('0' + frac / kScales[d] % 10), 0 };
+		line_str(line, c);
+	}
+}
+
+static void draw_line(uint8_t* framebuffer, int index, HudLine* line)
+{
+	hud_draw_text(framebuffer, 0, index * HUD_CELL_H + 1, line->text);
+	line->len = 0;
+	line->text[0] = 0;
+}
+
+static void update_audio_load(const AudioTelemetry* audio)
+{
+	float now = plat_time_get();
+	if (s_audio_time >= 0.0f && now >= s_audio_time && now - s_audio_time < HUD_AUDIO_INTERVAL)
+		return;
+	// statistics resets and timer resets start over
+	if (s_audio_time >= 0.0f && now > s_audio_time && audio->cost_sum >= s_audio_cost)
+		s_audio_load = (float)(audio->cost_sum - s_audio_cost) / (now - s_audio_time);
+	s_audio_time = now;
+	s_audio_cost = audio->cost_sum;
+}
+
+static void draw_graph(uint8_t* framebuffer, int y)
+{
+	uint8_t heights[HUD_WIDTH]; // oldest first
+	for (int i = 0; i < HUD_WIDTH; ++i)
+	{
+		float h = s_frame_ms[(s_frame_pos + i) % HUD_WIDTH] * (1.0f / HUD_GRAPH_MS_PER_PIXEL);
+		heights[i] = (uint8_t)MIN(h + 0.5f, (float)HUD_GRAPH_H);
+	}
+	int target_row = HUD_GRAPH_H - (int)(HUD_TARGET_FRAME_MS / HUD_GRAPH_MS_PER_PIXEL + 0.5f);
+	for (int r = 0; r < HUD_GRAPH_H; ++r)
+	{
+		uint8_t* row = framebuffer + (y + r) * SCREEN_STRIDE_BYTES;
+		int threshold = HUD_GRAPH_H - r;
+		uint8_t guide = r == target_row ? 0x55 : 0x00;
+		for (int b = 0; b < HUD_WIDTH / 8; ++b)
+		{
+			const uint8_t* h = heights + b * 8;
+			uint8_t bits = 0;
+			for (int k = 0; k < 8; ++k)
+				bits = (uint8_t)((bits << 1) | (h[k] >= threshold));
+			row[b] &= ~(bits | guide);
+		}
+	}
+}
+
+void hud_draw(uint8_t* framebuffer, const char* section, float time)
+{
+	if (!g_hud_visible)
+		return;
+	float t0 = plat_time_get();
+
+	for (int y = 0; y < HUD_HEIGHT; ++y)
+		memset(framebuffer + y * SCREEN_STRIDE_BYTES, 0xFF, HUD_WIDTH / 8);
+
+	HudLine line = { {0}, 0 };
+	line_str(&line, "t ");
+	line_fixed(&line, time, 1);
+	line_str(&line, " ");
+	line_str(&line, section ? section : "-");
+	draw_line(framebuffer, 0, &line);
+
+	int fps_frames = MIN(s_frame_filled, HUD_FPS_FRAMES);
+	float sum_ms = 0.0f, max_ms = 0.0f;
+	for (int i = 1; i <= fps_frames; ++i)
+	{
+		float ms = s_frame_ms[(s_frame_pos - i + HUD_WIDTH) % HUD_WIDTH];
+		sum_ms += ms;
+		max_ms = MAX(max_ms, ms);
+	}
+	float avg_ms = fps_frames > 0 ? sum_ms / fps_frames : 0.0f;
+	line_str(&line, "frame ");
+	line_fixed(&line, avg_ms, 1);
+	line_str(&line, "ms ");
+	line_fixed(&line, avg_ms > 0.0f ? 1000.0f / avg_ms : 0.0f, 0);
+	line_str(&line, "fps max ");
+	line_fixed(&line, max_ms, 1);
+	draw_line(framebuffer, 1, &line);
+
+	line_str(&line, "fx ");
+	line_fixed(&line, s_stage_ms[kHudStageEffect], 1);
+	line_str(&line, " dither ");
+	line_fixed(&line, s_stage_ms[kHudStageDither], 1);
+	line_str(&line, " ovl ");
+	line_fixed(&line, s_stage_ms[kHudStageOverlay], 1);
+	draw_line(framebuffer, 2, &line);
+
+	AudioTelemetry audio;
+	audio_telemetry_read(&audio);
+	line_str(&line, "audio ");
+	if (audio.callbacks > 0)
+	{
+		update_audio_load(&audio);
+		line_fixed(&line, s_audio_load * 100.0f, 1);
+		line_str(&line, "% u");
+		line_int(&line, (int)audio_telemetry_underruns(&audio));
+	}
+	else
+	{
+		line_str(&line, "-");
+	}
+	line_str(&line, " hud ");
+	line_fixed(&line, s_hud_ms, 2);
+	draw_line(framebuffer, 3, &line);
+
+	draw_graph(framebuffer, HUD_GRAPH_Y);
+
+	float ms = (plat_time_get() - t0) * 1000.0f;
+	s_hud_ms = s_hud_ms > 0.0f ? s_hud_ms + (ms - s_hud_ms) * HUD_SMOOTHING : ms;
+}
+
+#if BENCHMARK_MODE
+
+#define REPORT_FRAMES (1000)
+
+void hud_report()
+{
+	static uint8_t framebuffer[SCREEN_Y * SCREEN_STRIDE_BYTES];
+	bool visible = g_hud_visible;
+	g_hud_visible = true;
+
+	float t0 = plat_time_get();
+	for (int i = 0; i < REPORT_FRAMES; ++i)
+		hud_draw(framebuffer, "raymarch: 4 scenes rotating", 123.4f);
+	float draw_seconds = plat_time_get() - t0;
+
+	t0 = plat_time_get();
+	for (int i = 0; i < REPORT_FRAMES; ++i)
+	{
+		float st = hud_stage_begin();
+		hud_stage_end(kHudStageOverlay, st);
+	}
+	float stage_seconds = plat_time_get() - t0;
+
+	float draw_us = draw_seconds * 1.0e6f / REPORT_FRAMES;
+	plat_sys_log("perf hud: draw %.1f us per frame (%.3f%% of a 30FPS frame); stage timer %.2f us per stage",
+		draw_us, draw_us / (1.0e6f / 30.0f) * 100.0f, stage_seconds * 1.0e6f / REPORT_FRAMES);
+
+	g_hud_visible = visible;
+	memset(g_hud_stage_seconds, 0, sizeof(g_hud_stage_seconds));
+	s_hud_ms = 0.0f;
+}
+
+#else
+
+void hud_report()
+{
+}
+
+#endif
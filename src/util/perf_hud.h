@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: Unlicense
+
+#pragma once
+
+#include "../platform.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Performance HUD drawn over the top left corner of the screen: current section, frame time and
+// FPS, per stage milliseconds (smoothed), audio callback load and underruns (PC), its own cost,
+// and a graph of the recent frame times. Holding Left and Right together toggles it; the Playdate
+// D-pad can not press both, so there it is the "perf HUD" item of the system menu.
+//
+// Text uses a 3x5 pixel font in 4x6 cells, blitted 8 glyphs (32 pixels) at a time, so text starts
+// at byte aligned x positions.
+
+typedef enum HudStage {
+	kHudStageEffect, // whole effect update, dithering included
+	kHudStageDither,
+	kHudStageOverlay,
+	kHudStageCount
+} HudStage;
+
+extern bool g_hud_visible;
+extern float g_hud_stage_seconds[kHudStageCount]; // this frame so far
+
+// stage timing; only reads the timer while the HUD is visible
+static inline float hud_stage_begin()
+{
+	return g_hud_visible ? plat_time_get() : 0.0f;
+}
+static inline void hud_stage_end(HudStage stage, float t0)
+{
+	if (g_hud_visible)
+		g_hud_stage_seconds[stage] += plat_time_get() - t0;
+}
+
+void hud_init();
+// start of a frame: toggle combo (or menu), frame time of the previous frame
+void hud_begin_frame(uint32_t buttons_cur, uint32_t buttons_pressed);
+// end of a frame: draws the HUD if visible; section is the name of the current effect or part,
+// time is in beats
+void hud_draw(uint8_t* framebuffer, const char* section, float time);
+
+// black text on what is already there; x must be a multiple of 8
+void hud_draw_text(uint8_t* framebuffer, int x, int y, const char* text);
+
+// Benchmark mode: logs the cost of drawing the HUD and of the stage timers.
+void hud_report();
@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: Unlicense
+
+#include "perf_stats.h"
+
+#include "../platform.h"
+
+#include <string.h>
+
+#if BENCHMARK_MODE
+
+typedef struct PerfCounterDesc {
+	const char* name;
+	int per; // counter to normalize by, or kPerFrame / kPerSecond
+} PerfCounterDesc;
+
+enum {
+	kPerFrame = -1,
+	kPerSecond = -2, // of frame time
+};
+
+static const PerfCounterDesc kCounterDescs[kPerfCounterCount] = {
+	{"xor rays/frame", kPerFrame},
+	{"xor steps/ray", kPerfXorRays},
+	{"puls rays/frame", kPerFrame},
+	{"puls steps/ray", kPerfPulsRays},
+	{"puls warm starts/ray", kPerfPulsRays},
+	{"puls warm start fallbacks/ray", kPerfPulsRays},
+	{"march rays/frame", kPerFrame},
+	{"march steps/ray", kPerfMarchRays},
+	{"march cone prepass steps/ray", kPerfMarchRays},
+	{"fixed vs float: compared rays/frame", kPerFrame},
+	{"fixed vs float: mean abs diff", kPerfFixedCompareRays},
+	{"fixed vs float: differing rays", kPerfFixedCompareRays},
+	{"fixed vs float: rays off by more than 16", kPerfFixedCompareRays},
+	{"plasma object pixels/frame", kPerFrame},
+	{"dithered pixels/frame", kPerFrame},
+	{"dither: flat run pixels/dithered pixel", kPerfDitherPixels},
+	{"dither: run cache lookups/frame", kPerFrame},
+	{"dither: run cache misses/lookup", kPerfDitherRunLookups},
+	{"mesh triangles submitted/frame", kPerFrame},
+	{"mesh culled/submitted triangle", kPerfMeshSubmitted},
+	{"mesh triangles drawn/second", kPerSecond},
+	{"mesh fully occluded/drawn triangle", kPerfMeshDrawn},
+	{"mesh rasterized pixels/frame", kPerFrame},
+	{"mesh written/rasterized pixel", kPerfMeshRasterized},
+	{"line segments/second", kPerSecond},
+};
+
+uint32_t g_perf_counters[kPerfCounterCount];
+
+void perf_counters_reset()
+{
+	memset(g_perf_counters, 0, sizeof(g_perf_counters));
+}
+
+void perf_counters_log(int frame_count, float seconds)
+{
+	for (int i = 0; i < kPerfCounterCount; ++i)
+	{
+		if (g_perf_counters[i] == 0)
+			continue;
+		int per = kCounterDescs[i].per;
+		double div = per == kPerFrame ? frame_count : per == kPerSecond ? seconds : g_perf_counters[per];
+		if (div <= 0.0)
+			continue;
+		plat_sys_log("  %s: %.2f", kCounterDescs[i].name, (double)g_perf_counters[i] / div);
+	}
+}
+
+#else
+
+void perf_counters_reset()
+{
+}
+
+void perf_counters_log(int frame_count, float seconds)
+{
+}
+
+#endif
@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: Unlicense
+
+#pragma once
+
+#include <stdint.h>
+
+// Benchmark mode: instead of playing the demo, main.c runs through the effect timeline
+// at a fixed (simulated) 30FPS without music, and logs frame times and effect counters
+// for each benchmark variant. Can also be set from the build, e.g. -DBENCHMARK_MODE=1.
+#ifndef BENCHMARK_MODE
+#define BENCHMARK_MODE 0
+#endif
+
+typedef enum PerfCounter {
+	kPerfXorRays,
+	kPerfXorSteps,
+	kPerfPulsRays,
+	kPerfPulsSteps,
+	kPerfPulsWarmStarts,
+	kPerfPulsWarmFallbacks,
+	kPerfMarchRays,
+	kPerfMarchSteps,
+	kPerfConeSteps,
+	kPerfFixedCompareRays,
+	kPerfFixedAbsDiff,
+	kPerfFixedDiffRays,
+	kPerfFixedBigDiffRays,
+	kPerfPlasmaObjPixels,
+	kPerfDitherPixels,
+	kPerfDitherRunPixels,
+	kPerfDitherRunLookups,
+	kPerfDitherRunMisses,
+	kPerfMeshSubmitted,
+	kPerfMeshCulled,
+	kPerfMeshDrawn,
+	kPerfMeshOccluded,
+	kPerfMeshRasterized,
+	kPerfMeshWritten,
+	kPerfLineSegments,
+	kPerfCounterCount
+} PerfCounter;
+
+#if BENCHMARK_MODE
+extern uint32_t g_perf_counters[kPerfCounterCount];
+#define PERF_COUNT(counter, n) (g_perf_counters[counter] += (uint32_t)(n))
+#else
+#define PERF_COUNT(counter, n) ((void)0)
+#endif
+
+void perf_counters_reset();
+// logs counters that were hit, each normalized by its own "per" counter (or per frame, or per
+// second of frame time)
+void perf_counters_log(int frame_count, float seconds);
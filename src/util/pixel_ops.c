@@ -1,7 +1,10 @@
 // SPDX-License-Identifier: Unlicense
 
 #include "pixel_ops.h"
-#include "image_loader.h"
+#include "blue_noise_tile.h"
+#include "cpu_dispatch.h"
+#include "perf_hud.h"
+#include "perf_stats.h"
 
 #include "../globals.h"
 #include "../mathlib.h"
@@ -10,8 +13,38 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 
-static uint8_t* s_blue_noise;
+#if KERNELS_X86
+#include <immintrin.h>
+#endif
+#if KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+// A value dithers to black when it is <= the threshold of its pixel: blue noise tile remapped
+// through the current tone curve (bias or tone LUT), per noise level the highest value that is
+// still black (-1 if none). Rows are stored twice in a row, so that any run of up to
+// BLUE_NOISE_TILE_SIZE pixels starting within the tile is contiguous.
+#define NOISE_MASK (BLUE_NOISE_TILE_SIZE - 1)
+static int16_t s_threshold_rows[BLUE_NOISE_TILE_SIZE][BLUE_NOISE_TILE_SIZE * 2];
+static int16_t s_thresholds[256];
+static uint8_t s_threshold_invert; // 0xFF when the tone curve is decreasing: below threshold is white
+static int s_threshold_bias = INT_MIN; // bias the thresholds were built from, INT_MIN if from a tone LUT
+static uint8_t s_threshold_gen = 1; // bumped whenever the thresholds change; never 0
+
+// Flat runs: 1-bit rows of a single value against one noise row (bit 63 is tile x 0, without
+// the invert), computed on first use after the thresholds changed. A 64 pixel row repeats every
+// 8 bytes, so a byte aligned run of any length is a rotate plus stores.
+// The cache is direct mapped on the noise row and the low bits of the value, so it only keeps
+// the values in use (20KB instead of a slot for every value and row).
+int g_dither_runs = 1;
+#define DITHER_RUN_BLOCK 16 // run granularity in pixels; also the kernel granularity
+#define DITHER_RUN_CACHE_VALUE_BITS 5
+#define DITHER_RUN_CACHE_SIZE (BLUE_NOISE_TILE_SIZE << DITHER_RUN_CACHE_VALUE_BITS)
+static uint64_t s_run_patterns[DITHER_RUN_CACHE_SIZE];
+static uint8_t s_run_values[DITHER_RUN_CACHE_SIZE];
+static uint8_t s_run_gens[DITHER_RUN_CACHE_SIZE]; // s_threshold_gen of the entry, 0 if none
 
 uint8_t g_screen_buffer[SCREEN_X * SCREEN_Y];
 uint8_t g_screen_buffer_2x2sml[SCREEN_X/2 * SCREEN_Y/2];
@@ -102,51 +135,342 @@ int g_order_pattern_4x4[16][4] = {
 	{4, 0, 0, 0},
 };
 
-void init_pixel_ops()
+// Dithers count (multiple of DITHER_RUN_BLOCK) values of a row against a threshold row
+// (s_threshold_rows layout, first value at noise_x of it), into count/8 bytes of dst (leftmost
+// pixel in the top bit, set bit is white), xor-ed with invert.
+typedef void (*DitherRowFunc)(const uint8_t* values, const int16_t* thresholds, int noise_x, uint8_t invert, uint8_t* dst, int count);
+
+static void dither_row_scalar(const uint8_t* values, const int16_t* thresholds, int noise_x, uint8_t invert, uint8_t* dst, int count)
 {
-	int bn_w, bn_h;
-	s_blue_noise = read_tga_file_grayscale("BlueNoise.tga", &bn_w, &bn_h);
-	if (bn_w != SCREEN_X || bn_h != SCREEN_Y) {
-		plat_free(s_blue_noise);
-		s_blue_noise = NULL;
+	int px = 0;
+	for (int bx = 0; bx < count / 8; ++bx) {
+		const int16_t* thresholds8 = thresholds + ((px + noise_x) & NOISE_MASK);
+		uint8_t pixbyte = 0xFF;
+		for (int ib = 0; ib < 8; ++ib, ++px) {
+			if (values[px] <= thresholds8[ib]) {
+				pixbyte &= ~(1 << (7 - ib));
+			}
+		}
+		dst[bx] = pixbyte ^ invert;
 	}
+}
 
+#if KERNELS_X86
+static uint8_t s_bit_reverse[256];
+
+// 16 pixels into 2 bytes
+KERNEL_TARGET("sse2")
+static inline void dither16_sse2(const uint8_t* values, const int16_t* thresholds, uint8_t invert, uint8_t* dst)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i v = _mm_loadu_si128((const __m128i*)values);
+	// white where value > threshold
+	__m128i w_lo = _mm_cmpgt_epi16(_mm_unpacklo_epi8(v, zero), _mm_loadu_si128((const __m128i*)thresholds));
+	__m128i w_hi = _mm_cmpgt_epi16(_mm_unpackhi_epi8(v, zero), _mm_loadu_si128((const __m128i*)(thresholds + 8)));
+	int mask = _mm_movemask_epi8(_mm_packs_epi16(w_lo, w_hi));
+	dst[0] = s_bit_reverse[mask & 0xFF] ^ invert;
+	dst[1] = s_bit_reverse[mask >> 8] ^ invert;
+}
+
+KERNEL_TARGET("sse2")
+static void dither_row_sse2(const uint8_t* values, const int16_t* thresholds, int noise_x, uint8_t invert, uint8_t* dst, int count)
+{
+	for (int px = 0; px < count; px += 16)
+		dither16_sse2(values + px, thresholds + ((px + noise_x) & NOISE_MASK), invert, dst + px / 8);
+}
+
+KERNEL_TARGET("avx2")
+static void dither_row_avx2(const uint8_t* values, const int16_t* thresholds, int noise_x, uint8_t invert, uint8_t* dst, int count)
+{
+	// reverses each group of 8 bytes, so that movemask puts the leftmost pixel into the top bit
+	const __m256i reverse = _mm256_setr_epi8(
+		7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+		7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+	const uint32_t invert32 = invert * 0x01010101u;
+	int px = 0;
+	for (; px + 32 <= count; px += 32)
+	{
+		const int16_t* thresholds32 = thresholds + ((px + noise_x) & NOISE_MASK);
+		__m256i v_lo = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(values + px)));
+		__m256i v_hi = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(values + px + 16)));
+		__m256i w_lo = _mm256_cmpgt_epi16(v_lo, _mm256_loadu_si256((const __m256i*)thresholds32));
+		__m256i w_hi = _mm256_cmpgt_epi16(v_hi, _mm256_loadu_si256((const __m256i*)(thresholds32 + 16)));
+		// packs works within 128 bit lanes; put the 8 pixel groups back in order
+		__m256i w = _mm256_permute4x64_epi64(_mm256_packs_epi16(w_lo, w_hi), 0xD8);
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_shuffle_epi8(w, reverse)) ^ invert32;
+		memcpy(dst + px / 8, &mask, sizeof(mask));
+	}
+	for (; px < count; px += 16)
+		dither16_sse2(values + px, thresholds + ((px + noise_x) & NOISE_MASK), invert, dst + px / 8);
+}
+#endif // #if KERNELS_X86
+
+#if KERNELS_NEON
+static void dither_row_neon(const uint8_t* values, const int16_t* thresholds, int noise_x, uint8_t invert, uint8_t* dst, int count)
+{
+	static const uint8_t kBits[16] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01, 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
+	const uint8x16_t bits = vld1q_u8(kBits);
+	for (int px = 0; px < count; px += 16)
+	{
+		const int16_t* thresholds16 = thresholds + ((px + noise_x) & NOISE_MASK);
+		uint8x16_t v = vld1q_u8(values + px);
+		// white where value > threshold
+		uint16x8_t w_lo = vcgtq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(v))), vld1q_s16(thresholds16));
+		uint16x8_t w_hi = vcgtq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(v))), vld1q_s16(thresholds16 + 8));
+		uint8x16_t w = vandq_u8(vcombine_u8(vmovn_u16(w_lo), vmovn_u16(w_hi)), bits);
+		dst[px / 8 + 0] = vaddv_u8(vget_low_u8(w)) ^ invert;
+		dst[px / 8 + 1] = vaddv_u8(vget_high_u8(w)) ^ invert;
+	}
+}
+#endif // #if KERNELS_NEON
+
+static KernelSlot s_dither_row_slot = {
+	"dither_row",
+	{
+		{kIsaScalar, (KernelFunc)dither_row_scalar},
+#if KERNELS_X86
+		{kIsaSSE2, (KernelFunc)dither_row_sse2},
+		{kIsaAVX2, (KernelFunc)dither_row_avx2},
+#endif
+#if KERNELS_NEON
+		{kIsaNEON, (KernelFunc)dither_row_neon},
+#endif
+	},
+};
+
+// remaps the noise tile when the per noise level thresholds changed
+static void set_dither_thresholds(const int16_t thresholds[256], uint8_t invert)
+{
+	s_threshold_invert = invert;
+	if (memcmp(thresholds, s_thresholds, sizeof(s_thresholds)) == 0)
+		return;
+	memcpy(s_thresholds, thresholds, sizeof(s_thresholds));
+	if (++s_threshold_gen == 0)
+	{
+		// wrapped around: forget the old generations
+		memset(s_run_gens, 0, sizeof(s_run_gens));
+		s_threshold_gen = 1;
+	}
+	for (int y = 0; y < BLUE_NOISE_TILE_SIZE; ++y)
+	{
+		for (int x = 0; x < BLUE_NOISE_TILE_SIZE; ++x)
+		{
+			int16_t t = thresholds[kBlueNoiseTile[y * BLUE_NOISE_TILE_SIZE + x]];
+			s_threshold_rows[y][x] = t;
+			s_threshold_rows[y][x + BLUE_NOISE_TILE_SIZE] = t;
+		}
+	}
+}
+
+static void prepare_dither_bias(int bias)
+{
+	if (bias == s_threshold_bias)
+		return;
+	s_threshold_bias = bias;
+	int16_t thresholds[256];
+	for (int n = 0; n < 256; ++n)
+		thresholds[n] = (int16_t)MIN(MAX(n + bias, -1), 255);
+	set_dither_thresholds(thresholds, 0);
+}
+
+// false if the LUT is not monotonic
+static bool prepare_dither_tone(const uint8_t tone_lut[256])
+{
+	bool increasing = true, decreasing = true;
+	for (int v = 1; v < 256; ++v)
+	{
+		increasing &= tone_lut[v] >= tone_lut[v - 1];
+		decreasing &= tone_lut[v] <= tone_lut[v - 1];
+	}
+	if (!increasing && !decreasing)
+		return false;
+
+	// black is where tone_lut[v] <= noise: a prefix of the values for an increasing LUT, a suffix
+	// for a decreasing one (the latter is "white below threshold", inverted). Either way the
+	// threshold follows from how many values map to <= noise.
+	int count[256] = { 0 };
+	for (int v = 0; v < 256; ++v)
+		count[tone_lut[v]]++;
+	int16_t thresholds[256];
+	int black = 0;
+	for (int n = 0; n < 256; ++n)
+	{
+		black += count[n];
+		thresholds[n] = (int16_t)((increasing ? black : 256 - black) - 1);
+	}
+	s_threshold_bias = INT_MIN;
+	set_dither_thresholds(thresholds, increasing ? 0 : 0xFF);
+	return true;
+}
+
+void init_pixel_ops()
+{
 	memset(g_screen_buffer, 0xFF, sizeof(g_screen_buffer));
 	memset(g_screen_buffer_2x2sml, 0xFF, sizeof(g_screen_buffer_2x2sml));
+
+#if KERNELS_X86
+	for (int i = 0; i < 256; ++i)
+	{
+		uint8_t r = 0;
+		for (int b = 0; b < 8; ++b)
+			r |= ((i >> b) & 1) << (7 - b);
+		s_bit_reverse[i] = r;
+	}
+#endif
+	kernels_register(&s_dither_row_slot);
+
+	s_thresholds[0] = 1; // not a valid table, so that the first one gets built
+	prepare_dither_bias(0);
+}
+
+void build_tone_lut(uint8_t tone_lut[256], const ToneParams* params)
+{
+	float gamma = params->gamma > 0.0f ? params->gamma : 1.0f;
+	for (int v = 0; v < 256; ++v)
+	{
+		float x = v / 255.0f;
+		if (gamma != 1.0f)
+			x = powf(x, gamma);
+		x = saturate((x - 0.5f) * params->contrast + 0.5f);
+		if (params->posterize > 1)
+			x = floorf(x * (params->posterize - 1) + 0.5f) / (params->posterize - 1);
+		x += (1.0f - x) * params->fade;
+		int t = (int)(x * 255.0f + 0.5f) - params->bias;
+		t = MIN(MAX(t, 0), 255);
+		tone_lut[v] = (uint8_t)(params->invert ? 255 - t : t);
+	}
 }
 
+// 16 equal values: the value, or -1
+static inline int flat_block_value(const uint8_t* values)
+{
+	uint64_t a, b;
+	memcpy(&a, values, sizeof(a));
+	memcpy(&b, values + 8, sizeof(b));
+	if (a != b || a != (a & 0xFF) * 0x0101010101010101ull)
+		return -1;
+	return (int)(a & 0xFF);
+}
 
-void draw_dithered_scanline(const uint8_t* values, int y, int bias, uint8_t* framebuffer)
+static uint64_t run_pattern(int value, int noise_y)
+{
+	PERF_COUNT(kPerfDitherRunLookups, 1);
+	int idx = (noise_y << DITHER_RUN_CACHE_VALUE_BITS) | (value & ((1 << DITHER_RUN_CACHE_VALUE_BITS) - 1));
+	if (s_run_gens[idx] == s_threshold_gen && s_run_values[idx] == value)
+		return s_run_patterns[idx];
+	PERF_COUNT(kPerfDitherRunMisses, 1);
+	const int16_t* thresholds = s_threshold_rows[noise_y];
+	uint64_t bits = 0;
+	for (int x = 0; x < BLUE_NOISE_TILE_SIZE; ++x)
+		bits |= (uint64_t)(value > thresholds[x]) << (63 - x);
+	s_run_patterns[idx] = bits;
+	s_run_values[idx] = (uint8_t)value;
+	s_run_gens[idx] = s_threshold_gen;
+	return bits;
+}
+
+static void fill_run(int value, int noise_x, int noise_y, uint8_t* dst, int byte_count)
+{
+	uint64_t bits = run_pattern(value, noise_y);
+	int rot = noise_x & NOISE_MASK;
+	if (rot)
+		bits = (bits << rot) | (bits >> (64 - rot));
+	uint8_t bytes[8];
+	for (int i = 0; i < 8; ++i)
+		bytes[i] = (uint8_t)(bits >> (56 - i * 8)) ^ s_threshold_invert;
+	for (int i = 0; i < byte_count; ++i)
+		dst[i] = bytes[i & 7];
+}
+
+static void dither_scanline(const uint8_t* values, int y, uint8_t* framebuffer)
 {
 	uint8_t scanline[SCREEN_STRIDE_BYTES];
-	const uint8_t* noise_row = s_blue_noise + y * SCREEN_X;
+#if DITHER_ANIMATE_NOISE
+	// odd steps, so that over 64 frames all the offsets get used
+	int noise_x = G.frame_count * 41;
+	int noise_y = y + G.frame_count * 23;
+#else
+	int noise_x = 0;
+	int noise_y = y;
+#endif
+	noise_y &= NOISE_MASK;
+	const int16_t* threshold_row = s_threshold_rows[noise_y];
+	DitherRowFunc dither_row = (DitherRowFunc)kernel_bound(&s_dither_row_slot);
+	PERF_COUNT(kPerfDitherPixels, SCREEN_X);
+
+	// flat runs of whole blocks come from the run cache, the rest goes through the kernel
+	int start = 0;
 	int px = 0;
-	for (int bx = 0; bx < SCREEN_X / 8; ++bx) {
-		uint8_t pixbyte = 0xFF;
-		for (int ib = 0; ib < 8; ++ib, ++px) {
-			if (values[px] <= noise_row[px] + bias) {
-				pixbyte &= ~(1 << (7 - ib));
-			}
+	while (g_dither_runs && px < SCREEN_X)
+	{
+		int value = flat_block_value(values + px);
+		if (value < 0)
+		{
+			px += DITHER_RUN_BLOCK;
+			continue;
 		}
-		scanline[bx] = pixbyte;
+		int end = px + DITHER_RUN_BLOCK;
+		while (end < SCREEN_X && flat_block_value(values + end) == value)
+			end += DITHER_RUN_BLOCK;
+		if (start < px)
+			dither_row(values + start, threshold_row, (noise_x + start) & NOISE_MASK, s_threshold_invert, scanline + start / 8, px - start);
+		fill_run(value, noise_x + px, noise_y, scanline + px / 8, (end - px) / 8);
+		PERF_COUNT(kPerfDitherRunPixels, end - px);
+		start = px = end;
 	}
+	if (start < SCREEN_X)
+		dither_row(values + start, threshold_row, (noise_x + start) & NOISE_MASK, s_threshold_invert, scanline + start / 8, SCREEN_X - start);
 
 	uint8_t* row = framebuffer + y * SCREEN_STRIDE_BYTES;
 	memcpy(row, scanline, sizeof(scanline));
 }
 
+void draw_dithered_scanline(const uint8_t* values, int y, int bias, uint8_t* framebuffer)
+{
+	prepare_dither_bias(bias);
+	dither_scanline(values, y, framebuffer);
+}
+
 void draw_dithered_screen(uint8_t* framebuffer, int bias)
 {
+	float t0 = hud_stage_begin();
+	prepare_dither_bias(bias);
 	const uint8_t* src = g_screen_buffer;
 	for (int y = 0; y < SCREEN_Y; ++y)
 	{
-		draw_dithered_scanline(src, y, bias, framebuffer);
+		dither_scanline(src, y, framebuffer);
 		src += SCREEN_X;
 	}
+	hud_stage_end(kHudStageDither, t0);
+}
+
+void draw_dithered_screen_tone(uint8_t* framebuffer, const uint8_t tone_lut[256])
+{
+	float t0 = hud_stage_begin();
+	const uint8_t* src = g_screen_buffer;
+	if (prepare_dither_tone(tone_lut))
+	{
+		for (int y = 0; y < SCREEN_Y; ++y, src += SCREEN_X)
+			dither_scanline(src, y, framebuffer);
+		hud_stage_end(kHudStageDither, t0);
+		return;
+	}
+
+	// not monotonic, so apply it per pixel
+	prepare_dither_bias(0);
+	uint8_t rowvalues[SCREEN_X];
+	for (int y = 0; y < SCREEN_Y; ++y, src += SCREEN_X)
+	{
+		for (int x = 0; x < SCREEN_X; ++x)
+			rowvalues[x] = tone_lut[src[x]];
+		dither_scanline(rowvalues, y, framebuffer);
+	}
+	hud_stage_end(kHudStageDither, t0);
 }
 
 void draw_dithered_screen_2x2(uint8_t* framebuffer, int filter)
 {
+	float t0 = hud_stage_begin();
 	uint8_t rowvalues[SCREEN_X];
 	if (filter == 0)
 	{
@@ -199,9 +523,37 @@ void draw_dithered_screen_2x2(uint8_t* framebuffer, int filter)
 			}
 		}
 	}
+	hud_stage_end(kHudStageDither, t0);
 }
 
-// DDA line drawing algorithm, using 16.16 fixed point
+static inline int floor_div(int a, int b) // b > 0
+{
+	return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// narrows [*lo, *hi] to the steps i where 0 <= v + i * step < limit (16.16 values)
+static void clip_dda_axis(int v, int step, int limit, int* lo, int* hi)
+{
+	if (step == 0)
+	{
+		if (v < 0 || v >= limit)
+			*hi = -1;
+		return;
+	}
+	if (step > 0)
+	{
+		*lo = MAX(*lo, -floor_div(v, step));
+		*hi = MIN(*hi, floor_div(limit - 1 - v, step));
+	}
+	else
+	{
+		*lo = MAX(*lo, -floor_div(limit - 1 - v, -step));
+		*hi = MIN(*hi, floor_div(v, -step));
+	}
+}
+
+// DDA line drawing algorithm, using 16.16 fixed point. The range of steps that lands within the
+// buffer is found up front, so the loop does no bounds checks.
 void draw_line(uint8_t* framebuffer, int width, int height, int x1, int y1, int x2, int y2, uint8_t color)
 {
 	int dx = x2 - x1;
@@ -210,18 +562,22 @@ void draw_line(uint8_t* framebuffer, int width, int height, int x1, int y1, int
 	int abs_dy = abs(dy);
 	int steps = MAX(abs_dx, abs_dy);
 
-	int xstep_fx = (dx << 16) / steps;
-	int ystep_fx = (dy << 16) / steps;
+	// a single point has no direction
+	int xstep_fx = steps ? (dx << 16) / steps : 0;
+	int ystep_fx = steps ? (dy << 16) / steps : 0;
 
 	int x_fx = x1 << 16;
 	int y_fx = y1 << 16;
 
-	for (int i = 0; i <= steps; ++i)
+	int first = 0, last = steps;
+	clip_dda_axis(x_fx, xstep_fx, width << 16, &first, &last);
+	clip_dda_axis(y_fx, ystep_fx, height << 16, &first, &last);
+
+	x_fx += first * xstep_fx;
+	y_fx += first * ystep_fx;
+	for (int i = first; i <= last; ++i)
 	{
-		int ix = x_fx >> 16;
-		int iy = y_fx >> 16;
-		if (ix >= 0 && ix < width && iy >= 0 && iy < height)
-			framebuffer[iy * width + ix] = color;
+		framebuffer[(y_fx >> 16) * width + (x_fx >> 16)] = color;
 		x_fx += xstep_fx;
 		y_fx += ystep_fx;
 	}
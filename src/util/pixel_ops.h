@@ -3,6 +3,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 
 extern uint8_t g_screen_buffer[];
 extern uint8_t g_screen_buffer_2x2sml[];
@@ -16,9 +17,32 @@ static inline void put_pixel_black(uint8_t* row, int x)
 	row[x >> 3] &= mask;
 }
 
+// Dithering is against a 64x64 blue noise tile; set to 1 to move the tile around every frame.
+#define DITHER_ANIMATE_NOISE 0
+
+// Byte aligned runs of 16+ equal values get their 1-bit rows from a per (value, noise row) cache
+// instead of a compare per pixel; 0 turns that off (benchmark mode compares both).
+extern int g_dither_runs;
+
 // negative bias lightens the image, positive darkens
 void draw_dithered_scanline(const uint8_t* values, int y, int bias, uint8_t* framebuffer);
 void draw_dithered_screen(uint8_t* framebuffer, int bias);
+
+// Dithers g_screen_buffer as if each value v was tone_lut[v]. A monotonic (increasing or
+// decreasing) LUT is folded into the per-frame dither thresholds, so it costs nothing per pixel;
+// other LUTs get applied per pixel.
+void draw_dithered_screen_tone(uint8_t* framebuffer, const uint8_t tone_lut[256]);
+
+typedef struct ToneParams {
+	int bias; // like the draw_dithered_screen bias: positive darkens
+	float contrast; // around mid grey; 1 is no change
+	float gamma; // 1 is no change
+	int posterize; // number of levels, or 0
+	float fade; // towards white, before the bias: 0 is no change, 1 is all white
+	bool invert;
+} ToneParams;
+
+void build_tone_lut(uint8_t tone_lut[256], const ToneParams* params);
 void draw_dithered_screen_2x2(uint8_t* framebuffer, int filter);
 
 extern int g_order_pattern_2x2[4][2];
@@ -0,0 +1,93 @@
+// SPDX-License-Identifier: Unlicense
+
+#include "sdf_grid.h"
+
+#include "../platform.h"
+
+#define SDF_GRID_VALUES (SDF_GRID_SIZE * SDF_GRID_SIZE * SDF_GRID_SIZE)
+
+// position (within one period) of a grid vertex
+static float grid_pos(const SdfGrid* grid, int i)
+{
+	return (0.5f - i * (0.5f / (SDF_GRID_SIZE - 1))) * grid->period;
+}
+
+void sdf_grid_bake(SdfGrid* grid, float period, sdf_grid_function func)
+{
+	grid->period = period;
+	grid->inv_period = 1.0f / period;
+	if (grid->values == NULL)
+		grid->values = (int8_t*)plat_malloc(SDF_GRID_VALUES);
+
+	// evaluate into a temporary float grid first, to know the range
+	float* tmp = (float*)plat_malloc(SDF_GRID_VALUES * sizeof(float));
+	float max_abs = 1.0e-6f;
+	int idx = 0;
+	for (int iz = 0; iz < SDF_GRID_SIZE; ++iz)
+	{
+		for (int iy = 0; iy < SDF_GRID_SIZE; ++iy)
+		{
+			for (int ix = 0; ix < SDF_GRID_SIZE; ++ix, ++idx)
+			{
+				float3 p = { grid_pos(grid, ix), grid_pos(grid, iy), grid_pos(grid, iz) };
+				float d = func(p);
+				tmp[idx] = d;
+				max_abs = MAX(max_abs, fabsf(d));
+			}
+		}
+	}
+
+	grid->value_scale = max_abs / 127.0f;
+	float to_value = 127.0f / max_abs;
+	for (int i = 0; i < SDF_GRID_VALUES; ++i)
+	{
+		float v = tmp[i] * to_value;
+		grid->values[i] = (int8_t)(v < 0.0f ? v - 0.5f : v + 0.5f);
+	}
+	plat_free(tmp);
+}
+
+float sdf_grid_trilinear(const SdfGrid* grid, float3 p)
+{
+	float gx = sdf_grid_coord(grid, p.x);
+	float gy = sdf_grid_coord(grid, p.y);
+	float gz = sdf_grid_coord(grid, p.z);
+	int ix = MIN((int)gx, SDF_GRID_SIZE - 2);
+	int iy = MIN((int)gy, SDF_GRID_SIZE - 2);
+	int iz = MIN((int)gz, SDF_GRID_SIZE - 2);
+	float fx = gx - ix;
+	float fy = gy - iy;
+	float fz = gz - iz;
+
+	const int8_t* v = grid->values + (iz * SDF_GRID_SIZE + iy) * SDF_GRID_SIZE + ix;
+	const int dy = SDF_GRID_SIZE;
+	const int dz = SDF_GRID_SIZE * SDF_GRID_SIZE;
+	float v00 = lerp(v[0], v[1], fx);
+	float v10 = lerp(v[dy], v[dy + 1], fx);
+	float v01 = lerp(v[dz], v[dz + 1], fx);
+	float v11 = lerp(v[dz + dy], v[dz + dy + 1], fx);
+	float v0 = lerp(v00, v10, fy);
+	float v1 = lerp(v01, v11, fy);
+	return lerp(v0, v1, fz) * grid->value_scale;
+}
+
+void sdf_grid_error(const SdfGrid* grid, sdf_grid_function func, bool trilinear, float* out_mean, float* out_max)
+{
+	const int kSamples = 20000;
+	uint32_t rng = 1;
+	float sum = 0.0f, max_err = 0.0f;
+	for (int i = 0; i < kSamples; ++i)
+	{
+		float3 p = {
+			RandomFloat01(&rng) * grid->period,
+			RandomFloat01(&rng) * grid->period,
+			RandomFloat01(&rng) * grid->period };
+		float ref = func(p);
+		float val = trilinear ? sdf_grid_trilinear(grid, p) : sdf_grid_nearest(grid, p);
+		float err = fabsf(val - ref);
+		sum += err;
+		max_err = MAX(max_err, err);
+	}
+	*out_mean = sum / kSamples;
+	*out_max = max_err;
+}
@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: Unlicense
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "../mathlib.h"
+
+// One period of a periodic distance field, quantized into a small 3D grid of int8 values.
+// The field has to be mirror symmetric around the middle of the period in each axis (all of
+// ours are, since they go through abs(fract(p)-0.5)), so only the [0, period/2] octant is stored.
+#define SDF_GRID_SIZE 32
+
+typedef float (*sdf_grid_function)(float3 p);
+
+typedef struct SdfGrid {
+	int8_t* values;
+	float period;
+	float inv_period;
+	float value_scale; // distance = value * value_scale
+} SdfGrid;
+
+void sdf_grid_bake(SdfGrid* grid, float period, sdf_grid_function func);
+
+// fold position into the stored octant, in grid coordinates (0..SDF_GRID_SIZE-1)
+static inline float sdf_grid_coord(const SdfGrid* grid, float v)
+{
+	return fabsf(fract(v * grid->inv_period) - 0.5f) * (2.0f * (SDF_GRID_SIZE - 1));
+}
+
+static inline float sdf_grid_nearest(const SdfGrid* grid, float3 p)
+{
+	int ix = (int)(sdf_grid_coord(grid, p.x) + 0.5f);
+	int iy = (int)(sdf_grid_coord(grid, p.y) + 0.5f);
+	int iz = (int)(sdf_grid_coord(grid, p.z) + 0.5f);
+	return grid->values[(iz * SDF_GRID_SIZE + iy) * SDF_GRID_SIZE + ix] * grid->value_scale;
+}
+
+float sdf_grid_trilinear(const SdfGrid* grid, float3 p);
+
+// mean & max absolute error of the grid lookups compared to the function, at random positions
+void sdf_grid_error(const SdfGrid* grid, sdf_grid_function func, bool trilinear, float* out_mean, float* out_max);
@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: Unlicense
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+
+// Sequence lock for handing a small struct from the audio thread to the main thread: the writer
+// copies it into the published slot and never waits; the reader retries while the sequence is
+// odd (a publish in progress) or changed during its copy. On Playdate the audio callback
+// interrupts the main thread, so a publish always completes before the reader gets to retry.
+typedef struct Seqlock {
+	atomic_uint sequence;
+} Seqlock;
+
+// single writer
+static inline void seqlock_publish(Seqlock* lock, void* published, const void* value, size_t size)
+{
+	unsigned seq = atomic_load_explicit(&lock->sequence, memory_order_relaxed);
+	atomic_store_explicit(&lock->sequence, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	memcpy(published, value, size);
+	atomic_store_explicit(&lock->sequence, seq + 2, memory_order_release);
+}
+
+static inline void seqlock_read(Seqlock* lock, void* res, const void* published, size_t size)
+{
+	for (;;)
+	{
+		unsigned seq = atomic_load_explicit(&lock->sequence, memory_order_acquire);
+		if (seq & 1)
+			continue;
+		memcpy(res, published, size);
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&lock->sequence, memory_order_relaxed) == seq)
+			return;
+	}
+}
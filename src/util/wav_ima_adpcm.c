@@ -34,6 +34,7 @@ void wav_decode_state_init(const wav_file_desc* desc, wav_decode_state* state)
 	state->block_index = -1;
 	state->samples_per_block = desc->samples_per_block;
 	state->block_size_bytes = desc->block_size;
+	state->bits_per_sample = desc->bits_per_sample;
 }
 
 static const int kImaIndexTable[16] = {
@@ -41,6 +42,17 @@ static const int kImaIndexTable[16] = {
 	-1, -1, -1, -1, 2, 4, 6, 8
 };
 
+// step index changes of the 3 and 2 bit codes (sign bit on top, like the 4 bit ones)
+static const int kIma3IndexTable[8] = {
+	-1, -1, 1, 2,
+	-1, -1, 1, 2
+};
+
+static const int kIma2IndexTable[4] = {
+	-1, 2,
+	-1, 2
+};
+
 static const int kImaStepTable[89] = {
 	7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
 	19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
@@ -70,7 +82,7 @@ static inline float short_to_float(int v)
 	return v * (1.0f / 32767.0f);
 }
 
-static inline float decode_sample(int nibble, int* step_index, int* predict)
+static inline void update_predictor(int nibble, int* step_index, int* predict)
 {
 	int step = kImaStepTable[*step_index];
 	int diff = step >> 3;
@@ -80,18 +92,41 @@ static inline float decode_sample(int nibble, int* step_index, int* predict)
 	if (nibble & 8) diff = -diff;
 	*predict = clamp_predict(*predict + diff);
 	*step_index = clamp_step_index(*step_index + kImaIndexTable[nibble]);
+}
+
+static inline float decode_sample(int nibble, int* step_index, int* predict)
+{
+	update_predictor(nibble, step_index, predict);
 	return short_to_float(*predict);
 }
 
+// 3 and 2 bit codes: magnitude bits below the sign bit, and the difference is
+// (magnitude + 0.5) * step / 2^(bits-2)
+static inline void update_predictor_low_bits(int code, int bits, int* step_index, int* predict)
+{
+	int shift = bits - 1;
+	int step = kImaStepTable[*step_index];
+	int diff = ((2 * (code & ((1 << shift) - 1)) + 1) * step) >> shift;
+	if (code & (1 << shift)) diff = -diff;
+	*predict = clamp_predict(*predict + diff);
+	*step_index = clamp_step_index(*step_index + (bits == 3 ? kIma3IndexTable[code] : kIma2IndexTable[code]));
+}
+
+static inline void read_block_header(const uint8_t* data, int* predict, int* step_index)
+{
+	*predict = data[0] | (data[1] << 8);
+	if (*predict & 0x8000)
+		*predict -= 0x10000;
+	*step_index = clamp_step_index(data[2]);
+	assert(data[3] == 0);
+}
+
 static void wav_ima_adpcm_decode_block(float * __restrict output, const uint8_t *data, uint64_t sample_count)
 {
 	uint64_t i;
 
-	int predict = data[0] | (data[1] << 8);
-	if (predict & 0x8000)
-		predict -= 0x10000;
-	int step_index = clamp_step_index(data[2]);
-	assert(data[3] == 0);
+	int predict, step_index;
+	read_block_header(data, &predict, &step_index);
 
 	output[0] = short_to_float(predict);
 	output++;
@@ -110,6 +145,55 @@ static void wav_ima_adpcm_decode_block(float * __restrict output, const uint8_t
 	}
 }
 
+// The low bit depth codes are a little endian bit stream, read 8 codes (bits bytes) at a time.
+static inline void decode_block_low_bits(float* __restrict output, const uint8_t* data, int sample_count, int bits)
+{
+	int predict, step_index;
+	read_block_header(data, &predict, &step_index);
+
+	*output++ = short_to_float(predict);
+	data += 4;
+
+	const int mask = (1 << bits) - 1;
+	int i = 1;
+	for (; i + 8 <= sample_count; i += 8)
+	{
+		uint32_t codes = data[0] | (data[1] << 8) | (bits == 3 ? (data[2] << 16) : 0);
+		for (int j = 0; j < 8; ++j)
+		{
+			update_predictor_low_bits(codes & mask, bits, &step_index, &predict);
+			*output++ = short_to_float(predict);
+			codes >>= bits;
+		}
+		data += bits;
+	}
+	if (i < sample_count)
+	{
+		// partial group at the end of a block, when its size does not line up with the groups; only
+		// its own bytes are read, the block may be the last thing in the file
+		int bytes = ((sample_count - i) * bits + 7) >> 3;
+		uint32_t codes = 0;
+		for (int b = 0; b < bytes; ++b)
+			codes |= data[b] << (b * 8);
+		for (; i < sample_count; ++i)
+		{
+			update_predictor_low_bits(codes & mask, bits, &step_index, &predict);
+			*output++ = short_to_float(predict);
+			codes >>= bits;
+		}
+	}
+}
+
+static void wav_ima_adpcm_decode_block_3bit(float* __restrict output, const uint8_t* data, int sample_count)
+{
+	decode_block_low_bits(output, data, sample_count, 3);
+}
+
+static void wav_ima_adpcm_decode_block_2bit(float* __restrict output, const uint8_t* data, int sample_count)
+{
+	decode_block_low_bits(output, data, sample_count, 2);
+}
+
 void wav_ima_adpcm_decode(float* __restrict output, int sample_pos, int sample_count, const void* data, wav_decode_state* state)
 {
 	while (sample_count > 0)
@@ -119,7 +203,12 @@ void wav_ima_adpcm_decode(float* __restrict output, int sample_pos, int sample_c
 		if (block_index != state->block_index)
 		{
 			const uint8_t* block_ptr = (const uint8_t*)data + block_index * state->block_size_bytes;
-			wav_ima_adpcm_decode_block(state->block, block_ptr, state->samples_per_block);
+			if (state->bits_per_sample == 3)
+				wav_ima_adpcm_decode_block_3bit(state->block, block_ptr, state->samples_per_block);
+			else if (state->bits_per_sample == 2)
+				wav_ima_adpcm_decode_block_2bit(state->block, block_ptr, state->samples_per_block);
+			else
+				wav_ima_adpcm_decode_block(state->block, block_ptr, state->samples_per_block);
 			state->block_index = block_index;
 		}
 
@@ -137,6 +226,205 @@ void wav_ima_adpcm_decode(float* __restrict output, int sample_pos, int sample_c
 	}
 }
 
+// nibble that gets the predictor closest to the sample (same steps as the decoder)
+static inline int encode_sample(int sample, int* step_index, int* predict)
+{
+	int step = kImaStepTable[*step_index];
+	int diff = sample - *predict;
+	int nibble = 0;
+	if (diff < 0)
+	{
+		nibble = 8;
+		diff = -diff;
+	}
+	if (diff >= step) { nibble |= 4; diff -= step; }
+	step >>= 1;
+	if (diff >= step) { nibble |= 2; diff -= step; }
+	step >>= 1;
+	if (diff >= step) { nibble |= 1; }
+	update_predictor(nibble, step_index, predict);
+	return nibble;
+}
+
+// code of the low bit depth magnitude that gets the predictor closest to the sample
+static inline int encode_sample_low_bits(int sample, int bits, int* step_index, int* predict)
+{
+	int shift = bits - 1;
+	int step = kImaStepTable[*step_index];
+	int diff = sample - *predict;
+	int code = 0;
+	if (diff < 0)
+	{
+		code = 1 << shift;
+		diff = -diff;
+	}
+	int best = 0, best_err = 0x7FFFFFFF;
+	for (int m = 0; m < (1 << shift); ++m)
+	{
+		int err = abs(((2 * m + 1) * step >> shift) - diff);
+		if (err < best_err)
+		{
+			best = m;
+			best_err = err;
+		}
+	}
+	code |= best;
+	update_predictor_low_bits(code, bits, step_index, predict);
+	return code;
+}
+
+// The encoder searches for the code sequence with the least squared error over each block, keeping
+// the best few partial sequences (with distinct predictor states) at every sample. For each of them
+// it tries the code that gets closest to the sample, the next larger and smaller magnitudes, and
+// the smallest one of the other sign.
+#define ENCODE_SEARCH_WIDTH (16)
+
+typedef struct EncodePath {
+	int64_t err;
+	int predict;
+	int step_index;
+	int parent;
+	int code;
+} EncodePath;
+
+static inline int greedy_code(int sample, int bits, int step_index, int predict)
+{
+	return bits == 4
+		? encode_sample(sample, &step_index, &predict)
+		: encode_sample_low_bits(sample, bits, &step_index, &predict);
+}
+
+static inline void apply_code(int code, int bits, int* step_index, int* predict)
+{
+	if (bits == 4)
+		update_predictor(code, step_index, predict);
+	else
+		update_predictor_low_bits(code, bits, step_index, predict);
+}
+
+// adds the path to the best ones so far (sorted by error), unless a better one has the same state
+static void add_path(EncodePath* paths, int* count, const EncodePath* p)
+{
+	if (*count == ENCODE_SEARCH_WIDTH && p->err >= paths[*count - 1].err)
+		return;
+	for (int i = 0; i < *count; ++i)
+	{
+		if (paths[i].predict == p->predict && paths[i].step_index == p->step_index)
+		{
+			if (paths[i].err <= p->err)
+				return;
+			// replace the worse one with the same state
+			for (int j = i; j < *count - 1; ++j)
+				paths[j] = paths[j + 1];
+			(*count)--;
+			break;
+		}
+	}
+	int pos = *count < ENCODE_SEARCH_WIDTH ? (*count)++ : *count - 1;
+	while (pos > 0 && paths[pos - 1].err > p->err)
+	{
+		paths[pos] = paths[pos - 1];
+		pos--;
+	}
+	paths[pos] = *p;
+}
+
+// codes[1..count-1] for the block that starts with samples[0]; returns the final step index
+static int encode_block_search(uint8_t* codes, uint8_t (*history)[ENCODE_SEARCH_WIDTH][2], const int16_t* samples, int count, int bits, int step_index)
+{
+	EncodePath paths[2][ENCODE_SEARCH_WIDTH];
+	int path_count = 1;
+	paths[0][0] = (EncodePath){ 0, samples[0], step_index, 0, 0 };
+	int sign = 1 << (bits - 1);
+	int max_mag = sign - 1;
+	for (int i = 1; i < count; ++i)
+	{
+		const EncodePath* cur = paths[(i - 1) & 1];
+		EncodePath* next = paths[i & 1];
+		int next_count = 0;
+		for (int p = 0; p < path_count; ++p)
+		{
+			// candidates: the closest code, the next smaller and larger magnitudes, and the
+			// smallest magnitude of the other sign
+			int greedy = greedy_code(samples[i], bits, cur[p].step_index, cur[p].predict);
+			int mag = greedy & max_mag;
+			int tries[4], try_count = 0;
+			tries[try_count++] = greedy;
+			if (mag > 0)
+				tries[try_count++] = greedy - 1;
+			if (mag < max_mag)
+				tries[try_count++] = greedy + 1;
+			tries[try_count++] = (greedy & sign) ^ sign;
+			for (int t = 0; t < try_count; ++t)
+			{
+				EncodePath np = { cur[p].err, cur[p].predict, cur[p].step_index, p, tries[t] };
+				apply_code(np.code, bits, &np.step_index, &np.predict);
+				int64_t e = samples[i] - np.predict;
+				np.err += e * e;
+				add_path(next, &next_count, &np);
+			}
+		}
+		for (int p = 0; p < next_count; ++p)
+		{
+			history[i][p][0] = (uint8_t)next[p].parent;
+			history[i][p][1] = (uint8_t)next[p].code;
+		}
+		path_count = next_count;
+	}
+	// best path is first; walk back through the parents
+	int p = 0;
+	int final_step_index = count > 1 ? paths[(count - 1) & 1][0].step_index : step_index;
+	for (int i = count - 1; i >= 1; --i)
+	{
+		codes[i] = history[i][p][1];
+		p = history[i][p][0];
+	}
+	return final_step_index;
+}
+
+int wav_ima_adpcm_samples_per_block(int block_size, int bits_per_sample)
+{
+	return (block_size - 4) * 8 / bits_per_sample + 1;
+}
+
+int wav_ima_adpcm_encode(uint8_t* output, const int16_t* samples, int sample_count, int block_size, int bits_per_sample)
+{
+	assert(bits_per_sample >= WAV_IMA_ADPCM_MIN_BITS && bits_per_sample <= WAV_IMA_ADPCM_MAX_BITS);
+	int samples_per_block = wav_ima_adpcm_samples_per_block(block_size, bits_per_sample);
+	uint8_t* codes = (uint8_t*)malloc(samples_per_block);
+	uint8_t (*history)[ENCODE_SEARCH_WIDTH][2] = malloc(samples_per_block * sizeof(*history));
+	int step_index = 0;
+	int bytes = 0;
+	for (int start = 0; start < sample_count; start += samples_per_block)
+	{
+		uint8_t* block = output + bytes;
+		memset(block, 0, block_size);
+		int count = sample_count - start;
+		if (count > samples_per_block)
+			count = samples_per_block;
+
+		// header: first sample as is; the step index carries over from the previous block
+		int predict = samples[start];
+		block[0] = (uint8_t)(predict & 0xFF);
+		block[1] = (uint8_t)((predict >> 8) & 0xFF);
+		block[2] = (uint8_t)step_index;
+		step_index = encode_block_search(codes, history, samples + start, count, bits_per_sample, step_index);
+		for (int i = 1; i < count; ++i)
+		{
+			// little endian bit stream; a 3 bit code can straddle two bytes
+			int bit = (i - 1) * bits_per_sample;
+			int shifted = codes[i] << (bit & 7);
+			block[4 + bit / 8] |= (uint8_t)shifted;
+			if (shifted > 0xFF)
+				block[4 + bit / 8 + 1] |= (uint8_t)(shifted >> 8);
+		}
+		bytes += block_size;
+	}
+	free(history);
+	free(codes);
+	return bytes;
+}
+
 bool wav_parse_header(const void* data, size_t data_size, wav_file_desc* res)
 {
 	if (data == NULL || res == NULL || data_size < 44)
@@ -165,6 +453,8 @@ bool wav_parse_header(const void* data, size_t data_size, wav_file_desc* res)
 			format = (const wav_format*)&chunk[1];
 			if (format->format == 0x11 && chunk->size == 20) // IMA ADPCM
 			{
+				if (format->bits_per_sample < WAV_IMA_ADPCM_MIN_BITS || format->bits_per_sample > WAV_IMA_ADPCM_MAX_BITS)
+					return false;
 				res->samples_per_block = ((const uint16_t*)&format[1])[1];
 			}
 		}
@@ -189,6 +479,7 @@ bool wav_parse_header(const void* data, size_t data_size, wav_file_desc* res)
 	res->sample_rate = format->sample_rate;
 	res->channel_count = format->channel_count;
 	res->sample_format = format->format;
+	res->bits_per_sample = format->bits_per_sample;
 	res->block_size = format->block_size;
 
 	if (res->sample_count == 0) {
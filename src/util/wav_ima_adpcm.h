@@ -3,6 +3,8 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 typedef struct wav_file_desc {
 	const void* sample_data;
@@ -11,6 +13,7 @@ typedef struct wav_file_desc {
 	int sample_rate;
 	int channel_count;
 	int sample_format;
+	int bits_per_sample;
 
 	int block_size;
 	int samples_per_block;
@@ -21,10 +24,22 @@ typedef struct wav_decode_state {
 	int block_index;
 	int block_size_bytes;
 	int samples_per_block;
+	int bits_per_sample;
 } wav_decode_state;
 
+// IMA ADPCM in .wav files is usually 4 bits per sample. The 3 and 2 bit variants (same layout
+// as ffmpeg's adpcm_ima_wav: a little endian bit stream after the block header, 3 bit codes in
+// groups of 3 bytes) take 3/4 and 1/2 of the space, at a lower quality.
+#define WAV_IMA_ADPCM_MIN_BITS (2)
+#define WAV_IMA_ADPCM_MAX_BITS (4)
+
 bool wav_parse_header(const void* data, size_t data_size, wav_file_desc* res);
 
 void wav_decode_state_init(const wav_file_desc* desc, wav_decode_state* state);
 
 void wav_ima_adpcm_decode(float* __restrict output, int sample_pos, int sample_count, const void* data, wav_decode_state* state);
+
+// Mono samples into IMA ADPCM blocks of block_size bytes (the last one zero padded), with 2..4
+// bits per sample; returns the number of bytes written.
+int wav_ima_adpcm_samples_per_block(int block_size, int bits_per_sample);
+int wav_ima_adpcm_encode(uint8_t* output, const int16_t* samples, int sample_count, int block_size, int bits_per_sample);
@@ -0,0 +1,140 @@
+// SPDX-License-Identifier: Unlicense
+
+// Generates the tileable blue noise dither tile (src/util/blue_noise_tile.h) with the
+// void-and-cluster method (Ulichney 1993), on a torus so that the tile wraps seamlessly.
+//
+//   cc -O2 tools/blue_noise_tile.c -lm -o blue_noise_tile
+//   ./blue_noise_tile > src/util/blue_noise_tile.h
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SIZE 64
+#define N (SIZE * SIZE)
+#define SIGMA 1.5f
+#define INITIAL_FRACTION 10 // 1 in this many pixels set in the initial pattern
+
+static float s_kernel[N]; // gaussian of the toroidal offset
+static float s_energy[N];
+static uint8_t s_bits[N];
+static int s_rank[N];
+
+static void init_kernel()
+{
+	for (int y = 0; y < SIZE; ++y)
+	{
+		for (int x = 0; x < SIZE; ++x)
+		{
+			int dx = x <= SIZE / 2 ? x : SIZE - x;
+			int dy = y <= SIZE / 2 ? y : SIZE - y;
+			s_kernel[y * SIZE + x] = expf(-(dx * dx + dy * dy) / (2.0f * SIGMA * SIGMA));
+		}
+	}
+}
+
+static void splat(int idx, float sign)
+{
+	int px = idx % SIZE, py = idx / SIZE;
+	for (int y = 0; y < SIZE; ++y)
+	{
+		const float* krow = &s_kernel[((y - py) & (SIZE - 1)) * SIZE];
+		float* erow = &s_energy[y * SIZE];
+		for (int x = 0; x < SIZE; ++x)
+			erow[x] += sign * krow[(x - px) & (SIZE - 1)];
+	}
+}
+
+static void set_bit(int idx, uint8_t v)
+{
+	s_bits[idx] = v;
+	splat(idx, v ? 1.0f : -1.0f);
+}
+
+// tightest cluster: highest energy among the pixels equal to v
+static int find_extreme(uint8_t v, int highest)
+{
+	int best = -1;
+	for (int i = 0; i < N; ++i)
+	{
+		if (s_bits[i] != v)
+			continue;
+		if (best < 0 || (highest ? s_energy[i] > s_energy[best] : s_energy[i] < s_energy[best]))
+			best = i;
+	}
+	return best;
+}
+
+static void recompute_energy()
+{
+	memset(s_energy, 0, sizeof(s_energy));
+	for (int i = 0; i < N; ++i)
+		if (s_bits[i])
+			splat(i, 1.0f);
+}
+
+int main()
+{
+	init_kernel();
+
+	// initial binary pattern: random points, then swap tightest cluster to largest void until stable
+	uint32_t rng = 12345;
+	int ones = N / INITIAL_FRACTION;
+	for (int placed = 0; placed < ones; )
+	{
+		rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+		int idx = rng % N;
+		if (!s_bits[idx])
+		{
+			s_bits[idx] = 1;
+			++placed;
+		}
+	}
+	recompute_energy();
+	for (;;)
+	{
+		int cluster = find_extreme(1, 1);
+		set_bit(cluster, 0);
+		int hole = find_extreme(0, 0);
+		set_bit(hole, 1);
+		if (hole == cluster)
+			break;
+	}
+	uint8_t initial[N];
+	memcpy(initial, s_bits, sizeof(initial));
+
+	// phase 1: rank the initial points by removing tightest clusters
+	for (int rank = ones - 1; rank >= 0; --rank)
+	{
+		int cluster = find_extreme(1, 1);
+		set_bit(cluster, 0);
+		s_rank[cluster] = rank;
+	}
+
+	// phase 2 and 3: from the initial pattern, fill largest voids until all pixels are ranked (past
+	// half, the largest void of the ones is also the tightest cluster of the zeros, since the two
+	// energies add up to a constant)
+	memcpy(s_bits, initial, sizeof(s_bits));
+	recompute_energy();
+	for (int rank = ones; rank < N; ++rank)
+	{
+		int hole = find_extreme(0, 0);
+		set_bit(hole, 1);
+		s_rank[hole] = rank;
+	}
+
+	printf("// SPDX-License-Identifier: Unlicense\n\n");
+	printf("// Generated by tools/blue_noise_tile.c, do not edit.\n\n");
+	printf("#pragma once\n\n#include <stdint.h>\n\n");
+	printf("#define BLUE_NOISE_TILE_SIZE %d\n\n", SIZE);
+	printf("static const uint8_t kBlueNoiseTile[BLUE_NOISE_TILE_SIZE * BLUE_NOISE_TILE_SIZE] = {\n");
+	for (int y = 0; y < SIZE; ++y)
+	{
+		printf("\t");
+		for (int x = 0; x < SIZE; ++x)
+			printf("%d,%s", s_rank[y * SIZE + x] * 256 / N, x == SIZE - 1 ? "\n" : "");
+	}
+	printf("};\n");
+	return 0;
+}
@@ -0,0 +1,253 @@
+// SPDX-License-Identifier: Unlicense
+
+// Converts a mono .wav file (16 bit PCM, or IMA ADPCM of any supported bit depth) into IMA ADPCM
+// with 4, 3 or 2 bits per sample, e.g. to make a smaller Source/music.wav for the PC/web builds.
+// Logs the size, the quality (signal to noise ratio against the input) and the decoding speed of
+// the result; with --report it does that for all bit depths without writing anything.
+// By default the blocks are as long as the PC mixer can play (MIXER_ADPCM_BLOCK_MAX samples), so
+// the output also works for plat_audio_load_sample.
+//
+//   cc -O2 tools/wav_adpcm.c src/util/wav_ima_adpcm.c -lm -o wav_adpcm
+//   ./wav_adpcm Source/music.wav music3.wav 3
+//   ./wav_adpcm --report Source/music.wav
+
+#include "../src/util/audio_mixer.h"
+#include "../src/util/wav_ima_adpcm.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DECODE_CHUNK 512 // samples per decode call, like the PC audio callback
+#define DECODE_RUNS 5
+
+static double time_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+static uint8_t* read_file(const char* path, size_t* size)
+{
+	FILE* f = fopen(path, "rb");
+	if (f == NULL)
+		return NULL;
+	fseek(f, 0, SEEK_END);
+	*size = (size_t)ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t* res = (uint8_t*)malloc(*size);
+	if (fread(res, 1, *size, f) != *size)
+	{
+		free(res);
+		res = NULL;
+	}
+	fclose(f);
+	return res;
+}
+
+// whole file as floats; sets the decode time per sample for ADPCM input
+static float* decode_wav(const wav_file_desc* desc, double* ns_per_sample)
+{
+	float* res = (float*)malloc(desc->sample_count * sizeof(float));
+	*ns_per_sample = 0.0;
+	if (desc->sample_format == 1)
+	{
+		const int16_t* src = (const int16_t*)desc->sample_data;
+		for (int i = 0; i < desc->sample_count; ++i)
+		{
+			float v = 0.0f;
+			for (int c = 0; c < desc->channel_count; ++c)
+				v += src[i * desc->channel_count + c];
+			res[i] = v / (desc->channel_count * 32767.0f);
+		}
+		return res;
+	}
+
+	double best = 1.0e9;
+	for (int run = 0; run < DECODE_RUNS; ++run)
+	{
+		wav_decode_state state;
+		wav_decode_state_init(desc, &state);
+		double t0 = time_now();
+		for (int pos = 0; pos < desc->sample_count; pos += DECODE_CHUNK)
+		{
+			int count = desc->sample_count - pos < DECODE_CHUNK ? desc->sample_count - pos : DECODE_CHUNK;
+			wav_ima_adpcm_decode(res + pos, pos, count, desc->sample_data, &state);
+		}
+		double t = time_now() - t0;
+		best = t < best ? t : best;
+		free(state.block);
+	}
+	*ns_per_sample = best * 1.0e9 / desc->sample_count;
+	return res;
+}
+
+// the 3 bit stream goes in groups of 32 codes (12 bytes), the 2 bit one in 16 codes (4 bytes)
+static int round_block_size(int block_size, int bits)
+{
+	int group = bits == 3 ? 12 : 4;
+	return 4 + (block_size - 4) / group * group;
+}
+
+// largest block whose samples fit the ADPCM block buffer of a PC mixer voice
+static int default_block_size(int bits)
+{
+	return round_block_size(4 + (MIXER_ADPCM_BLOCK_MAX - 1) * bits / 8, bits);
+}
+
+static void put16(uint8_t** p, uint32_t v) { (*p)[0] = (uint8_t)v; (*p)[1] = (uint8_t)(v >> 8); *p += 2; }
+static void put32(uint8_t** p, uint32_t v) { put16(p, v & 0xFFFF); put16(p, v >> 16); }
+static void put_fourcc(uint8_t** p, const char* s) { memcpy(*p, s, 4); *p += 4; }
+
+// IMA ADPCM .wav file in memory; returns its size
+static size_t encode_wav(uint8_t** res, const float* samples, int sample_count, int sample_rate, int bits, int block_size)
+{
+	int samples_per_block = wav_ima_adpcm_samples_per_block(block_size, bits);
+	int block_count = (sample_count + samples_per_block - 1) / samples_per_block;
+	size_t data_size = (size_t)block_count * block_size;
+	size_t header_size = 12 + 8 + 20 + 8 + 4 + 8;
+	uint8_t* file = (uint8_t*)calloc(header_size + data_size, 1);
+
+	int16_t* pcm = (int16_t*)malloc(sample_count * sizeof(int16_t));
+	for (int i = 0; i < sample_count; ++i)
+	{
+		float v = samples[i] * 32767.0f;
+		v = v < -32768.0f ? -32768.0f : v > 32767.0f ? 32767.0f : v;
+		pcm[i] = (int16_t)lrintf(v);
+	}
+
+	uint8_t* p = file;
+	put_fourcc(&p, "RIFF");
+	put32(&p, (uint32_t)(header_size + data_size - 8));
+	put_fourcc(&p, "WAVE");
+	put_fourcc(&p, "fmt ");
+	put32(&p, 20);
+	put16(&p, 0x11);
+	put16(&p, 1);
+	put32(&p, sample_rate);
+	put32(&p, (uint32_t)((double)sample_rate * block_size / samples_per_block));
+	put16(&p, block_size);
+	put16(&p, bits);
+	put16(&p, 2);
+	put16(&p, samples_per_block);
+	put_fourcc(&p, "fact");
+	put32(&p, 4);
+	put32(&p, sample_count);
+	put_fourcc(&p, "data");
+	put32(&p, (uint32_t)data_size);
+	wav_ima_adpcm_encode(p, pcm, sample_count, block_size, bits);
+
+	free(pcm);
+	*res = file;
+	return header_size + data_size;
+}
+
+static double snr_db(const float* ref, const float* v, int count)
+{
+	double signal = 0.0, noise = 0.0;
+	for (int i = 0; i < count; ++i)
+	{
+		signal += (double)ref[i] * ref[i];
+		noise += (double)(v[i] - ref[i]) * (v[i] - ref[i]);
+	}
+	return 10.0 * log10(signal / (noise > 0.0 ? noise : 1.0e-20));
+}
+
+// encodes, decodes back and logs the tradeoff; writes the file if out_path is set
+// block_size 0 is the default for the bit depth
+static int convert(const float* samples, const wav_file_desc* src, size_t src_size, int bits, int block_size, const char* out_path)
+{
+	block_size = block_size > 0 ? round_block_size(block_size, bits) : default_block_size(bits);
+	if (wav_ima_adpcm_samples_per_block(block_size, bits) > MIXER_ADPCM_BLOCK_MAX)
+		printf("note: %i byte blocks of %i bit codes are longer than %i samples; fine for the music, but the PC mixer can not play them as a sample\n",
+			block_size, bits, MIXER_ADPCM_BLOCK_MAX);
+	uint8_t* file;
+	size_t size = encode_wav(&file, samples, src->sample_count, src->sample_rate, bits, block_size);
+
+	wav_file_desc desc;
+	if (!wav_parse_header(file, size, &desc))
+	{
+		fprintf(stderr, "could not parse the encoded file\n");
+		return 1;
+	}
+	double ns_per_sample;
+	float* decoded = decode_wav(&desc, &ns_per_sample);
+	printf("%i bit, %5i byte blocks: %8zu bytes (%5.1f%% of input), %6.1f kbit/s, SNR %5.1f dB, decode %.2f ns/sample\n",
+		bits, block_size, size, size * 100.0 / src_size, desc.sample_data_size * 8.0 * src->sample_rate / src->sample_count / 1000.0,
+		snr_db(samples, decoded, src->sample_count), ns_per_sample);
+	free(decoded);
+
+	int res = 0;
+	if (out_path != NULL)
+	{
+		FILE* f = fopen(out_path, "wb");
+		if (f == NULL || fwrite(file, 1, size, f) != size)
+		{
+			fprintf(stderr, "could not write %s\n", out_path);
+			res = 1;
+		}
+		if (f != NULL)
+			fclose(f);
+	}
+	free(file);
+	return res;
+}
+
+int main(int argc, char** argv)
+{
+	bool report = argc >= 2 && strcmp(argv[1], "--report") == 0;
+	if ((report && argc < 3) || (!report && argc < 3))
+	{
+		fprintf(stderr, "usage: %s <input.wav> <output.wav> [bits (4, 3, 2), default 3] [block size, default up to %i samples]\n", argv[0], MIXER_ADPCM_BLOCK_MAX);
+		fprintf(stderr, "       %s --report <input.wav> [block size]\n", argv[0]);
+		return 1;
+	}
+	const char* in_path = argv[report ? 2 : 1];
+	int bits = !report && argc >= 4 ? atoi(argv[3]) : 3;
+	int block_size = argc >= (report ? 4 : 5) ? atoi(argv[report ? 3 : 4]) : 0;
+	if (bits < WAV_IMA_ADPCM_MIN_BITS || bits > WAV_IMA_ADPCM_MAX_BITS || (block_size != 0 && (block_size < 16 || block_size > 0xFFFF)))
+	{
+		fprintf(stderr, "unsupported bits per sample or block size\n");
+		return 1;
+	}
+
+	size_t src_size;
+	uint8_t* src = read_file(in_path, &src_size);
+	wav_file_desc desc;
+	if (src == NULL || !wav_parse_header(src, src_size, &desc))
+	{
+		fprintf(stderr, "could not read %s\n", in_path);
+		return 1;
+	}
+	bool pcm16 = desc.sample_format == 1 && desc.bits_per_sample == 16;
+	if (!pcm16 && !(desc.sample_format == 0x11 && desc.channel_count == 1))
+	{
+		fprintf(stderr, "%s: need 16 bit PCM or mono IMA ADPCM\n", in_path);
+		return 1;
+	}
+
+	double ns_per_sample;
+	float* samples = decode_wav(&desc, &ns_per_sample);
+	printf("%s: %i samples at %iHz, %zu bytes", in_path, desc.sample_count, desc.sample_rate, src_size);
+	if (pcm16)
+		printf(" (16 bit PCM)\n");
+	else
+		printf(" (%i bit IMA ADPCM, decode %.2f ns/sample)\n", desc.bits_per_sample, ns_per_sample);
+
+	int res = 0;
+	if (report)
+	{
+		for (int b = WAV_IMA_ADPCM_MAX_BITS; b >= WAV_IMA_ADPCM_MIN_BITS; --b)
+			res |= convert(samples, &desc, src_size, b, block_size, NULL);
+	}
+	else
+	{
+		res = convert(samples, &desc, src_size, bits, block_size, argv[2]);
+	}
+	free(samples);
+	free(src);
+	return res;
+}